@@ -0,0 +1,334 @@
+#define _POSIX_C_SOURCE 200112L
+#include "batch.h"
+#include "bmp.h"
+#include <glob.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Наибольшее число рабочих потоков
+#define BATCH_MAX_JOBS 256
+
+// Размер блока чтения и записи файла (в байтах)
+#define BATCH_BLOCK_BYTES (4 * 1024 * 1024)
+
+// Наибольшая длина строки списка файлов
+#define BATCH_LINE_SIZE 8192
+
+static char* batch_strdup(const char* text, size_t length) {
+    char* copy = (char*)malloc(length + 1);
+    if (copy) {
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+static BatchList* batch_list_create(void) {
+    return (BatchList*)calloc(1, sizeof(BatchList));
+}
+
+// Добавляет пару (строки копируются)
+static bool batch_list_add(BatchList* list, const char* input, size_t input_length,
+                           const char* output, size_t output_length) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? 2 * list->capacity : 64;
+        BatchItem* items = (BatchItem*)realloc(list->items, capacity * sizeof(BatchItem));
+        if (!items) return false;
+        list->items = items;
+        list->capacity = capacity;
+    }
+
+    BatchItem* item = &list->items[list->count];
+    item->input = batch_strdup(input, input_length);
+    item->output = batch_strdup(output, output_length);
+    if (!item->input || !item->output) {
+        free(item->input);
+        free(item->output);
+        return false;
+    }
+    list->count++;
+    return true;
+}
+
+void batch_list_free(BatchList* list) {
+    if (!list) return;
+    for (int i = 0; i < list->count; i++) {
+        free(list->items[i].input);
+        free(list->items[i].output);
+    }
+    free(list->items);
+    free(list);
+}
+
+bool batch_is_pattern(const char* source) {
+    return strpbrk(source, "*?[") != NULL;
+}
+
+BatchList* batch_list_load(const char* filename) {
+    FILE* file = fopen(filename, "r");
+    BatchList* list = batch_list_create();
+    if (!file || !list) {
+        if (file) fclose(file);
+        batch_list_free(list);
+        return NULL;
+    }
+
+    char line[BATCH_LINE_SIZE];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        size_t length = strcspn(line, "\r\n");
+        line[length] = '\0';
+
+        // Пропуск пробелов в начале, пустых строк и комментариев
+        const char* input = line;
+        while (*input == ' ' || *input == '\t') input++;
+        if (*input == '\0' || *input == '#') continue;
+
+        // Разделитель - табуляция, если она есть, иначе первый пробел
+        const char* separator = strchr(input, '\t');
+        if (!separator) separator = strchr(input, ' ');
+        if (!separator) {
+            ok = false;
+            break;
+        }
+
+        const char* output = separator;
+        while (*output == ' ' || *output == '\t') output++;
+        size_t output_length = strlen(output);
+        while (output_length > 0 && (output[output_length - 1] == ' ' || output[output_length - 1] == '\t')) {
+            output_length--;
+        }
+        if (output_length == 0) {
+            ok = false;
+            break;
+        }
+
+        ok = batch_list_add(list, input, (size_t)(separator - input), output, output_length);
+    }
+
+    if (ferror(file)) ok = false;
+    fclose(file);
+    if (!ok) {
+        batch_list_free(list);
+        return NULL;
+    }
+    return list;
+}
+
+BatchList* batch_list_glob(const char* pattern, const char* output_dir) {
+    BatchList* list = batch_list_create();
+    if (!list) return NULL;
+
+    glob_t found;
+    int status = glob(pattern, 0, NULL, &found);
+    if (status == GLOB_NOMATCH) {
+        return list;  // Пустой список - не ошибка разбора
+    }
+    if (status != 0) {
+        batch_list_free(list);
+        return NULL;
+    }
+
+    bool ok = true;
+    size_t dir_length = strlen(output_dir);
+    for (size_t i = 0; i < found.gl_pathc && ok; i++) {
+        const char* input = found.gl_pathv[i];
+        const char* slash = strrchr(input, '/');
+        const char* name = slash ? slash + 1 : input;
+
+        // Каталог результата + '/' + имя входного файла
+        size_t name_length = strlen(name);
+        char* output = (char*)malloc(dir_length + 1 + name_length + 1);
+        if (!output) {
+            ok = false;
+            break;
+        }
+        memcpy(output, output_dir, dir_length);
+        output[dir_length] = '/';
+        memcpy(output + dir_length + 1, name, name_length + 1);
+
+        ok = batch_list_add(list, input, strlen(input), output, strlen(output));
+        free(output);
+    }
+
+    globfree(&found);
+    if (!ok) {
+        batch_list_free(list);
+        return NULL;
+    }
+    return list;
+}
+
+// Общее состояние рабочих: следующий свободный файл и число ошибок
+typedef struct {
+    Pipeline* pipeline;
+    const PipelineSource* source;
+    const BatchList* list;
+    PixelFormat format;
+    pthread_mutex_t lock;
+    int next;
+    int failed;
+} BatchJob;
+
+// Строки окна читаются блоками в spare, и каждый блок сразу меняет размер
+// в image: исходное изображение целиком в памяти не создается
+static bool batch_read_resized(BMPReader* reader, const ImageRegion* window, const Filter* resize,
+                               PixelFormat format, Image* image, Image* spare) {
+    ResizeStream* stream = resize_stream_create(resize, window->width, window->height, format, image);
+    int block_rows = (int)(BATCH_BLOCK_BYTES / ((size_t)window->width * pixel_format_size(format)));
+    if (block_rows < 1) block_rows = 1;
+
+    bool ok = stream != NULL;
+    for (int y = 0; y < window->height && ok; y += block_rows) {
+        int rows = (window->height - y < block_rows) ? window->height - y : block_rows;
+        ok = image_reshape(spare, window->width, rows, format) &&
+             bmp_reader_read_region(reader, window->x, window->y + y, rows, spare, 0) &&
+             resize_stream_push(stream, spare, 0, rows);
+    }
+    return resize_stream_finish(stream) && ok;
+}
+
+// Файл читается и пишется блоками строк, поэтому буферы кодека небольшие,
+// а память пикселей переиспользуется через image_reshape
+// Начало пайплайна source (обрезка, изменение размеров) выполняется при чтении
+bool batch_process_file(Pipeline* pipeline, const PipelineSource* source, const char* input, const char* output,
+                        PixelFormat format, Image** image, Image** spare) {
+    BMPReader* reader = bmp_reader_open(input);
+    if (!reader) {
+        return false;
+    }
+
+    ImageRegion window = {0, 0, reader->width, reader->height};
+    if (source && source->cropped) {
+        window = source->region;
+    }
+    if (!image_region_clip(&window, reader->width, reader->height)) {
+        bmp_reader_close(reader);
+        return false;
+    }
+    int height = window.height;
+    int block_rows = (int)(BATCH_BLOCK_BYTES / reader->row_stride);
+    if (block_rows < 1) block_rows = 1;
+
+    // Начальные оттенки серого - декодирование сразу в одноканальный формат
+    if (source && source->gray) {
+        format = pixel_format_gray(format);
+    }
+
+    ProfileMark mark;
+    if (pipeline->profile) {
+        profile_begin(&mark, *image, NULL);
+    }
+    bool ok;
+    if (source && source->resized) {
+        ok = batch_read_resized(reader, &window, &source->resize, format, *image, *spare);
+    } else {
+        ok = image_reshape(*image, window.width, height, format);
+        for (int y = 0; y < height && ok; y += block_rows) {
+            int rows = (height - y < block_rows) ? height - y : block_rows;
+            ok = bmp_reader_read_region(reader, window.x, window.y + y, rows, *image, y);
+        }
+    }
+    BMPInfoHeader info = reader->info_header;
+    bool alpha = reader->layout.alpha;  // сохраняется, если результат хранит ее (RGBA8)
+    bmp_reader_close(reader);
+    if (pipeline->profile) {
+        profile_end(pipeline->profile, &mark, "load", *image, NULL);
+    }
+
+    if (!ok || !pipeline_run_buffered(pipeline, image, spare)) {
+        return false;
+    }
+
+    const Image* result = *image;
+    BMPWriter* writer = bmp_writer_open(output, &info, result->width, result->height,
+                                        bmp_output_bpp(result->format, alpha));
+    if (!writer) {
+        return false;
+    }
+    if (pipeline->profile) {
+        profile_begin(&mark, result, NULL);
+    }
+    block_rows = (int)(BATCH_BLOCK_BYTES / writer->row_stride);
+    if (block_rows < 1) block_rows = 1;
+    for (int y = 0; y < result->height && ok; y += block_rows) {
+        int rows = (result->height - y < block_rows) ? result->height - y : block_rows;
+        ok = bmp_writer_write_rows(writer, result, y, rows);
+    }
+    if (!bmp_writer_close(writer)) {
+        ok = false;
+    }
+    if (pipeline->profile) {
+        profile_end(pipeline->profile, &mark, "save", result, NULL);
+    }
+    return ok;
+}
+
+static void* batch_worker(void* arg) {
+    BatchJob* job = (BatchJob*)arg;
+    Image* image = image_create_empty();
+    Image* spare = image_create_empty();
+
+    while (true) {
+        pthread_mutex_lock(&job->lock);
+        int index = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (index >= job->list->count) break;
+
+        const BatchItem* item = &job->list->items[index];
+        bool ok = image && spare &&
+                  batch_process_file(job->pipeline, job->source, item->input, item->output, job->format,
+                                     &image, &spare);
+        if (!ok) {
+            pthread_mutex_lock(&job->lock);
+            job->failed++;
+            fprintf(stderr, "Ошибка обработки: %s -> %s\n", item->input, item->output);
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+
+    image_free(image);
+    image_free(spare);
+    return NULL;
+}
+
+int batch_process(Pipeline* pipeline, const PipelineSource* source, const BatchList* list, PixelFormat format,
+                  int jobs) {
+    if (jobs <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (jobs <= 0) jobs = 1;
+    }
+    if (jobs > list->count) jobs = list->count;
+    if (jobs > BATCH_MAX_JOBS) jobs = BATCH_MAX_JOBS;
+
+    BatchJob job;
+    job.pipeline = pipeline;
+    job.source = source;
+    job.list = list;
+    job.format = format;
+    job.next = 0;
+    job.failed = 0;
+    pthread_mutex_init(&job.lock, NULL);
+
+    // Вызывающий поток тоже обрабатывает файлы
+    pthread_t threads[BATCH_MAX_JOBS];
+    int started = 0;
+    for (int i = 0; i < jobs - 1; i++) {
+        if (pthread_create(&threads[started], NULL, batch_worker, &job) != 0) {
+            break;
+        }
+        started++;
+    }
+    batch_worker(&job);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&job.lock);
+    return job.failed;
+}
@@ -0,0 +1,47 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "pipeline.h"
+
+// Пакетная обработка: один разобранный пайплайн для многих файлов в одном процессе
+// Файлы распределяются между рабочими потоками; у каждого потока свои буферы
+// изображения, которые переиспользуются от файла к файлу, а чтение и запись
+// одного файла идут одновременно с обработкой других
+
+// Пара входной и выходной файл
+typedef struct {
+    char* input;
+    char* output;
+} BatchItem;
+
+typedef struct {
+    BatchItem* items;
+    int count;
+    int capacity;
+} BatchList;
+
+// Список пар из текстового файла: строка "вход<TAB>выход" (или через пробел,
+// если в путях нет пробелов), пустые строки и строки с '#' пропускаются
+BatchList* batch_list_load(const char* filename);
+
+// Файлы по шаблону glob; результаты - в каталоге output_dir под теми же именами
+BatchList* batch_list_glob(const char* pattern, const char* output_dir);
+
+void batch_list_free(BatchList* list);
+
+// Шаблон ли это glob (есть '*', '?' или '[')
+bool batch_is_pattern(const char* source);
+
+// Обрабатывает все файлы списка в jobs рабочих потоков (<= 0 - по числу ядер)
+// Ошибки отдельных файлов сообщаются в stderr и не останавливают остальные
+// Возвращает число файлов, которые не удалось обработать
+// source - начало пайплайна, выполняемое при чтении каждого файла (NULL - нет)
+int batch_process(Pipeline* pipeline, const PipelineSource* source, const BatchList* list, PixelFormat format,
+                  int jobs);
+
+// Обрабатывает один файл в буферах вызывающего потока (*image и *spare
+// переиспользуются от файла к файлу); после успеха *image - результат
+bool batch_process_file(Pipeline* pipeline, const PipelineSource* source, const char* input, const char* output,
+                        PixelFormat format, Image** image, Image** spare);
+
+#endif // BATCH_H
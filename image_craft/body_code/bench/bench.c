@@ -0,0 +1,443 @@
+// bench.c
+// Замеры производительности фильтров, кодека BMP и типовых пайплайнов
+// на синтетических изображениях заданного размера
+// Результат - JSON (медиана и 95-й перцентиль времени, MPix/s, пиковая память),
+// по которому можно сравнивать версии между собой
+#define _POSIX_C_SOURCE 200112L
+#include "bmp.h"
+#include "filters.h"
+#include "pipeline.h"
+#include "threadpool.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Наибольшее число размеров изображений и замеров одного случая
+#define BENCH_MAX_SIZES 16
+#define BENCH_MAX_RUNS 1000
+
+// Наибольшее число фильтров в пайплайне случая
+#define BENCH_MAX_CHAIN 4
+
+// Что измеряется
+typedef enum {
+    BENCH_FILTER,       // Функция filter_apply_* для filter
+    BENCH_PIPELINE,     // pipeline_apply для цепочки chain
+    BENCH_SAVE,         // bmp_save
+    BENCH_LOAD,         // bmp_load
+    BENCH_LOAD_MAPPED   // bmp_load_mapped
+} BenchKind;
+
+typedef struct {
+    const char* name;
+    const char* params;               // Параметры для отчета
+    BenchKind kind;
+    Filter filter;                    // Для BENCH_FILTER
+    Filter chain[BENCH_MAX_CHAIN];    // Для BENCH_PIPELINE
+    int chain_length;
+} BenchCase;
+
+// Неразделимое ядро 5x5 для свертки
+static float bench_kernel_weights[25] = {
+    0, 1, 2, 1, 0,
+    1, 2, -4, 2, 1,
+    2, -4, 9, -4, 2,
+    1, 2, -4, 2, 1,
+    0, 1, 2, 1, 0
+};
+static const ConvKernel bench_kernel = {5, 5, bench_kernel_weights};
+
+// Размеры обрезки и изменения размеров задаются в процентах от изображения
+// (отрицательным числом) и подставляются перед запуском
+#define BENCH_CROP_PERCENT(p) (-(p))
+
+static const BenchCase bench_cases[] = {
+    {"crop", "1/2 x 1/2", BENCH_FILTER, {FILTER_CROP, BENCH_CROP_PERCENT(50), BENCH_CROP_PERCENT(50), 0, 0, 0, NULL}, {{0}}, 0},
+    {"grayscale", "", BENCH_FILTER, {FILTER_GRAYSCALE, 0, 0, 0, 0, 0, NULL}, {{0}}, 0},
+    {"negative", "", BENCH_FILTER, {FILTER_NEGATIVE, 0, 0, 0, 0, 0, NULL}, {{0}}, 0},
+    {"sharpening", "", BENCH_FILTER, {FILTER_SHARPENING, 0, 0, 0, 0, 0, NULL}, {{0}}, 0},
+    {"edge_detection", "threshold=0.1", BENCH_FILTER, {FILTER_EDGE_DETECTION, 0, 0, 0.1f, 0, 0, NULL}, {{0}}, 0},
+    {"median", "window=5", BENCH_FILTER, {FILTER_MEDIAN, 5, 0, 0, 0, 0, NULL}, {{0}}, 0},
+    {"median", "window=25", BENCH_FILTER, {FILTER_MEDIAN, 25, 0, 0, 0, 0, NULL}, {{0}}, 0},
+    {"gaussian_blur", "sigma=1.5", BENCH_FILTER, {FILTER_GAUSSIAN_BLUR, BLUR_METHOD_AUTO, 0, 1.5f, 0, 0, NULL}, {{0}}, 0},
+    {"gaussian_blur", "sigma=8", BENCH_FILTER, {FILTER_GAUSSIAN_BLUR, BLUR_METHOD_AUTO, 0, 8.0f, 0, 0, NULL}, {{0}}, 0},
+    {"crystallize", "cell_size=16", BENCH_FILTER, {FILTER_CRYSTALLIZE, 16, 0, 0, 0, 0, NULL}, {{0}}, 0},
+    {"glass", "distortion=0.5", BENCH_FILTER, {FILTER_GLASS, 0, 0, 0.5f, 0, 0, NULL}, {{0}}, 0},
+    {"convolution", "5x5", BENCH_FILTER, {FILTER_CONVOLUTION, 0, 0, 0, 0, 0, &bench_kernel}, {{0}}, 0},
+    {"resize", "1/4 box", BENCH_FILTER, {FILTER_RESIZE, BENCH_CROP_PERCENT(25), BENCH_CROP_PERCENT(25), 0, RESIZE_METHOD_BOX, 0, NULL}, {{0}}, 0},
+    {"resize", "1/4 lanczos", BENCH_FILTER, {FILTER_RESIZE, BENCH_CROP_PERCENT(25), BENCH_CROP_PERCENT(25), 0, RESIZE_METHOD_LANCZOS, 0, NULL}, {{0}}, 0},
+    {"bmp_save", "", BENCH_SAVE, {0}, {{0}}, 0},
+    {"bmp_load", "", BENCH_LOAD, {0}, {{0}}, 0},
+    {"bmp_load_mapped", "", BENCH_LOAD_MAPPED, {0}, {{0}}, 0},
+    {"pipeline", "-gs -neg -gs", BENCH_PIPELINE, {0}, {
+        {FILTER_GRAYSCALE, 0, 0, 0, 0, 0, NULL},
+        {FILTER_NEGATIVE, 0, 0, 0, 0, 0, NULL},
+        {FILTER_GRAYSCALE, 0, 0, 0, 0, 0, NULL}}, 3},
+    {"pipeline", "-sharp -blur 2 -edge 0.1", BENCH_PIPELINE, {0}, {
+        {FILTER_SHARPENING, 0, 0, 0, 0, 0, NULL},
+        {FILTER_GAUSSIAN_BLUR, BLUR_METHOD_AUTO, 0, 2.0f, 0, 0, NULL},
+        {FILTER_EDGE_DETECTION, 0, 0, 0.1f, 0, 0, NULL}}, 3},
+    {"pipeline", "-crop 3/4 -med 3 -gs -sharp", BENCH_PIPELINE, {0}, {
+        {FILTER_CROP, BENCH_CROP_PERCENT(75), BENCH_CROP_PERCENT(75), 0, 0, 0, NULL},
+        {FILTER_MEDIAN, 3, 0, 0, 0, 0, NULL},
+        {FILTER_GRAYSCALE, 0, 0, 0, 0, 0, NULL},
+        {FILTER_SHARPENING, 0, 0, 0, 0, 0, NULL}}, 4},
+};
+
+#define BENCH_CASE_COUNT ((int)(sizeof(bench_cases) / sizeof(bench_cases[0])))
+
+// Параметры запуска
+typedef struct {
+    double sizes[BENCH_MAX_SIZES];  // Размеры изображений в мегапикселях
+    int size_count;
+    int runs;                       // Замеров на случай
+    int warmup;                     // Прогонов без замера перед замерами
+    int threads;                    // 0 - по числу ядер
+    PixelFormat format;
+    const char* format_name;
+    const char* only;               // Подстрока имени случая (NULL - все случаи)
+    const char* output;             // Файл отчета (NULL - stdout)
+    const char* temp_file;          // Временный BMP для замеров кодека
+} BenchOptions;
+
+static void bench_help(void) {
+    fprintf(stderr, "Использование: image_craft_bench [параметры]\n\n");
+    fprintf(stderr, "  --sizes <MP,MP,...>   Размеры изображений в мегапикселях (по умолчанию 1,4)\n");
+    fprintf(stderr, "  --runs <N>            Замеров на случай (по умолчанию 5)\n");
+    fprintf(stderr, "  --warmup <N>          Прогонов без замера (по умолчанию 1)\n");
+    fprintf(stderr, "  --threads <N>         Число потоков (по умолчанию - по числу ядер)\n");
+    fprintf(stderr, "  --format <f32|rgb8|rgba8|rgb16|planar|gray8|grayf32>  Формат пикселей (по умолчанию f32)\n");
+    fprintf(stderr, "  --only <name>         Только случаи, в имени или параметрах которых есть name\n");
+    fprintf(stderr, "  --out <file>          Файл отчета JSON (по умолчанию stdout)\n");
+    fprintf(stderr, "  --tmp <file>          Временный BMP для замеров кодека (по умолчанию image_craft_bench.bmp)\n");
+}
+
+static bool bench_parse_sizes(const char* text, BenchOptions* options) {
+    options->size_count = 0;
+    const char* p = text;
+    while (*p) {
+        char* end;
+        double size = strtod(p, &end);
+        if (end == p || size <= 0 || options->size_count == BENCH_MAX_SIZES) {
+            return false;
+        }
+        options->sizes[options->size_count++] = size;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') {
+            return false;
+        }
+    }
+    return options->size_count > 0;
+}
+
+static bool bench_parse_options(int argc, char* argv[], BenchOptions* options) {
+    options->sizes[0] = 1;
+    options->sizes[1] = 4;
+    options->size_count = 2;
+    options->runs = 5;
+    options->warmup = 1;
+    options->threads = 0;
+    options->format = PIXEL_FORMAT_RGB_F32;
+    options->format_name = "f32";
+    options->only = NULL;
+    options->output = NULL;
+    options->temp_file = "image_craft_bench.bmp";
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--sizes") == 0 && has_value) {
+            if (!bench_parse_sizes(argv[++i], options)) return false;
+        } else if (strcmp(argv[i], "--runs") == 0 && has_value) {
+            options->runs = atoi(argv[++i]);
+            if (options->runs < 1 || options->runs > BENCH_MAX_RUNS) return false;
+        } else if (strcmp(argv[i], "--warmup") == 0 && has_value) {
+            options->warmup = atoi(argv[++i]);
+            if (options->warmup < 0) return false;
+        } else if (strcmp(argv[i], "--threads") == 0 && has_value) {
+            options->threads = atoi(argv[++i]);
+            if (options->threads < 1) return false;
+        } else if (strcmp(argv[i], "--format") == 0 && has_value) {
+            options->format_name = argv[++i];
+            if (!pixel_format_parse(options->format_name, &options->format)) return false;
+        } else if (strcmp(argv[i], "--only") == 0 && has_value) {
+            options->only = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && has_value) {
+            options->output = argv[++i];
+        } else if (strcmp(argv[i], "--tmp") == 0 && has_value) {
+            options->temp_file = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Синтетическое изображение: плавные градиенты с шумом и резкими границами,
+// чтобы медиана, выделение границ и кодек работали не на однородных данных
+static Image* bench_create_image(int width, int height, PixelFormat format) {
+    Image* image = image_create_format(width, height, format);
+    Color* row = (Color*)malloc((size_t)width * sizeof(Color));
+    if (!image || !row) {
+        image_free(image);
+        free(row);
+        return NULL;
+    }
+
+    uint32_t state = 0x12345678u;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            // xorshift32: воспроизводимый шум без общего состояния rand()
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            float noise = (state & 0xffff) / 65535.0f * 0.2f;
+            bool stripe = ((x / 64) + (y / 64)) % 2 == 0;
+
+            row[x].r = 0.8f * x / width + noise;
+            row[x].g = 0.8f * y / height + noise;
+            row[x].b = stripe ? 0.75f + noise : 0.1f + noise;
+        }
+        image_write_row(image, y, row);
+    }
+
+    free(row);
+    return image;
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Сброс пиковой памяти процесса (Linux 4.0+; иначе пик считается с начала работы)
+static void bench_reset_peak_rss(void) {
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (file) {
+        fputs("5", file);
+        fclose(file);
+    }
+}
+
+// Пиковая память процесса в килобайтах
+static long bench_peak_rss_kb(void) {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file) {
+        char line[256];
+        long peak = -1;
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "VmHWM: %ld", &peak) == 1) break;
+        }
+        fclose(file);
+        if (peak >= 0) return peak;
+    }
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        return usage.ru_maxrss;
+    }
+    return -1;
+}
+
+// Подстановка размеров обрезки и изменения размеров, заданных в процентах
+static Filter bench_resolve_filter(Filter filter, const Image* image) {
+    if ((filter.type == FILTER_CROP || filter.type == FILTER_RESIZE) && filter.param1 < 0) {
+        filter.param1 = (int)((int64_t)image->width * -filter.param1 / 100);
+        filter.param2 = (int)((int64_t)image->height * -filter.param2 / 100);
+    }
+    return filter;
+}
+
+// Вызов функции filter_apply_* для фильтра
+static Image* bench_apply_filter(const Filter* filter, const Image* image) {
+    switch (filter->type) {
+        case FILTER_CROP:
+            return filter_apply_crop(image, filter->param4, filter->param5, filter->param1, filter->param2);
+        case FILTER_GRAYSCALE:
+            return filter_apply_grayscale(image);
+        case FILTER_NEGATIVE:
+            return filter_apply_negative(image);
+        case FILTER_SHARPENING:
+            return filter_apply_sharpening(image);
+        case FILTER_EDGE_DETECTION:
+            return filter_apply_edge_detection(image, filter->param3);
+        case FILTER_MEDIAN:
+            return filter_apply_median(image, filter->param1);
+        case FILTER_GAUSSIAN_BLUR:
+            return filter_apply_gaussian_blur(image, filter->param3);
+        case FILTER_CRYSTALLIZE:
+            return filter_apply_crystallize(image, filter->param1);
+        case FILTER_GLASS:
+            return filter_apply_glass(image, filter->param3);
+        case FILTER_CONVOLUTION:
+            return filter_apply_convolution(image, filter->kernel);
+        case FILTER_RESIZE:
+            return filter_apply_resize(image, filter->param1, filter->param2, (ResizeMethod)filter->param4);
+    }
+    return NULL;
+}
+
+// Один прогон случая; false при ошибке
+static bool bench_run_once(const BenchCase* bench, const Image* image, Pipeline* pipeline,
+                           const BenchOptions* options) {
+    switch (bench->kind) {
+        case BENCH_FILTER: {
+            Filter filter = bench_resolve_filter(bench->filter, image);
+            Image* result = bench_apply_filter(&filter, image);
+            image_free(result);
+            return result != NULL;
+        }
+        case BENCH_PIPELINE: {
+            Image* result = pipeline_apply(pipeline, image);
+            image_free(result);
+            return result != NULL;
+        }
+        case BENCH_SAVE: {
+            // Изображение только заимствуется: заголовки заполняет bmp_save
+            BMPImage bmp;
+            memset(&bmp, 0, sizeof(bmp));
+            bmp.image = (Image*)image;
+            return bmp_save(&bmp, options->temp_file);
+        }
+        case BENCH_LOAD:
+        case BENCH_LOAD_MAPPED: {
+            BMPImage* bmp = (bench->kind == BENCH_LOAD)
+                ? bmp_load_format(options->temp_file, options->format)
+                : bmp_load_mapped(options->temp_file, options->format);
+            bmp_free(bmp);
+            return bmp != NULL;
+        }
+    }
+    return false;
+}
+
+static int bench_compare_times(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static bool bench_matches(const BenchCase* bench, const char* only) {
+    return !only || strstr(bench->name, only) || strstr(bench->params, only);
+}
+
+// Замеры одного случая на одном изображении и запись результата в JSON
+static bool bench_case(const BenchCase* bench, const Image* image, double megapixels,
+                       const BenchOptions* options, FILE* out, bool* first) {
+    Pipeline* pipeline = NULL;
+    if (bench->kind == BENCH_PIPELINE) {
+        pipeline = pipeline_create();
+        if (!pipeline) return false;
+        for (int i = 0; i < bench->chain_length; i++) {
+            Filter filter = bench_resolve_filter(bench->chain[i], image);
+            if (!pipeline_add(pipeline, &filter)) {
+                pipeline_free(pipeline);
+                return false;
+            }
+        }
+    }
+
+    double times[BENCH_MAX_RUNS];
+    bool ok = true;
+    bench_reset_peak_rss();
+    for (int i = 0; i < options->warmup && ok; i++) {
+        ok = bench_run_once(bench, image, pipeline, options);
+    }
+    for (int i = 0; i < options->runs && ok; i++) {
+        double start = bench_now();
+        ok = bench_run_once(bench, image, pipeline, options);
+        times[i] = bench_now() - start;
+    }
+    long peak_rss = bench_peak_rss_kb();
+    pipeline_free(pipeline);
+    if (!ok) {
+        fprintf(stderr, "Ошибка замера: %s %s\n", bench->name, bench->params);
+        return false;
+    }
+
+    // Медиана и 95-й перцентиль (ближайший ранг)
+    int runs = options->runs;
+    qsort(times, runs, sizeof(double), bench_compare_times);
+    double median = (runs % 2) ? times[runs / 2] : 0.5 * (times[runs / 2 - 1] + times[runs / 2]);
+    int p95_rank = (int)ceil(0.95 * runs);
+    double p95 = times[p95_rank - 1];
+
+    fprintf(out, "%s\n    {\"name\": \"%s\", \"params\": \"%s\", \"megapixels\": %.3f, "
+                 "\"width\": %d, \"height\": %d, \"median_ms\": %.3f, \"p95_ms\": %.3f, "
+                 "\"mpix_per_s\": %.2f, \"peak_rss_kb\": %ld}",
+            *first ? "" : ",", bench->name, bench->params, megapixels, image->width, image->height,
+            median * 1e3, p95 * 1e3, megapixels / median, peak_rss);
+    *first = false;
+
+    fprintf(stderr, "%6.1f MP  %-16s %-28s %10.2f ms  %8.1f MPix/s\n",
+            megapixels, bench->name, bench->params, median * 1e3, megapixels / median);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    if (!bench_parse_options(argc, argv, &options)) {
+        bench_help();
+        return 1;
+    }
+
+    FILE* out = options.output ? fopen(options.output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Не удалось открыть файл отчета: %s\n", options.output);
+        return 1;
+    }
+
+    threadpool_init(options.threads);
+
+    fprintf(out, "{\n  \"threads\": %d,\n  \"format\": \"%s\",\n  \"runs\": %d,\n  \"warmup\": %d,\n  \"results\": [",
+            threadpool_size(), options.format_name, options.runs, options.warmup);
+
+    bool ok = true;
+    bool first = true;
+    for (int s = 0; s < options.size_count && ok; s++) {
+        // Изображение 4:3 с заданным числом пикселей
+        double pixels = options.sizes[s] * 1e6;
+        int width = (int)lround(sqrt(pixels * 4.0 / 3.0));
+        int height = (int)lround(pixels / width);
+        if (width < 1) width = 1;
+        if (height < 1) height = 1;
+        double megapixels = (double)width * height / 1e6;
+
+        Image* image = bench_create_image(width, height, options.format);
+        if (!image) {
+            fprintf(stderr, "Не удалось создать изображение %dx%d\n", width, height);
+            ok = false;
+            break;
+        }
+
+        // Загрузка читает файл, записанный замером bmp_save, поэтому файл
+        // создается заранее на случай, если bmp_save не выбран
+        BMPImage bmp;
+        memset(&bmp, 0, sizeof(bmp));
+        bmp.image = image;
+        if (!bmp_save(&bmp, options.temp_file)) {
+            fprintf(stderr, "Не удалось записать временный файл: %s\n", options.temp_file);
+            image_free(image);
+            ok = false;
+            break;
+        }
+
+        for (int c = 0; c < BENCH_CASE_COUNT && ok; c++) {
+            if (bench_matches(&bench_cases[c], options.only)) {
+                ok = bench_case(&bench_cases[c], image, megapixels, &options, out, &first);
+            }
+        }
+        image_free(image);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    remove(options.temp_file);
+    threadpool_shutdown();
+    if (out != stdout) {
+        fclose(out);
+    }
+    return ok ? 0 : 1;
+}
@@ -1,90 +1,759 @@
+#define _POSIX_C_SOURCE 200112L
 #include "bmp.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Размер блока чтения/записи пиксельного массива (в байтах)
+#define BMP_READ_BLOCK_SIZE (4 * 1024 * 1024)
+#define BMP_WRITE_BLOCK_SIZE (4 * 1024 * 1024)
+// Блок чтения сжатого потока RLE: полосы читаются с разных мест потока,
+// поэтому блок небольшой
+#define BMP_RLE_BLOCK_SIZE (64 * 1024)
+
+// Сколько байт между BITMAPINFOHEADER и пикселями читается для разметки
+// (расширенный заголовок, маски, палитра - все лежит в начале этой части)
+#define BMP_MAX_HEADER_EXTRA (64 * 1024)
+
+// Размер заголовка BITMAPV4HEADER, с которым пишутся файлы с альфой
+#define BMP_V4_HEADER_SIZE 108
+// Палитра 8-битных файлов оттенков серого: 256 записей b, g, r, 0
+#define BMP_GRAY_PALETTE_SIZE (256 * 4)
+
+//*преобразует строку BGR8 из файла в строку Color
+void bmp_decode_row_bgr24(const uint8_t* src, Color* dst, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[x].r = src[3 * x + 2] / 255.0f;
+        dst[x].g = src[3 * x + 1] / 255.0f;
+        dst[x].b = src[3 * x + 0] / 255.0f;
+    }
+}
+
+// Перевод канала [0.0, 1.0] в байт с округлением и ограничением
+static inline uint8_t channel_to_byte(float value) {
+    float v = value * 255.0f;
+    if (!(v > 0.0f)) v = 0.0f;  // заодно отбрасывает NaN
+    if (v > 255.0f) v = 255.0f;
+    return (uint8_t)(v + 0.5f);
+}
+
+//*преобразует строку Color в строку BGR8 для записи в файл
+void bmp_encode_row_bgr24(const Color* src, uint8_t* dst, int width) {
+    const float* in = (const float*)src;  // r, g, b подряд
+    int count = width * 3;
+    int i = 0;
+
+#ifdef __SSE2__
+    // 16 каналов за итерацию: масштаб, ограничение, округление, упаковка в байты
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (; i + 16 <= count; i += 16) {
+        __m128 v0 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i), scale), zero), scale);
+        __m128 v1 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale), zero), scale);
+        __m128 v2 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 8), scale), zero), scale);
+        __m128 v3 = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(in + i + 12), scale), zero), scale);
+        __m128i i0 = _mm_cvttps_epi32(_mm_add_ps(v0, half));
+        __m128i i1 = _mm_cvttps_epi32(_mm_add_ps(v1, half));
+        __m128i i2 = _mm_cvttps_epi32(_mm_add_ps(v2, half));
+        __m128i i3 = _mm_cvttps_epi32(_mm_add_ps(v3, half));
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(i0, i1), _mm_packs_epi32(i2, i3));
+        _mm_storeu_si128((__m128i*)(dst + i), packed);
+    }
+#endif
+
+    for (; i < count; i++) {
+        dst[i] = channel_to_byte(in[i]);
+    }
+
+    // RGB -> BGR
+    for (int x = 0; x < width; x++) {
+        uint8_t r = dst[3 * x];
+        dst[3 * x] = dst[3 * x + 2];
+        dst[3 * x + 2] = r;
+    }
+}
+
+//*яркость пикселя для одноканальных форматов - как у фильтра оттенков серого
+//*(целочисленные коэффициенты для байта, float - для GRAY_F32)
+static inline uint8_t bmp_gray_byte(unsigned r, unsigned g, unsigned b) {
+    return (uint8_t)((19595u * r + 38470u * g + 7471u * b + 32768u) >> 16);
+}
+
+static inline float bmp_gray_float(unsigned r, unsigned g, unsigned b) {
+    return 0.299f * (r / 255.0f) + 0.587f * (g / 255.0f) + 0.114f * (b / 255.0f);
+}
+
+//*декодирует строку файла BGR8 в строку y изображения любого формата
+static void bmp_decode_row(const uint8_t* src, Image* image, int y) {
+    int width = image->width;
+    uint8_t* row = (pixel_format_planes(image->format) > 0) ? NULL : image_row_bytes(image, y);
+
+    switch (image->format) {
+        case PIXEL_FORMAT_RGB_F32:
+            bmp_decode_row_bgr24(src, (Color*)row, width);
+            break;
+        case PIXEL_FORMAT_RGB8:
+            for (int x = 0; x < width; x++) {
+                row[3 * x + 0] = src[3 * x + 2];
+                row[3 * x + 1] = src[3 * x + 1];
+                row[3 * x + 2] = src[3 * x + 0];
+            }
+            break;
+        case PIXEL_FORMAT_RGBA8:
+            for (int x = 0; x < width; x++) {
+                row[4 * x + 0] = src[3 * x + 2];
+                row[4 * x + 1] = src[3 * x + 1];
+                row[4 * x + 2] = src[3 * x + 0];
+                row[4 * x + 3] = 255;
+            }
+            break;
+        case PIXEL_FORMAT_RGB16: {
+            uint16_t* dst = (uint16_t*)row;
+            for (int x = 0; x < width; x++) {
+                dst[3 * x + 0] = (uint16_t)(src[3 * x + 2] * 257);
+                dst[3 * x + 1] = (uint16_t)(src[3 * x + 1] * 257);
+                dst[3 * x + 2] = (uint16_t)(src[3 * x + 0] * 257);
+            }
+            break;
+        }
+        case PIXEL_FORMAT_PLANAR_F32: {
+            float* r = image_plane_row(image, 0, y);
+            float* g = image_plane_row(image, 1, y);
+            float* b = image_plane_row(image, 2, y);
+            for (int x = 0; x < width; x++) {
+                r[x] = src[3 * x + 2] / 255.0f;
+                g[x] = src[3 * x + 1] / 255.0f;
+                b[x] = src[3 * x + 0] / 255.0f;
+            }
+            break;
+        }
+        case PIXEL_FORMAT_GRAY8:
+            for (int x = 0; x < width; x++) {
+                row[x] = bmp_gray_byte(src[3 * x + 2], src[3 * x + 1], src[3 * x + 0]);
+            }
+            break;
+        case PIXEL_FORMAT_GRAY_F32: {
+            float* v = image_plane_row(image, 0, y);
+            for (int x = 0; x < width; x++) {
+                v[x] = bmp_gray_float(src[3 * x + 2], src[3 * x + 1], src[3 * x + 0]);
+            }
+            break;
+        }
+    }
+}
+
+//*меняет местами байты 0 и 2 каждого 4-байтового пикселя (BGRA <-> RGBA)
+//*без alpha байт 3 результата - 255
+static void bmp_swap_red_blue(const uint8_t* src, uint8_t* dst, int width, bool alpha) {
+    int x = 0;
+
+#ifdef __SSE2__
+    // 4 пикселя за итерацию: зеленый и альфа на месте, красный и синий меняются
+    const __m128i keep = _mm_set1_epi32((int)0xFF00FF00);
+    const __m128i low = _mm_set1_epi32(0xFF);
+    const __m128i opaque = _mm_set1_epi32(alpha ? 0 : (int)0xFF000000);
+    for (; x + 4 <= width; x += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * x));
+        __m128i swapped = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), low),
+                                       _mm_slli_epi32(_mm_and_si128(v, low), 16));
+        __m128i out = _mm_or_si128(_mm_or_si128(_mm_and_si128(v, keep), swapped), opaque);
+        _mm_storeu_si128((__m128i*)(dst + 4 * x), out);
+    }
+#endif
+
+    for (; x < width; x++) {
+        uint8_t first = src[4 * x];
+        dst[4 * x + 0] = src[4 * x + 2];
+        dst[4 * x + 1] = src[4 * x + 1];
+        dst[4 * x + 2] = first;
+        dst[4 * x + 3] = alpha ? src[4 * x + 3] : 255;
+    }
+}
+
+//*стандартная ли разметка 32 бит: BGRA или BGR с неиспользуемым байтом
+static bool bmp_is_bgra32(const BMPLayout* layout) {
+    return layout->bpp == 32 && layout->masks[0] == 0x00FF0000 && layout->masks[1] == 0x0000FF00 &&
+           layout->masks[2] == 0x000000FF && (layout->masks[3] == 0 || layout->masks[3] == 0xFF000000);
+}
+
+//*сдвиг и наибольшее значение канала по маске (у пустой маски max = 0)
+static void bmp_mask_parts(uint32_t mask, int* shift, uint32_t* max) {
+    *shift = 0;
+    *max = 0;
+    if (mask == 0) return;
+    while (!((mask >> *shift) & 1)) (*shift)++;
+    *max = mask >> *shift;
+}
+
+//*распаковывает пиксели [x, x + width) строки файла в байты r, g, b, a
+//*палитра и маски - по таблицам, стандартные 32 бита - перестановкой байтов
+static void bmp_unpack_rgba(const BMPLayout* layout, const uint8_t* src, int x, int width, uint8_t* dst) {
+    // RLE распаковывается заранее в байты индексов
+    bool indexed = layout->compression == BMP_COMPRESSION_RLE8 || layout->compression == BMP_COMPRESSION_RLE4;
+    int bpp = indexed ? 8 : layout->bpp;
+
+    switch (bpp) {
+        case 1:
+            for (int i = 0; i < width; i++) {
+                int p = x + i;
+                memcpy(dst + 4 * i, layout->palette[(src[p >> 3] >> (7 - (p & 7))) & 1], 4);
+            }
+            return;
+        case 4:
+            for (int i = 0; i < width; i++) {
+                int p = x + i;
+                memcpy(dst + 4 * i, layout->palette[(src[p >> 1] >> ((p & 1) ? 0 : 4)) & 15], 4);
+            }
+            return;
+        case 8:
+            for (int i = 0; i < width; i++) {
+                memcpy(dst + 4 * i, layout->palette[src[x + i]], 4);
+            }
+            return;
+        case 24:
+            for (int i = 0; i < width; i++) {
+                const uint8_t* p = src + 3 * (size_t)(x + i);
+                dst[4 * i + 0] = p[2];
+                dst[4 * i + 1] = p[1];
+                dst[4 * i + 2] = p[0];
+                dst[4 * i + 3] = 255;
+            }
+            return;
+        default:
+            break;
+    }
+
+    if (bmp_is_bgra32(layout)) {
+        bmp_swap_red_blue(src + 4 * (size_t)x, dst, width, layout->alpha);
+        return;
+    }
+
+    // Произвольные маски 16 и 32 бит: канал переводится в [0, 255] с округлением
+    int shifts[4];
+    uint32_t max[4];
+    for (int c = 0; c < 4; c++) {
+        bmp_mask_parts(layout->masks[c], &shifts[c], &max[c]);
+    }
+    int step = bpp / 8;
+    for (int i = 0; i < width; i++) {
+        const uint8_t* p = src + (size_t)(x + i) * step;
+        uint32_t value = (step == 2) ? (uint32_t)(p[0] | p[1] << 8)
+                                     : (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+                                       (uint32_t)p[3] << 24;
+        for (int c = 0; c < 4; c++) {
+            uint64_t channel = (value & layout->masks[c]) >> shifts[c];
+            dst[4 * i + c] = max[c] ? (uint8_t)((channel * 255 + max[c] / 2) / max[c]) : 0;
+        }
+        if (!layout->alpha) dst[4 * i + 3] = 255;
+    }
+}
+
+//*записывает байты r, g, b, a в строку y изображения любого формата
+//*(альфа сохраняется только в RGBA8)
+static void bmp_store_rgba(const uint8_t* src, Image* image, int y) {
+    int width = image->width;
+
+    if (image->format == PIXEL_FORMAT_PLANAR_F32) {
+        float* r = image_plane_row(image, 0, y);
+        float* g = image_plane_row(image, 1, y);
+        float* b = image_plane_row(image, 2, y);
+        for (int x = 0; x < width; x++) {
+            r[x] = src[4 * x + 0] / 255.0f;
+            g[x] = src[4 * x + 1] / 255.0f;
+            b[x] = src[4 * x + 2] / 255.0f;
+        }
+        return;
+    }
+
+    if (image->format == PIXEL_FORMAT_GRAY_F32) {
+        float* v = image_plane_row(image, 0, y);
+        for (int x = 0; x < width; x++) {
+            v[x] = bmp_gray_float(src[4 * x + 0], src[4 * x + 1], src[4 * x + 2]);
+        }
+        return;
+    }
+
+    uint8_t* row = image_row_bytes(image, y);
+    switch (image->format) {
+        case PIXEL_FORMAT_RGB_F32: {
+            Color* dst = (Color*)row;
+            for (int x = 0; x < width; x++) {
+                dst[x].r = src[4 * x + 0] / 255.0f;
+                dst[x].g = src[4 * x + 1] / 255.0f;
+                dst[x].b = src[4 * x + 2] / 255.0f;
+            }
+            break;
+        }
+        case PIXEL_FORMAT_RGB8:
+            for (int x = 0; x < width; x++) {
+                row[3 * x + 0] = src[4 * x + 0];
+                row[3 * x + 1] = src[4 * x + 1];
+                row[3 * x + 2] = src[4 * x + 2];
+            }
+            break;
+        case PIXEL_FORMAT_RGBA8:
+            memcpy(row, src, (size_t)width * 4);
+            break;
+        case PIXEL_FORMAT_RGB16: {
+            uint16_t* dst = (uint16_t*)row;
+            for (int x = 0; x < width; x++) {
+                dst[3 * x + 0] = (uint16_t)(src[4 * x + 0] * 257);
+                dst[3 * x + 1] = (uint16_t)(src[4 * x + 1] * 257);
+                dst[3 * x + 2] = (uint16_t)(src[4 * x + 2] * 257);
+            }
+            break;
+        }
+        case PIXEL_FORMAT_GRAY8:
+            for (int x = 0; x < width; x++) {
+                row[x] = bmp_gray_byte(src[4 * x + 0], src[4 * x + 1], src[4 * x + 2]);
+            }
+            break;
+        case PIXEL_FORMAT_PLANAR_F32:
+        case PIXEL_FORMAT_GRAY_F32:
+            break;  // обработаны выше
+    }
+}
+
+//*декодирует пиксели [x, x + image->width) строки файла в строку y изображения
+//*scratch - строка r, g, b, a на image->width пикселей (не нужна для 24 бит и RGBA8)
+static void bmp_decode_pixels(const BMPLayout* layout, const uint8_t* src, int x,
+                              Image* image, int y, uint8_t* scratch) {
+    if (layout->bpp == 24) {
+        bmp_decode_row(src + 3 * (size_t)x, image, y);
+    } else if (image->format == PIXEL_FORMAT_RGBA8) {
+        bmp_unpack_rgba(layout, src, x, image->width, image_row_bytes(image, y));
+    } else {
+        bmp_unpack_rgba(layout, src, x, image->width, scratch);
+        bmp_store_rgba(scratch, image, y);
+    }
+}
+
+//*нужна ли bmp_decode_pixels строка scratch
+static bool bmp_needs_scratch(const BMPLayout* layout, PixelFormat format) {
+    return layout->bpp != 24 && format != PIXEL_FORMAT_RGBA8;
+}
+
+//*кодирует строку y изображения любого формата в строку файла BGR8
+static void bmp_encode_row(const Image* image, int y, uint8_t* dst) {
+    int width = image->width;
+    const uint8_t* row = (pixel_format_planes(image->format) > 0) ? NULL : image_row_bytes(image, y);
+
+    switch (image->format) {
+        case PIXEL_FORMAT_RGB_F32:
+            bmp_encode_row_bgr24((const Color*)row, dst, width);
+            break;
+        case PIXEL_FORMAT_RGB8:
+        case PIXEL_FORMAT_RGBA8: {
+            size_t step = pixel_format_size(image->format);
+            for (int x = 0; x < width; x++) {
+                dst[3 * x + 0] = row[x * step + 2];
+                dst[3 * x + 1] = row[x * step + 1];
+                dst[3 * x + 2] = row[x * step + 0];
+            }
+            break;
+        }
+        case PIXEL_FORMAT_RGB16: {
+            const uint16_t* src = (const uint16_t*)row;
+            for (int x = 0; x < width; x++) {
+                dst[3 * x + 0] = (uint8_t)((src[3 * x + 2] * 255u + 32767u) / 65535u);
+                dst[3 * x + 1] = (uint8_t)((src[3 * x + 1] * 255u + 32767u) / 65535u);
+                dst[3 * x + 2] = (uint8_t)((src[3 * x + 0] * 255u + 32767u) / 65535u);
+            }
+            break;
+        }
+        case PIXEL_FORMAT_PLANAR_F32: {
+            const float* r = image_plane_row(image, 0, y);
+            const float* g = image_plane_row(image, 1, y);
+            const float* b = image_plane_row(image, 2, y);
+            for (int x = 0; x < width; x++) {
+                dst[3 * x + 0] = channel_to_byte(b[x]);
+                dst[3 * x + 1] = channel_to_byte(g[x]);
+                dst[3 * x + 2] = channel_to_byte(r[x]);
+            }
+            break;
+        }
+        case PIXEL_FORMAT_GRAY8:
+            for (int x = 0; x < width; x++) {
+                dst[3 * x + 0] = dst[3 * x + 1] = dst[3 * x + 2] = row[x];
+            }
+            break;
+        case PIXEL_FORMAT_GRAY_F32: {
+            const float* v = image_plane_row(image, 0, y);
+            for (int x = 0; x < width; x++) {
+                dst[3 * x + 0] = dst[3 * x + 1] = dst[3 * x + 2] = channel_to_byte(v[x]);
+            }
+            break;
+        }
+    }
+}
+
+//*размер строки файла с выравниванием до 4 байт
+static size_t bmp_row_stride(int width, int bpp) {
+    return ((size_t)width * bpp + 31) / 32 * 4;
+}
+
+//*32-битное число little-endian (маски в заголовке)
+static uint32_t bmp_read_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void bmp_write_u32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+//*маска канала: пустая или из идущих подряд бит не шире разрядности пикселя
+static bool bmp_mask_valid(uint32_t mask, int bpp) {
+    int shift;
+    uint32_t max;
+    bmp_mask_parts(mask, &shift, &max);
+    return (max & (max + 1)) == 0 && (bpp == 32 || mask < (1u << bpp));
+}
+
+//*проверяет заголовки и разбирает разметку пикселей
+//*extra - первые size байт файла после BITMAPINFOHEADER (маски, палитра)
+static bool bmp_parse_layout(const BMPFileHeader* file_header, const BMPInfoHeader* info_header,
+                             const uint8_t* extra, size_t size, BMPLayout* layout) {
+    memset(layout, 0, sizeof(*layout));
+    if (file_header->type != 0x4D42 ||
+        info_header->size < sizeof(BMPInfoHeader) ||
+        info_header->width == 0 || info_header->height == 0) {
+        return false;
+    }
+
+    uint32_t compression = info_header->compression;
+    bool bitfields = compression == BMP_COMPRESSION_BITFIELDS || compression == BMP_COMPRESSION_ALPHABITFIELDS;
+    bool valid;
+    switch (info_header->bpp) {
+        case 1:
+            valid = compression == BMP_COMPRESSION_RGB;
+            break;
+        case 4:
+            valid = compression == BMP_COMPRESSION_RGB || compression == BMP_COMPRESSION_RLE4;
+            break;
+        case 8:
+            valid = compression == BMP_COMPRESSION_RGB || compression == BMP_COMPRESSION_RLE8;
+            break;
+        case 16:
+        case 32:
+            valid = compression == BMP_COMPRESSION_RGB || bitfields;
+            break;
+        case 24:
+            valid = compression == BMP_COMPRESSION_RGB;
+            break;
+        default:
+            valid = false;
+    }
+    // Сжатые RLE изображения хранятся только снизу вверх
+    if (!valid || ((compression == BMP_COMPRESSION_RLE8 || compression == BMP_COMPRESSION_RLE4) &&
+                   info_header->height < 0)) {
+        return false;
+    }
+    layout->bpp = info_header->bpp;
+    layout->compression = compression;
+
+    // Маски лежат сразу после BITMAPINFOHEADER: в расширенном заголовке
+    // или (у заголовка из 40 байт) отдельно перед палитрой
+    size_t palette_offset = info_header->size - sizeof(BMPInfoHeader);
+    if (bitfields) {
+        int count = (info_header->size >= 56 || compression == BMP_COMPRESSION_ALPHABITFIELDS) ? 4 : 3;
+        if (size < (size_t)count * 4) {
+            return false;
+        }
+        for (int c = 0; c < count; c++) {
+            layout->masks[c] = bmp_read_u32(extra + 4 * c);
+        }
+        if (info_header->size == sizeof(BMPInfoHeader)) {
+            palette_offset = (size_t)count * 4;
+        }
+    } else if (layout->bpp == 16) {
+        layout->masks[0] = 0x7C00;  // 5-5-5
+        layout->masks[1] = 0x03E0;
+        layout->masks[2] = 0x001F;
+    } else if (layout->bpp == 32) {
+        layout->masks[0] = 0x00FF0000;  // BGR и неиспользуемый байт
+        layout->masks[1] = 0x0000FF00;
+        layout->masks[2] = 0x000000FF;
+    }
+    if (layout->bpp == 16 || layout->bpp == 32) {
+        for (int c = 0; c < 4; c++) {
+            if (!bmp_mask_valid(layout->masks[c], layout->bpp) || (c < 3 && layout->masks[c] == 0)) {
+                return false;
+            }
+        }
+        layout->alpha = layout->masks[3] != 0;
+    }
+
+    // Палитра: по 4 байта (b, g, r, 0), недостающие цвета - черные
+    for (int i = 0; i < 256; i++) {
+        layout->palette[i][3] = 255;
+    }
+    if (layout->bpp <= 8) {
+        uint32_t colors = info_header->colors_used ? info_header->colors_used : (1u << layout->bpp);
+        if (colors > (1u << layout->bpp)) colors = 1u << layout->bpp;
+        size_t available = (size > palette_offset) ? (size - palette_offset) / 4 : 0;
+        if (colors > available) colors = (uint32_t)available;
+        if (colors == 0) {
+            return false;
+        }
+        for (uint32_t i = 0; i < colors; i++) {
+            const uint8_t* entry = extra + palette_offset + 4 * i;
+            layout->palette[i][0] = entry[2];
+            layout->palette[i][1] = entry[1];
+            layout->palette[i][2] = entry[0];
+        }
+        layout->colors = (int)colors;
+    }
+    return true;
+}
+
+//*читает и проверяет заголовки и разметку, оставляя файл в начале пиксельного массива
+static bool bmp_read_headers(FILE* file, BMPFileHeader* file_header, BMPInfoHeader* info_header,
+                             BMPLayout* layout) {
+    if (fread(file_header, sizeof(BMPFileHeader), 1, file) != 1 ||
+        fread(info_header, sizeof(BMPInfoHeader), 1, file) != 1) {
+        return false;
+    }
+
+    size_t headers = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
+    if (file_header->offset < headers) {
+        return false;
+    }
+    size_t size = file_header->offset - headers;
+    if (size > BMP_MAX_HEADER_EXTRA) size = BMP_MAX_HEADER_EXTRA;
+
+    uint8_t* extra = (uint8_t*)malloc(size ? size : 1);
+    bool ok = extra && fread(extra, 1, size, file) == size &&
+              bmp_parse_layout(file_header, info_header, extra, size, layout);
+    free(extra);
+
+    return ok && fseek(file, file_header->offset, SEEK_SET) == 0;
+}
+
+int bmp_output_bpp(PixelFormat format, bool alpha) {
+    if (pixel_format_channels(format) == 1) {
+        return 8;
+    }
+    return (alpha && format == PIXEL_FORMAT_RGBA8) ? 32 : 24;
+}
+
+//*заполняет заголовки для записи несжатого изображения сверху вниз:
+//*8 бит с палитрой оттенков серого, 24 бита BGR или 32 бита BGRA
+//*с заголовком BITMAPV4HEADER
+static void bmp_fill_headers(BMPFileHeader* file_header, BMPInfoHeader* info_header, int width, int height,
+                             int bpp) {
+    size_t row_stride = bmp_row_stride(width, bpp);
+
+    file_header->type = 0x4D42;
+    info_header->size = (bpp == 32) ? BMP_V4_HEADER_SIZE : sizeof(BMPInfoHeader);
+    info_header->width = width;
+    info_header->height = -height;
+    info_header->planes = 1;
+    info_header->bpp = (uint16_t)bpp;
+    info_header->compression = (bpp == 32) ? BMP_COMPRESSION_BITFIELDS : BMP_COMPRESSION_RGB;
+    info_header->image_size = (uint32_t)(row_stride * height);
+    info_header->colors_used = (bpp == 8) ? 256 : 0;
+    info_header->colors_important = 0;
+    file_header->offset = sizeof(BMPFileHeader) + info_header->size + ((bpp == 8) ? BMP_GRAY_PALETTE_SIZE : 0);
+    file_header->size = file_header->offset + info_header->image_size;
+}
+
+//*записывает заголовки; у BITMAPV4HEADER за полями BITMAPINFOHEADER идут
+//*маски r, g, b, a и цветовое пространство sRGB, у 8 бит - палитра
+static bool bmp_write_headers(FILE* file, const BMPFileHeader* file_header, const BMPInfoHeader* info_header) {
+    if (fwrite(file_header, sizeof(BMPFileHeader), 1, file) != 1 ||
+        fwrite(info_header, sizeof(BMPInfoHeader), 1, file) != 1) {
+        return false;
+    }
+    if (info_header->bpp == 8) {
+        uint8_t palette[BMP_GRAY_PALETTE_SIZE];
+        for (int i = 0; i < 256; i++) {
+            palette[4 * i + 0] = palette[4 * i + 1] = palette[4 * i + 2] = (uint8_t)i;
+            palette[4 * i + 3] = 0;
+        }
+        return fwrite(palette, sizeof(palette), 1, file) == 1;
+    }
+    if (info_header->size != BMP_V4_HEADER_SIZE) {
+        return true;
+    }
+
+    uint8_t tail[BMP_V4_HEADER_SIZE - sizeof(BMPInfoHeader)];
+    memset(tail, 0, sizeof(tail));
+    bmp_write_u32(tail + 0, 0x00FF0000);
+    bmp_write_u32(tail + 4, 0x0000FF00);
+    bmp_write_u32(tail + 8, 0x000000FF);
+    bmp_write_u32(tail + 12, 0xFF000000);
+    bmp_write_u32(tail + 16, 0x73524742);  // 'sRGB'
+    return fwrite(tail, sizeof(tail), 1, file) == 1;
+}
+
+//*кодирует строку y изображения в строку файла с bpp бит на пиксель:
+//*индексы палитры оттенков серого (из одноканальных форматов), BGR8
+//*или BGRA8 (только из RGBA8)
+static void bmp_encode_pixels(const Image* image, int y, uint8_t* dst, int bpp) {
+    if (bpp == 32) {
+        bmp_swap_red_blue(image_row_bytes(image, y), dst, image->width, true);
+    } else if (bpp == 8 && image->format == PIXEL_FORMAT_GRAY8) {
+        memcpy(dst, image_row_bytes(image, y), (size_t)image->width);
+    } else if (bpp == 8) {
+        const float* v = image_plane_row(image, 0, y);
+        for (int x = 0; x < image->width; x++) {
+            dst[x] = channel_to_byte(v[x]);
+        }
+    } else {
+        bmp_encode_row(image, y, dst);
+    }
+}
+
 BMPImage* bmp_load(const char* filename) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
+    return bmp_load_format(filename, PIXEL_FORMAT_RGB_F32);
+}
+
+BMPImage* bmp_load_format(const char* filename, PixelFormat format) {
+    BMPReader* reader = bmp_reader_open(filename);
+    if (!reader) {
         return NULL;
     }
 
     BMPImage* bmp = (BMPImage*)malloc(sizeof(BMPImage));
     if (!bmp) {
-        fclose(file);
+        bmp_reader_close(reader);
         return NULL;
     }
+    bmp->file_header = reader->file_header;
+    bmp->info_header = reader->info_header;
+    bmp->alpha = reader->layout.alpha;
 
-    if (fread(&bmp->file_header, sizeof(BMPFileHeader), 1, file) != 1) {
+    int width = reader->width;
+    int height = reader->height;
+    bmp->image = image_create_format(width, height, format);
+    if (!bmp->image) {
         free(bmp);
-        fclose(file);
+        bmp_reader_close(reader);
         return NULL;
     }
 
-    if (fread(&bmp->info_header, sizeof(BMPInfoHeader), 1, file) != 1) {
-        free(bmp);
-        fclose(file);
+    // Читаем пиксельный массив крупными блоками строк в порядке файла
+    int block_rows = (int)(BMP_READ_BLOCK_SIZE / reader->row_stride);
+    if (block_rows < 1) block_rows = 1;
+
+    for (int done = 0; done < height; done += block_rows) {
+        int rows = (height - done < block_rows) ? height - done : block_rows;
+        int y = reader->top_down ? done : height - done - rows;
+        if (!bmp_reader_read_rows(reader, y, rows, bmp->image, y)) {
+            bmp_free(bmp);
+            bmp_reader_close(reader);
+            return NULL;
+        }
+    }
+
+    bmp_reader_close(reader);
+    return bmp;
+}
+
+#ifndef _WIN32
+// Загрузка через отображение файла в память (mmap)
+// Пиксели декодируются прямо из отображения, без промежуточного буфера
+BMPImage* bmp_load_mapped(const char* filename, PixelFormat format) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         return NULL;
     }
 
-    if (bmp->file_header.type != 0x4D42) {
-        free(bmp);
-        fclose(file);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        // Не обычный файл (канал, устройство) - читаем обычным способом
+        close(fd);
+        return bmp_load_format(filename, format);
+    }
+
+    size_t file_size = (size_t)st.st_size;
+    if (file_size < sizeof(BMPFileHeader) + sizeof(BMPInfoHeader)) {
+        close(fd);
         return NULL;
     }
 
-    if (bmp->info_header.bpp != 24) {
-        free(bmp);
-        fclose(file);
+    const uint8_t* data = (const uint8_t*)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == (const uint8_t*)MAP_FAILED) {
+        return bmp_load_format(filename, format);
+    }
+    posix_madvise((void*)data, file_size, POSIX_MADV_SEQUENTIAL);
+
+    BMPImage* bmp = (BMPImage*)malloc(sizeof(BMPImage));
+    if (!bmp) {
+        munmap((void*)data, file_size);
         return NULL;
     }
+    memcpy(&bmp->file_header, data, sizeof(BMPFileHeader));
+    memcpy(&bmp->info_header, data + sizeof(BMPFileHeader), sizeof(BMPInfoHeader));
+    bmp->image = NULL;
 
-    if (bmp->info_header.compression != 0) {
+    // Проверяем заголовок по реальному размеру файла,
+    // чтобы обрезанный файл не читался наполовину
+    size_t headers = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
+    size_t offset = bmp->file_header.offset;
+    size_t extra = (offset > file_size ? file_size : offset) - headers;
+    if (extra > BMP_MAX_HEADER_EXTRA) extra = BMP_MAX_HEADER_EXTRA;
+    BMPLayout layout;
+    if (offset < headers || offset > file_size ||
+        !bmp_parse_layout(&bmp->file_header, &bmp->info_header, data + headers, extra, &layout)) {
         free(bmp);
-        fclose(file);
+        munmap((void*)data, file_size);
         return NULL;
     }
-
-    fseek(file, bmp->file_header.offset, SEEK_SET);
+    if (layout.compression == BMP_COMPRESSION_RLE8 || layout.compression == BMP_COMPRESSION_RLE4) {
+        // Строки RLE разной длины - распаковываются при чтении
+        free(bmp);
+        munmap((void*)data, file_size);
+        return bmp_load_format(filename, format);
+    }
 
     int width = abs(bmp->info_header.width);
     int height = abs(bmp->info_header.height);
     bool top_down = bmp->info_header.height < 0;
-    int row_padding = calculate_row_padding(width);
+    size_t row_stride = bmp_row_stride(width, layout.bpp);
+    bmp->alpha = layout.alpha;
 
-    bmp->image = image_create(width, height);
-    if (!bmp->image) {
+    uint8_t* scratch = NULL;
+    if ((file_size - offset) / row_stride < (size_t)height ||
+        (bmp_needs_scratch(&layout, format) && !(scratch = (uint8_t*)malloc((size_t)width * 4))) ||
+        !(bmp->image = image_create_format(width, height, format))) {
+        free(scratch);
         free(bmp);
-        fclose(file);
+        munmap((void*)data, file_size);
         return NULL;
     }
 
+    const uint8_t* pixels = data + offset;
     for (int y = 0; y < height; y++) {
         int target_y = top_down ? y : (height - 1 - y);
-        
-        for (int x = 0; x < width; x++) {
-            uint8_t pixel[3];
-            if (fread(pixel, 1, 3, file) != 3) {
-                image_free(bmp->image);
-                free(bmp);
-                fclose(file);
-                return NULL;
-            }
-
-            Color color = {
-                pixel[2] / 255.0f,
-                pixel[1] / 255.0f,
-                pixel[0] / 255.0f
-            };
-            image_set_pixel(bmp->image, x, target_y, color);
-        }
-
-        fseek(file, row_padding, SEEK_CUR);
+        bmp_decode_pixels(&layout, pixels + (size_t)y * row_stride, 0, bmp->image, target_y, scratch);
     }
 
-    fclose(file);
+    free(scratch);
+    munmap((void*)data, file_size);
     return bmp;
 }
+#else
+BMPImage* bmp_load_mapped(const char* filename, PixelFormat format) {
+    return bmp_load_format(filename, format);
+}
+#endif
 
 bool bmp_save(BMPImage* bmp, const char* filename) {
     FILE* file = fopen(filename, "wb");
@@ -94,35 +763,404 @@ bool bmp_save(BMPImage* bmp, const char* filename) {
 
     int width = bmp->image->width;
     int height = bmp->image->height;
-    int row_padding = calculate_row_padding(width);
-    
-    bmp->info_header.width = width;
-    bmp->info_header.height = -height;
-    bmp->info_header.image_size = (width * 3 + row_padding) * height;
-    bmp->file_header.size = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader) + bmp->info_header.image_size;
-
-    fwrite(&bmp->file_header, sizeof(BMPFileHeader), 1, file);
-    fwrite(&bmp->info_header, sizeof(BMPInfoHeader), 1, file);
-
-    uint8_t padding[3] = {0, 0, 0};
-    
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            Color color = image_get_pixel(bmp->image, x, y);
-            uint8_t pixel[3] = {
-                (uint8_t)(color.b * 255),
-                (uint8_t)(color.g * 255),
-                (uint8_t)(color.r * 255)
-            };
-            fwrite(pixel, 1, 3, file);
+    int bpp = bmp_output_bpp(bmp->image->format, bmp->alpha);
+    size_t pixel_bytes = (size_t)width * (bpp / 8);
+    size_t row_stride = bmp_row_stride(width, bpp);
+
+    bmp_fill_headers(&bmp->file_header, &bmp->info_header, width, height, bpp);
+
+    if (!bmp_write_headers(file, &bmp->file_header, &bmp->info_header)) {
+        fclose(file);
+        return false;
+    }
+
+    // Строки кодируются в общий буфер и пишутся крупными блоками
+    int block_rows = (int)(BMP_WRITE_BLOCK_SIZE / row_stride);
+    if (block_rows < 1) block_rows = 1;
+    if (block_rows > height) block_rows = height;
+
+    uint8_t* buffer = (uint8_t*)malloc((size_t)block_rows * row_stride);
+    if (!buffer) {
+        fclose(file);
+        return false;
+    }
+
+    bool ok = true;
+    for (int y = 0; y < height && ok; y += block_rows) {
+        int rows = (height - y < block_rows) ? height - y : block_rows;
+
+        for (int i = 0; i < rows; i++) {
+            uint8_t* row = buffer + (size_t)i * row_stride;
+            bmp_encode_pixels(bmp->image, y + i, row, bpp);
+            memset(row + pixel_bytes, 0, row_stride - pixel_bytes);
+        }
+
+        ok = fwrite(buffer, row_stride, rows, file) == (size_t)rows;
+    }
+
+    free(buffer);
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    return ok;
+}
+
+//ПОТОКОВОЕ ЧТЕНИЕ И ЗАПИСЬ
+
+//*переход к смещению в файле (гигапиксельные изображения занимают больше 2 ГБ)
+static bool bmp_seek(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+//*переходит к смещению offset сжатого потока RLE (внутри прочитанного блока -
+//*без обращения к файлу). Файл всегда стоит на конце прочитанного блока
+static bool bmp_rle_seek(BMPReader* reader, uint64_t offset) {
+    if (offset >= reader->rle_offset && offset - reader->rle_offset <= reader->rle_length) {
+        reader->rle_pos = (size_t)(offset - reader->rle_offset);
+        return true;
+    }
+    reader->rle_offset = offset;
+    reader->rle_pos = 0;
+    reader->rle_length = 0;
+    return bmp_seek(reader->file, (uint64_t)reader->file_header.offset + offset);
+}
+
+//*смещение текущего байта сжатого потока
+static uint64_t bmp_rle_tell(const BMPReader* reader) {
+    return reader->rle_offset + reader->rle_pos;
+}
+
+//*n байт сжатого потока с текущего места (команда или неупакованные индексы,
+//*n < 260); NULL - поток кончился раньше
+static const uint8_t* bmp_rle_fetch(BMPReader* reader, size_t n) {
+    if (reader->rle_length - reader->rle_pos < n) {
+        // Остаток блока переносится в начало, блок дочитывается
+        size_t rest = reader->rle_length - reader->rle_pos;
+        memmove(reader->rle_block, reader->rle_block + reader->rle_pos, rest);
+        reader->rle_offset += reader->rle_pos;
+        reader->rle_pos = 0;
+
+        uint64_t end = reader->rle_offset + rest;
+        size_t want = BMP_RLE_BLOCK_SIZE - rest;
+        if (end >= reader->rle_size) {
+            want = 0;
+        } else if (reader->rle_size - end < want) {
+            want = (size_t)(reader->rle_size - end);
+        }
+        reader->rle_length = rest + fread(reader->rle_block + rest, 1, want, reader->file);
+        if (reader->rle_length < n) {
+            return NULL;
+        }
+    }
+    const uint8_t* data = reader->rle_block + reader->rle_pos;
+    reader->rle_pos += n;
+    return data;
+}
+
+//*находит начала строк RLE8/RLE4 одним проходом по сжатому потоку (в памяти
+//*только блок чтения). Строки, пропущенные смещениями и концом изображения,
+//*остаются пустыми; поврежденный поток обрывается там, где кончились данные
+static void bmp_rle_index(BMPReader* reader) {
+    bool rle4 = reader->layout.compression == BMP_COMPRESSION_RLE4;
+    int width = reader->width;
+    int height = reader->height;
+    for (int y = 1; y < height; y++) {
+        reader->rle_rows[y].offset = UINT64_MAX;
+        reader->rle_rows[y].x = 0;
+    }
+    reader->rle_rows[0].offset = 0;
+    reader->rle_rows[0].x = 0;
+
+    int x = 0;
+    int y = 0;
+    const uint8_t* command;
+    while ((command = bmp_rle_fetch(reader, 2)) != NULL) {
+        int count = command[0];
+        int value = command[1];
+
+        if (count > 0) {
+            x = (count < width - x) ? x + count : width;
+        } else if (value == 0) {
+            x = 0;
+            if (++y >= height) break;
+            reader->rle_rows[y].offset = bmp_rle_tell(reader);
+        } else if (value == 1) {
+            break;
+        } else if (value == 2) {
+            const uint8_t* delta = bmp_rle_fetch(reader, 2);
+            if (!delta) break;
+            x = (delta[0] < width - x) ? x + delta[0] : width;
+            if (delta[1] > 0) {
+                // Смещение вниз: строка начинается с того же столбца
+                y += delta[1];
+                if (y >= height) break;
+                reader->rle_rows[y].offset = bmp_rle_tell(reader);
+                reader->rle_rows[y].x = x;
+            }
+        } else {
+            size_t bytes = rle4 ? (size_t)(value + 1) / 2 : (size_t)value;
+            if (!bmp_rle_fetch(reader, bytes) || ((bytes & 1) && !bmp_rle_fetch(reader, 1))) break;
+            x = (value < width - x) ? x + value : width;
+        }
+    }
+}
+
+//*распаковывает строку файла y (снизу вверх) в индексы палитры: байт на
+//*пиксель. Пиксели, пропущенные смещениями и концом строки, получают индекс 0
+static bool bmp_rle_decode_row(BMPReader* reader, int y, uint8_t* row) {
+    bool rle4 = reader->layout.compression == BMP_COMPRESSION_RLE4;
+    int width = reader->width;
+    const BMPRleRow* start = &reader->rle_rows[y];
+    memset(row, 0, (size_t)width);
+    if (start->offset == UINT64_MAX) {
+        return true;
+    }
+    if (!bmp_rle_seek(reader, start->offset)) {
+        return false;
+    }
+
+    int x = start->x;
+    const uint8_t* command;
+    while ((command = bmp_rle_fetch(reader, 2)) != NULL) {
+        int count = command[0];
+        int value = command[1];
+
+        if (count > 0) {
+            // Серия: один индекс (у RLE4 - два чередующихся)
+            for (int i = 0; i < count && x < width; i++, x++) {
+                row[x] = rle4 ? (uint8_t)((i & 1) ? value & 15 : value >> 4) : (uint8_t)value;
+            }
+        } else if (value == 0 || value == 1) {
+            break;
+        } else if (value == 2) {
+            // Смещение вниз заканчивает строку
+            const uint8_t* delta = bmp_rle_fetch(reader, 2);
+            if (!delta || delta[1] > 0) break;
+            x = (delta[0] < width - x) ? x + delta[0] : width;
+        } else {
+            // Неупакованные индексы, выровненные до четного числа байт
+            size_t bytes = rle4 ? (size_t)(value + 1) / 2 : (size_t)value;
+            const uint8_t* data = bmp_rle_fetch(reader, bytes);
+            if (!data) break;
+            for (int i = 0; i < value && x < width; i++, x++) {
+                row[x] = rle4 ? (uint8_t)((i & 1) ? data[i / 2] & 15 : data[i / 2] >> 4) : data[i];
+            }
+            if ((bytes & 1) && !bmp_rle_fetch(reader, 1)) break;
+        }
+    }
+    return true;
+}
+
+//*открывает BMP для чтения полосами строк (заголовки проверяются сразу)
+//*у RLE поток просматривается один раз, чтобы найти начала строк: строки
+//*полосы распаковываются при чтении, изображение целиком в памяти не нужно
+BMPReader* bmp_reader_open(const char* filename) {
+    BMPReader* reader = (BMPReader*)calloc(1, sizeof(BMPReader));
+    if (!reader) {
+        return NULL;
+    }
+
+    reader->file = fopen(filename, "rb");
+    if (!reader->file ||
+        !bmp_read_headers(reader->file, &reader->file_header, &reader->info_header, &reader->layout)) {
+        bmp_reader_close(reader);
+        return NULL;
+    }
+
+    reader->width = abs(reader->info_header.width);
+    reader->height = abs(reader->info_header.height);
+    reader->top_down = reader->info_header.height < 0;
+    reader->row_stride = bmp_row_stride(reader->width, reader->layout.bpp);
+
+    if (reader->layout.compression == BMP_COMPRESSION_RLE8 || reader->layout.compression == BMP_COMPRESSION_RLE4) {
+        // Размер сжатого потока из заголовка, если он не указан - до конца файла
+        reader->row_stride = (size_t)reader->width;
+        reader->rle_size = reader->info_header.image_size ? reader->info_header.image_size : UINT64_MAX;
+        reader->rle_rows = (BMPRleRow*)malloc((size_t)reader->height * sizeof(BMPRleRow));
+        reader->rle_block = (uint8_t*)malloc(BMP_RLE_BLOCK_SIZE);
+        if (!reader->rle_rows || !reader->rle_block) {
+            bmp_reader_close(reader);
+            return NULL;
+        }
+        bmp_rle_index(reader);
+    }
+    return reader;
+}
+
+//*читает строки [y, y + count) файла (нумерация сверху вниз)
+//*в строки изображения, начиная с image_y
+bool bmp_reader_read_rows(BMPReader* reader, int y, int count, Image* image, int image_y) {
+    if (image->width != reader->width) {
+        return false;
+    }
+    return bmp_reader_read_region(reader, 0, y, count, image, image_y);
+}
+
+//*читает окно файла: строки [y, y + count), столбцы [x, x + image->width)
+//*узкое окно читается построчно - с диска берутся только байты окна,
+//*иначе строки читаются одним блоком и декодируются только столбцы окна
+bool bmp_reader_read_region(BMPReader* reader, int x, int y, int count, Image* image, int image_y) {
+    if (x < 0 || y < 0 || count <= 0 || y + count > reader->height || x + image->width > reader->width) {
+        return false;
+    }
+
+    // Байты строки, в которых лежат пиксели окна (при 1 и 4 битах окно
+    // может начинаться с середины байта - тогда первые skip пикселей пропускаются)
+    int bpp = reader->rle_rows ? 8 : reader->layout.bpp;
+    size_t first_byte = (size_t)x * bpp / 8;
+    size_t span = ((size_t)(x + image->width) * bpp + 7) / 8 - first_byte;
+    int skip = x - (int)(first_byte * 8 / bpp);
+
+    bool by_rows = !reader->rle_rows && count > 1 && span * 2 < reader->row_stride;
+    size_t stride = by_rows ? span : reader->row_stride;
+    size_t pixels_size = (size_t)count * stride;
+    size_t scratch_size = bmp_needs_scratch(&reader->layout, image->format) ? (size_t)image->width * 4 : 0;
+    size_t size = pixels_size + scratch_size;
+    if (size > reader->capacity) {
+        uint8_t* buffer = (uint8_t*)realloc(reader->buffer, size);
+        if (!buffer) {
+            return false;
+        }
+        reader->buffer = buffer;
+        reader->capacity = size;
+    }
+    uint8_t* scratch = scratch_size ? reader->buffer + pixels_size : NULL;
+
+    // В файле снизу вверх строки полосы тоже лежат подряд, но в обратном порядке
+    int first = reader->top_down ? y : reader->height - y - count;
+    const uint8_t* pixels;
+    int pixels_x = x;
+    if (reader->rle_rows) {
+        // Строки полосы идут в потоке подряд, каждая распаковывается от своего начала
+        for (int i = 0; i < count; i++) {
+            if (!bmp_rle_decode_row(reader, first + i, reader->buffer + (size_t)i * stride)) {
+                return false;
+            }
         }
-        fwrite(padding, 1, row_padding, file);
+        pixels = reader->buffer;
+    } else {
+        uint64_t offset = reader->file_header.offset + (uint64_t)first * reader->row_stride;
+        if (by_rows) {
+            for (int i = 0; i < count; i++) {
+                if (!bmp_seek(reader->file, offset + (uint64_t)i * reader->row_stride + first_byte) ||
+                    fread(reader->buffer + (size_t)i * span, span, 1, reader->file) != 1) {
+                    return false;
+                }
+            }
+            pixels_x = skip;
+        } else if (!bmp_seek(reader->file, offset) ||
+                   fread(reader->buffer, reader->row_stride, count, reader->file) != (size_t)count) {
+            return false;
+        }
+        pixels = reader->buffer;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int target_y = reader->top_down ? image_y + i : image_y + count - 1 - i;
+        bmp_decode_pixels(&reader->layout, pixels + (size_t)i * stride, pixels_x, image, target_y, scratch);
+    }
+    return true;
+}
+
+void bmp_reader_close(BMPReader* reader) {
+    if (reader) {
+        if (reader->file) {
+            fclose(reader->file);
+        }
+        free(reader->rle_rows);
+        free(reader->rle_block);
+        free(reader->buffer);
+        free(reader);
+    }
+}
+
+//*создает BMP width x height и записывает заголовки; строки дописываются
+//*по порядку сверху вниз. Поля заголовков, не связанные с размером и форматом
+//*(например, разрешение), берутся из like, если он задан
+//*bpp - из bmp_output_bpp: 32-битные строки принимаются только из RGBA8,
+//*8-битные - только из одноканальных форматов
+BMPWriter* bmp_writer_open(const char* filename, const BMPInfoHeader* like, int width, int height, int bpp) {
+    if (width <= 0 || height <= 0 || (bpp != 8 && bpp != 24 && bpp != 32)) {
+        return NULL;
+    }
+
+    BMPWriter* writer = (BMPWriter*)calloc(1, sizeof(BMPWriter));
+    if (!writer) {
+        return NULL;
+    }
+
+    BMPFileHeader file_header;
+    BMPInfoHeader info_header;
+    memset(&file_header, 0, sizeof(file_header));
+    memset(&info_header, 0, sizeof(info_header));
+    if (like) {
+        info_header = *like;
+    }
+    bmp_fill_headers(&file_header, &info_header, width, height, bpp);
+
+    writer->width = width;
+    writer->height = height;
+    writer->bpp = bpp;
+    writer->row_stride = bmp_row_stride(width, bpp);
+    writer->file = fopen(filename, "wb");
+    if (!writer->file || !bmp_write_headers(writer->file, &file_header, &info_header)) {
+        bmp_writer_close(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+//*дописывает count строк изображения, начиная с image_y
+bool bmp_writer_write_rows(BMPWriter* writer, const Image* image, int image_y, int count) {
+    if (count <= 0 || writer->rows_written + count > writer->height || image->width != writer->width ||
+        (writer->bpp == 32 && image->format != PIXEL_FORMAT_RGBA8) ||
+        (writer->bpp == 8 && pixel_format_channels(image->format) != 1)) {
+        return false;
     }
 
-    fclose(file);
+    size_t size = (size_t)count * writer->row_stride;
+    if (size > writer->capacity) {
+        uint8_t* buffer = (uint8_t*)realloc(writer->buffer, size);
+        if (!buffer) {
+            return false;
+        }
+        writer->buffer = buffer;
+        writer->capacity = size;
+    }
+
+    size_t pixel_bytes = (size_t)writer->width * (writer->bpp / 8);
+    for (int i = 0; i < count; i++) {
+        uint8_t* row = writer->buffer + (size_t)i * writer->row_stride;
+        bmp_encode_pixels(image, image_y + i, row, writer->bpp);
+        memset(row + pixel_bytes, 0, writer->row_stride - pixel_bytes);
+    }
+
+    if (fwrite(writer->buffer, writer->row_stride, count, writer->file) != (size_t)count) {
+        return false;
+    }
+    writer->rows_written += count;
     return true;
 }
 
+//*закрывает файл; false, если записаны не все строки или запись не удалась
+bool bmp_writer_close(BMPWriter* writer) {
+    if (!writer) {
+        return false;
+    }
+
+    bool ok = writer->file && writer->rows_written == writer->height;
+    if (writer->file && fclose(writer->file) != 0) {
+        ok = false;
+    }
+    free(writer->buffer);
+    free(writer);
+    return ok;
+}
+
 void bmp_free(BMPImage* bmp) {
     if (bmp) {
         if (bmp->image) {
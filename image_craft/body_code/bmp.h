@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include "image.h"
 
 #pragma pack(push, 1)
@@ -32,12 +33,86 @@ typedef struct {
     BMPFileHeader file_header;
     BMPInfoHeader info_header;
     Image* image;
+    bool alpha;          // В исходном файле есть альфа: RGBA8 сохраняется 32-битным BGRA
 } BMPImage;
 #pragma pack(pop)
 
+// Сжатие пиксельного массива (поле compression)
+#define BMP_COMPRESSION_RGB 0
+#define BMP_COMPRESSION_RLE8 1
+#define BMP_COMPRESSION_RLE4 2
+#define BMP_COMPRESSION_BITFIELDS 3
+#define BMP_COMPRESSION_ALPHABITFIELDS 6
+
+// Разметка пикселей файла. Читаются 1, 4 и 8 бит с палитрой (8 и 4 бита -
+// и со сжатием RLE), 16 и 32 бита с масками каналов (BI_BITFIELDS), 24 бита BGR
+typedef struct {
+    int bpp;                  // Бит на пиксель
+    uint32_t compression;     // BMP_COMPRESSION_*
+    uint32_t masks[4];        // Маски r, g, b, a для 16 и 32 бит
+    bool alpha;               // Есть альфа-канал (ненулевая маска альфы)
+    int colors;               // Цветов в палитре
+    uint8_t palette[256][4];  // Палитра: r, g, b и a = 255
+} BMPLayout;
+
+// Начало строки RLE в сжатом потоке: первая команда строки и столбец,
+// с которого она пишет (строка может начинаться со смещения)
+typedef struct {
+    uint64_t offset;     // Смещение от начала пиксельного массива (UINT64_MAX - пустая строка)
+    int x;
+} BMPRleRow;
+
+// Потоковое чтение BMP полосами строк: в памяти только читаемая полоса
+typedef struct {
+    FILE* file;
+    BMPFileHeader file_header;
+    BMPInfoHeader info_header;
+    int width;
+    int height;
+    bool top_down;       // Строки в файле идут сверху вниз
+    BMPLayout layout;    // Разметка пикселей
+    size_t row_stride;   // Размер строки в файле с выравниванием (у RLE - строки индексов)
+    BMPRleRow* rle_rows; // Начала строк RLE в порядке файла (иначе NULL)
+    uint64_t rle_size;   // Размер сжатого потока (UINT64_MAX - до конца файла)
+    uint8_t* rle_block;  // Блок чтения сжатого потока
+    uint64_t rle_offset; // Смещение начала блока в потоке
+    size_t rle_pos;      // Текущий байт блока
+    size_t rle_length;   // Прочитано байт в блоке
+    uint8_t* buffer;     // Буфер чтения полосы
+    size_t capacity;
+} BMPReader;
+
+// Потоковая запись BMP: строки дописываются по порядку сверху вниз
+typedef struct {
+    FILE* file;
+    int width;
+    int height;
+    int rows_written;
+    int bpp;             // Бит на пиксель файла (см. bmp_output_bpp)
+    size_t row_stride;
+    uint8_t* buffer;     // Буфер кодирования полосы
+    size_t capacity;
+} BMPWriter;
+
 BMPImage* bmp_load(const char* filename);
+BMPImage* bmp_load_format(const char* filename, PixelFormat format);
+BMPImage* bmp_load_mapped(const char* filename, PixelFormat format);
 bool bmp_save(BMPImage* bmp, const char* filename);
 void bmp_free(BMPImage* bmp);
 int calculate_row_padding(int width);
+void bmp_decode_row_bgr24(const uint8_t* src, Color* dst, int width);
+void bmp_encode_row_bgr24(const Color* src, uint8_t* dst, int width);
+
+// Бит на пиксель файла для изображения формата format: 8 - оттенки серого
+// с палитрой (одноканальные форматы), 32 - BGRA (RGBA8 из файла с альфой), иначе 24
+int bmp_output_bpp(PixelFormat format, bool alpha);
+
+BMPReader* bmp_reader_open(const char* filename);
+bool bmp_reader_read_rows(BMPReader* reader, int y, int count, Image* image, int image_y);
+bool bmp_reader_read_region(BMPReader* reader, int x, int y, int count, Image* image, int image_y);
+void bmp_reader_close(BMPReader* reader);
+BMPWriter* bmp_writer_open(const char* filename, const BMPInfoHeader* like, int width, int height, int bpp);
+bool bmp_writer_write_rows(BMPWriter* writer, const Image* image, int image_y, int count);
+bool bmp_writer_close(BMPWriter* writer);
 
 #endif
@@ -1,61 +1,395 @@
 #include "filters.h"
+#include "filters_planar.h"
+#include "threadpool.h"
 #include <math.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <string.h>
-#include <time.h>
 
-// Вспомогательная функция для сравнения float (используется в qsort)
-static int compare_floats(const void* a, const void* b) {
-    float fa = *(const float*)a;
-    float fb = *(const float*)b;
-    return (fa > fb) - (fa < fb);  // Возвращает -1, 0, 1
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Ограничение координаты диапазоном [0, size - 1]
+static inline int clamp_coord(int v, int size) {
+    if (v < 0) return 0;
+    if (v >= size) return size - 1;
+    return v;
 }
 
-// Ограничение значений цвета в диапазоне [0.0, 1.0]
-static Color color_clamp(Color c) {
-    if (c.r < 0.0f) c.r = 0.0f;
-    if (c.g < 0.0f) c.g = 0.0f;
-    if (c.b < 0.0f) c.b = 0.0f;
-    if (c.r > 1.0f) c.r = 1.0f;
-    if (c.g > 1.0f) c.g = 1.0f;
-    if (c.b > 1.0f) c.b = 1.0f;
-    return c;
+// Имя фильтра для отчетов
+const char* filter_name(FilterType type) {
+    switch (type) {
+        case FILTER_CROP: return "crop";
+        case FILTER_GRAYSCALE: return "gs";
+        case FILTER_NEGATIVE: return "neg";
+        case FILTER_SHARPENING: return "sharp";
+        case FILTER_EDGE_DETECTION: return "edge";
+        case FILTER_MEDIAN: return "med";
+        case FILTER_GAUSSIAN_BLUR: return "blur";
+        case FILTER_CRYSTALLIZE: return "crystallize";
+        case FILTER_GLASS: return "glass";
+        case FILTER_CONVOLUTION: return "conv";
+        case FILTER_RESIZE: return "resize";
+    }
+    return "?";
 }
 
-// Фильтр обрезки (Crop)
-// Вырезает прямоугольную область из изображения
-Image* filter_apply_crop(const Image* image, int width, int height) {
-    // Определяем новые размеры (не больше исходных)
-    int new_width = (width < image->width) ? width : image->width;
-    int new_height = (height < image->height) ? height : image->height;
-    
-    // Создаем новое изображение
-    Image* result = image_create(new_width, new_height);
+// Может ли фильтр работать с форматом напрямую, без перевода во float
+bool filter_supports_format(FilterType type, PixelFormat format) {
+    switch (type) {
+        case FILTER_CROP:
+        case FILTER_GRAYSCALE:
+        case FILTER_NEGATIVE:
+        case FILTER_RESIZE:
+            return true;  // любой формат
+        case FILTER_CRYSTALLIZE:
+            return true;  // строки читаются и пишутся через Color
+        case FILTER_GLASS:
+            return true;  // пиксели копируются без изменений
+        case FILTER_SHARPENING:
+        case FILTER_EDGE_DETECTION:
+            return format != PIXEL_FORMAT_RGB16;
+        case FILTER_MEDIAN:
+            return format != PIXEL_FORMAT_RGB16 && format != PIXEL_FORMAT_PLANAR_F32;
+        case FILTER_GAUSSIAN_BLUR:
+        case FILTER_CONVOLUTION:
+        default:
+            return format == PIXEL_FORMAT_RGB_F32 ||  // нужна точность float
+                   format == PIXEL_FORMAT_PLANAR_F32 ||
+                   format == PIXEL_FORMAT_GRAY_F32;
+    }
+}
+
+// Выбор способа Гауссова размытия
+// При малых sigma точное ядро не медленнее каскада и не вносит погрешности
+#define BLUR_EXACT_MAX_SIGMA 2.0f
+// При sigma < 1 приближение Дерише заметно отходит от Гауссианы
+#define BLUR_IIR_MIN_SIGMA 1.0f
+// Число box-фильтров в каскаде
+#define BLUR_BOX_PASSES 4
+
+static BlurMethod blur_resolve_method(const Filter* filter) {
+    BlurMethod method = (BlurMethod)filter->param1;
+    float sigma = filter->param3;
+
+    if (method == BLUR_METHOD_AUTO) {
+        method = (sigma < BLUR_EXACT_MAX_SIGMA) ? BLUR_METHOD_EXACT : BLUR_METHOD_BOX;
+    }
+    if (method == BLUR_METHOD_IIR && sigma < BLUR_IIR_MIN_SIGMA) {
+        method = BLUR_METHOD_EXACT;
+    }
+    return method;
+}
+
+// Расширенный box-фильтр (Gwosdek и др.): 2 * radius + 1 отсчетов с весом inner
+// и по одному крайнему отсчету с весом outer. Дисперсия каскада из
+// BLUR_BOX_PASSES таких фильтров в точности равна sigma^2
+// Веса целые, в единицах 2^-BLUR_BOX_WEIGHT_BITS
+#define BLUR_BOX_WEIGHT_BITS 30
+
+typedef struct {
+    int radius;
+    int64_t inner;
+    int64_t outer;
+} BoxCascade;
+
+static BoxCascade box_cascade_init(float sigma) {
+    double variance = (double)sigma * sigma / BLUR_BOX_PASSES;
+
+    // Наибольший обычный box-фильтр с дисперсией r(r + 1)/3 не больше нужной
+    int radius = (int)floor(0.5 * sqrt(12.0 * variance + 1.0) - 0.5);
+
+    // Вес крайних отсчетов добирает недостающую дисперсию
+    double alpha = (2 * radius + 1) * (variance - radius * (radius + 1) / 3.0) /
+                   (2.0 * ((radius + 1.0) * (radius + 1.0) - variance));
+
+    double inner = 1.0 / (2 * radius + 1 + 2 * alpha);
+    BoxCascade box = {radius, 0, 0};
+    box.inner = (int64_t)llround(ldexp(inner, BLUR_BOX_WEIGHT_BITS));
+    box.outer = (int64_t)llround(ldexp(alpha * inner, BLUR_BOX_WEIGHT_BITS));
+    return box;
+}
+
+// sigma, для которой можно вычислить радиус ядра (без размытия - sigma <= 0)
+static bool blur_sigma_valid(float sigma) {
+    return isfinite(sigma) && sigma <= BLUR_MAX_SIGMA;
+}
+
+// Ореол фильтра: на сколько пикселей в каждую сторону он читает соседей
+// Результат пикселя зависит только от окна исходного изображения этого радиуса
+// (у границ изображения координаты ограничиваются, как и без разбиения на части)
+int filter_halo(const Filter* filter) {
+    switch (filter->type) {
+        case FILTER_GRAYSCALE:
+        case FILTER_NEGATIVE:
+            return 0;
+        case FILTER_SHARPENING:
+        case FILTER_EDGE_DETECTION:
+            return 1;  // окрестность 3x3
+        case FILTER_MEDIAN:
+            return filter->param1 / 2;
+        case FILTER_GAUSSIAN_BLUR:
+            if (!blur_sigma_valid(filter->param3)) {
+                return -1;  // фильтр завершится ошибкой при выполнении
+            }
+            if (filter->param3 <= 0) {
+                return 0;
+            }
+            switch (blur_resolve_method(filter)) {
+                case BLUR_METHOD_BOX:
+                    return BLUR_BOX_PASSES * (box_cascade_init(filter->param3).radius + 1);  // опора каскада
+                case BLUR_METHOD_IIR:
+                    return -1;  // отклик рекурсивного фильтра бесконечен
+                default:
+                    return (int)ceil(3 * filter->param3);
+            }
+        case FILTER_CONVOLUTION:
+            if (!filter->kernel) {
+                return -1;
+            }
+            return (filter->kernel->width > filter->kernel->height ? filter->kernel->width
+                                                                   : filter->kernel->height) / 2;
+        default:
+            return -1;  // обрезка и изменение размеров меняют размеры, кристаллизация и стекло нелокальны
+    }
+}
+
+// Применение фильтра к формату, который он не поддерживает напрямую:
+// изображение временно переводится во float, результат - обратно в исходный формат
+// (пайплайн переводит формат сам, поэтому здесь допустимы новые буферы)
+static Image* filter_apply_promoted(const Filter* filter, const Image* image) {
+    Image* promoted = image_convert(image, pixel_format_float(image->format));
+    if (!promoted) {
+        return NULL;
+    }
+
+    Image* processed = filter_apply(filter, promoted);
+    image_free(promoted);
+    if (!processed) {
+        return NULL;
+    }
+
+    Image* result = image_convert(processed, image->format);
+    image_free(processed);
     if (!result) {
         return NULL;
     }
-    
-    // Копируем пиксели из верхнего левого угла
-    for (int y = 0; y < new_height; y++) {
-        for (int x = 0; x < new_width; x++) {
-            Color color = image_get_pixel(image, x, y);
-            image_set_pixel(result, x, y, color);
+
+    // Альфа-канал сохраняется, если размеры не изменились
+    if (image->format == PIXEL_FORMAT_RGBA8 &&
+        result->width == image->width && result->height == image->height) {
+        for (size_t i = 0; i < (size_t)image->width * image->height; i++) {
+            result->pixels[4 * i + 3] = image->pixels[4 * i + 3];
         }
     }
-    
+
     return result;
 }
 
+// Задание для параллельной обработки полос строк
+// Поля используются по необходимости конкретным фильтром
+typedef struct {
+    const Image* src;     // Исходное изображение
+    Image* dst;           // Результат
+    const float* kernel;  // Одномерное ядро свертки
+    int radius;           // Радиус ядра или окна
+    float threshold;      // Порог (обнаружение границ)
+    const void* extra;    // Дополнительные данные фильтра
+} FilterJob;
+
+// Фильтры записывают результат либо на место (*image), либо в запасной буфер
+// (*spare), который после этого меняется местами с текущим изображением
+static void swap_images(Image** image, Image** spare) {
+    Image* temp = *image;
+    *image = *spare;
+    *spare = temp;
+}
+
+// Фильтр обрезки (Crop)
+// Вырезает прямоугольную область из изображения
+
+// Задание обрезки: окно с левым верхним углом (x, y) в исходном изображении
+typedef struct {
+    const Image* src;
+    Image* dst;
+    int x, y;
+} CropJob;
+
+// Копирует строки [y_begin, y_end) окна с углом (x, y) в строки результата
+static void crop_copy_rows(const Image* image, Image* result, int x, int y, int y_begin, int y_end) {
+    image_copy_region(image, x, y + y_begin, result, 0, y_begin, result->width, y_end - y_begin);
+}
+
+static void crop_rows(void* context, int y_begin, int y_end) {
+    const CropJob* job = (const CropJob*)context;
+    crop_copy_rows(job->src, job->dst, job->x, job->y, y_begin, y_end);
+}
+
+static bool crop_buffered(Image** image, Image** spare, int x, int y, int width, int height) {
+    Image* source = *image;
+
+    // Определяем новые размеры (не больше исходных)
+    ImageRegion region = {x, y, width, height};
+    if (!image_region_clip(&region, source->width, source->height)) {
+        return false;
+    }
+    int new_width = region.width;
+    int new_height = region.height;
+
+    if (x == 0 && y == 0 && new_width == source->width && new_height == source->height) {
+        return true;  // Обрезать нечего
+    }
+
+    // Окно от левого верхнего угла той же ширины: упакованные строки уже на своих местах
+    if (x == 0 && y == 0 && new_width == source->width && pixel_format_planes(source->format) == 0) {
+        return image_reshape(source, new_width, new_height, source->format);
+    }
+
+    if (!image_reshape(*spare, new_width, new_height, source->format)) {
+        return false;
+    }
+
+    CropJob job = {source, *spare, x, y};
+    parallel_for_rows(new_height, crop_rows, &job);
+
+    swap_images(image, spare);
+    return true;
+}
+
+// Оттенки серого для упакованных форматов (целочисленные коэффициенты, сумма 65536)
+static void grayscale_packed_rows(Image* image, int y_begin, int y_end) {
+    size_t count = (size_t)image->width * (y_end - y_begin);
+
+    if (image->format == PIXEL_FORMAT_RGB16) {
+        uint16_t* p = (uint16_t*)image_row_bytes(image, y_begin);
+        for (size_t i = 0; i < count; i++, p += 3) {
+            uint32_t gray = (19595u * p[0] + 38470u * p[1] + 7471u * p[2] + 32768u) >> 16;
+            p[0] = p[1] = p[2] = (uint16_t)gray;
+        }
+        return;
+    }
+
+    size_t step = pixel_format_size(image->format);
+    uint8_t* p = image_row_bytes(image, y_begin);
+    for (size_t i = 0; i < count; i++, p += step) {
+        uint32_t gray = (19595u * p[0] + 38470u * p[1] + 7471u * p[2] + 32768u) >> 16;
+        p[0] = p[1] = p[2] = (uint8_t)gray;
+    }
+}
+
+// Негатив для упакованных форматов (альфа не меняется)
+static void negative_packed_rows(Image* image, int y_begin, int y_end) {
+    size_t count = (size_t)image->width * (y_end - y_begin);
+
+    if (image->format == PIXEL_FORMAT_RGB16) {
+        uint16_t* p = (uint16_t*)image_row_bytes(image, y_begin);
+        for (size_t i = 0; i < count * 3; i++) {
+            p[i] = (uint16_t)(65535u - p[i]);
+        }
+        return;
+    }
+
+    if (image->format == PIXEL_FORMAT_GRAY8) {
+        uint8_t* p = image_row_bytes(image, y_begin);
+        for (size_t i = 0; i < count; i++) {
+            p[i] = (uint8_t)(255 - p[i]);
+        }
+        return;
+    }
+
+    size_t step = pixel_format_size(image->format);
+    uint8_t* p = image_row_bytes(image, y_begin);
+    for (size_t i = 0; i < count; i++, p += step) {
+        p[0] = (uint8_t)(255 - p[0]);
+        p[1] = (uint8_t)(255 - p[1]);
+        p[2] = (uint8_t)(255 - p[2]);
+    }
+}
+
+// Оттенки серого с переходом в одноканальный формат: строки [y_begin, y_end)
+// результата - яркость окна с углом (x, y) исходного изображения
+// Формулы те же, что и у расчета на месте, поэтому яркость та же
+static void grayscale_convert_rows(const Image* image, Image* result, int x, int y, int y_begin, int y_end) {
+    int width = result->width;
+
+    for (int row = y_begin; row < y_end; row++) {
+        switch (image->format) {
+            case PIXEL_FORMAT_RGB8: {
+                const uint8_t* p = image_row_bytes(image, y + row) + 3 * (size_t)x;
+                uint8_t* out = image_row_bytes(result, row);
+                for (int i = 0; i < width; i++, p += 3) {
+                    out[i] = (uint8_t)((19595u * p[0] + 38470u * p[1] + 7471u * p[2] + 32768u) >> 16);
+                }
+                break;
+            }
+            case PIXEL_FORMAT_RGB16: {
+                const uint16_t* p = (const uint16_t*)image_row_bytes(image, y + row) + 3 * (size_t)x;
+                float* out = image_plane_row(result, 0, row);
+                for (int i = 0; i < width; i++, p += 3) {
+                    out[i] = 0.299f * (p[0] / 65535.0f) + 0.587f * (p[1] / 65535.0f) + 0.114f * (p[2] / 65535.0f);
+                }
+                break;
+            }
+            case PIXEL_FORMAT_PLANAR_F32: {
+                const float* r = image_plane_row(image, 0, y + row) + x;
+                const float* g = image_plane_row(image, 1, y + row) + x;
+                const float* b = image_plane_row(image, 2, y + row) + x;
+                float* out = image_plane_row(result, 0, row);
+                int i = 0;
+#ifdef __SSE2__
+                const __m128 kr = _mm_set1_ps(0.299f);
+                const __m128 kg = _mm_set1_ps(0.587f);
+                const __m128 kb = _mm_set1_ps(0.114f);
+                for (; i + 4 <= width; i += 4) {
+                    __m128 gray = _mm_add_ps(_mm_add_ps(_mm_mul_ps(kr, _mm_loadu_ps(r + i)),
+                                                        _mm_mul_ps(kg, _mm_loadu_ps(g + i))),
+                                             _mm_mul_ps(kb, _mm_loadu_ps(b + i)));
+                    _mm_store_ps(out + i, gray);
+                }
+#endif
+                for (; i < width; i++) {
+                    out[i] = 0.299f * r[i] + 0.587f * g[i] + 0.114f * b[i];
+                }
+                break;
+            }
+            case PIXEL_FORMAT_RGB_F32: {
+                const Color* p = (const Color*)image_row_bytes(image, y + row) + x;
+                float* out = image_plane_row(result, 0, row);
+                for (int i = 0; i < width; i++) {
+                    out[i] = 0.299f * p[i].r + 0.587f * p[i].g + 0.114f * p[i].b;
+                }
+                break;
+            }
+            default:
+                break;  // RGBA8 и одноканальные форматы не переводятся
+        }
+    }
+}
+
 // Фильтр оттенков серого (Grayscale)
 // Преобразует цветное изображение в черно-белое
-Image* filter_apply_grayscale(const Image* image) {
-    // Создаем копию изображения
-    Image* result = image_clone(image);
-    if (!result) {
-        return NULL;
+// Одноканальное изображение уже серое; цветное, кроме RGBA8, переводится
+// в одноканальный формат в filter_apply_point_chain
+static void grayscale_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* image = job->src;
+    Image* result = job->dst;
+
+    if (pixel_format_channels(image->format) == 1) {
+        return;
     }
-    
+    if (image->format == PIXEL_FORMAT_PLANAR_F32) {
+        planar_grayscale_rows(result, y_begin, y_end);
+        return;
+    }
+    if (image->format != PIXEL_FORMAT_RGB_F32) {
+        grayscale_packed_rows(result, y_begin, y_end);
+        return;
+    }
+
     // Преобразуем каждый пиксель
-    for (int y = 0; y < image->height; y++) {
+    for (int y = y_begin; y < y_end; y++) {
         for (int x = 0; x < image->width; x++) {
             Color color = image_get_pixel(image, x, y);
             // Формула преобразования RGB в оттенки серого
@@ -65,327 +399,3049 @@ Image* filter_apply_grayscale(const Image* image) {
             image_set_pixel(result, x, y, gray_color);
         }
     }
-    
-    return result;
 }
 
-// Фильтр негатива (Negative)
-// Инвертирует цвета изображения
-Image* filter_apply_negative(const Image* image) {
-    Image* result = image_clone(image);
-    if (!result) {
-        return NULL;
+// Фильтр негатива (Negative)
+// Инвертирует цвета изображения
+static void negative_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* image = job->src;
+    Image* result = job->dst;
+
+    if (pixel_format_planes(image->format) > 0) {
+        planar_negative_rows(result, y_begin, y_end);
+        return;
+    }
+    if (image->format != PIXEL_FORMAT_RGB_F32) {
+        negative_packed_rows(result, y_begin, y_end);
+        return;
+    }
+
+    for (int y = y_begin; y < y_end; y++) {
+        for (int x = 0; x < image->width; x++) {
+            Color color = image_get_pixel(image, x, y);
+            // Инвертируем каждый канал: новый = 1.0 - исходный
+            Color negative = {1.0f - color.r, 1.0f - color.g, 1.0f - color.b};
+            image_set_pixel(result, x, y, negative);
+        }
+    }
+}
+
+// Оттенки серого и негатив выполняются на месте, без второго буфера
+static void point_in_place(Image* image, RowBandFunc func) {
+    FilterJob job = {image, image, NULL, 0, 0, NULL};
+    parallel_for_rows(image->height, func, &job);
+}
+
+// Слитное выполнение серии поэлементных фильтров (Crop, Grayscale, Negative)
+// Строки обрабатываются небольшими блоками: блок копируется из окна обрезки,
+// и все фильтры серии проходят по нему, пока он в кэше
+// Если серия начинается с оттенков серого цветного изображения, блок вместо
+// копирования сразу переводится в одноканальный формат
+#define POINT_CHAIN_BLOCK_BYTES (64 * 1024)
+
+typedef struct {
+    const FilterType* types;  // Поэлементные фильтры серии (кроме обрезки)
+    int count;
+    int x, y;                 // Угол окна обрезки в исходном изображении
+} PointChain;
+
+static void point_chain_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const PointChain* chain = (const PointChain*)job->extra;
+    Image* result = job->dst;
+
+    size_t row_size = (size_t)result->width * pixel_format_size(result->format);
+    int block_rows = (int)(POINT_CHAIN_BLOCK_BYTES / row_size);
+    if (block_rows < 1) block_rows = 1;
+
+    // Фильтры серии работают на месте в строках результата
+    FilterJob in_place = {result, result, NULL, 0, 0, NULL};
+
+    for (int y = y_begin; y < y_end; y += block_rows) {
+        int y_block_end = (y + block_rows < y_end) ? y + block_rows : y_end;
+
+        if (job->src->format != result->format) {
+            grayscale_convert_rows(job->src, result, chain->x, chain->y, y, y_block_end);
+        } else if (job->src != job->dst) {
+            crop_copy_rows(job->src, result, chain->x, chain->y, y, y_block_end);
+        }
+        for (int i = 0; i < chain->count; i++) {
+            if (chain->types[i] == FILTER_GRAYSCALE) {
+                grayscale_rows(&in_place, y, y_block_end);
+            } else {
+                negative_rows(&in_place, y, y_block_end);
+            }
+        }
+    }
+}
+
+// Поэлементный ли фильтр (результат пикселя зависит только от него самого)
+// Обрезка тоже считается поэлементной: она лишь выбирает окно
+bool filter_is_pointwise(FilterType type) {
+    return type == FILTER_CROP || type == FILTER_GRAYSCALE || type == FILTER_NEGATIVE;
+}
+
+bool filter_apply_point_chain(const Filter* filters, int count, Image** image, Image** spare) {
+    // Обрезки в серии сводятся к одному окну: поэлементные фильтры с ней перестановочны
+    Image* source = *image;
+    int width = source->width;
+    int height = source->height;
+
+    // Оттенки серого переводят цветное изображение в одноканальный формат
+    // Негативы перед ними обрабатывают еще цветное изображение, поэтому
+    // серия делится на две: до первых оттенков серого и начиная с них
+    PixelFormat format = pixel_format_gray(source->format);
+    int to_gray = 0;
+    for (int i = 0; i < count && format != source->format; i++) {
+        if (filters[i].type == FILTER_NEGATIVE) {
+            for (int j = i + 1; j < count; j++) {
+                if (filters[j].type == FILTER_GRAYSCALE) {
+                    return filter_apply_point_chain(filters, j, image, spare) &&
+                           filter_apply_point_chain(filters + j, count - j, image, spare);
+                }
+            }
+            break;
+        }
+        if (filters[i].type == FILTER_GRAYSCALE) {
+            to_gray = 1;
+            break;
+        }
+    }
+    if (!to_gray) {
+        format = source->format;
+    }
+
+    FilterType* types = (FilterType*)malloc((count > 0 ? count : 1) * sizeof(FilterType));
+    if (!types) {
+        return false;
+    }
+
+    // Угол окна накапливается: угол следующей обрезки отсчитывается от предыдущей
+    int x = 0, y = 0;
+    int type_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (filters[i].type == FILTER_CROP) {
+            ImageRegion region = {filters[i].param4, filters[i].param5, filters[i].param1, filters[i].param2};
+            if (!image_region_clip(&region, width, height)) {
+                free(types);
+                return false;
+            }
+            x += region.x;
+            y += region.y;
+            width = region.width;
+            height = region.height;
+        } else if (filter_is_pointwise(filters[i].type)) {
+            types[type_count++] = filters[i].type;
+        } else {
+            free(types);
+            return false;  // Не поэлементный фильтр
+        }
+    }
+
+    // Без обрезки (или с окном от левого верхнего угла той же ширины упакованных
+    // строк) серия идет на месте, иначе окно копируется в запасной буфер
+    // Перевод в одноканальный формат всегда пишет в запасной буфер
+    Image* result = source;
+    if (to_gray || x != 0 || y != 0 || width != source->width ||
+        (height != source->height && pixel_format_planes(source->format) > 0)) {
+        result = *spare;
+    }
+    if (!image_reshape(result, width, height, format)) {
+        free(types);
+        return false;
+    }
+
+    // Первые оттенки серого выполняет перевод формата
+    PointChain chain = {types + to_gray, type_count - to_gray, x, y};
+    FilterJob job = {source, result, NULL, 0, 0, &chain};
+    parallel_for_rows(height, point_chain_rows, &job);
+
+    if (result != source) {
+        swap_images(image, spare);
+    }
+    free(types);
+    return true;
+}
+
+// Свертка 3x3 - общая для повышения резкости, обнаружения границ и других ядер 3x3
+// Строка - width пикселей по channels чисел float подряд, соседи по горизонтали
+// отстоят на channels чисел (планарная плоскость и яркость - channels = 1)
+// Внутренняя часть строки считается без проверок координат (с SSE2 - по 4 числа),
+// с ограничением координат - только крайние пиксели; строки окна у верхнего
+// и нижнего краев выбирает вызывающий
+// Слагаемые идут в порядке строк ядра, нулевые веса пропускаются, поэтому результат
+// совпадает с поэлементной сверткой. Целые значения 8-битных форматов (и их
+// яркость x1000) представимы во float точно, как и их суммы, поэтому те же
+// функции дают для них точный целочисленный результат
+typedef struct {
+    int count;         // Ненулевых весов
+    int row[9];        // Строка окна: 0 - верхняя, 1 - текущая, 2 - нижняя
+    int dx[9];         // Смещение по горизонтали: -1, 0, 1
+    float weight[9];
+} Conv3x3;
+
+static Conv3x3 conv3x3_init(const float kernel[3][3]) {
+    Conv3x3 conv;
+    conv.count = 0;
+    for (int ky = 0; ky < 3; ky++) {
+        for (int kx = 0; kx < 3; kx++) {
+            if (kernel[ky][kx] != 0.0f) {
+                conv.row[conv.count] = ky;
+                conv.dx[conv.count] = kx - 1;
+                conv.weight[conv.count] = kernel[ky][kx];
+                conv.count++;
+            }
+        }
+    }
+    return conv;
+}
+
+// Одно число строки; left и right - смещения соседей (0 за краем строки)
+static inline float conv3x3_at(const Conv3x3* conv, const float* const rows[3], int i, int left, int right) {
+    float sum = 0.0f;
+    for (int t = 0; t < conv->count; t++) {
+        int offset = (conv->dx[t] < 0) ? left : (conv->dx[t] > 0 ? right : 0);
+        sum += rows[conv->row[t]][i + offset] * conv->weight[t];
+    }
+    return sum;
+}
+
+static void conv3x3_row(const Conv3x3* conv, const float* const rows[3], float* out, int width, int channels) {
+    int count = width * channels;
+
+    // Крайние пиксели - с ограничением координат
+    for (int c = 0; c < channels; c++) {
+        out[c] = conv3x3_at(conv, rows, c, 0, (width > 1) ? channels : 0);
+        if (width > 1) {
+            out[count - channels + c] = conv3x3_at(conv, rows, count - channels + c, -channels, 0);
+        }
+    }
+
+    // Внутренняя часть строки - без проверок
+    int i = channels;
+#ifdef __SSE2__
+    if (conv->count > 0) {
+        const float* taps[9];
+        __m128 weights[9];
+        for (int t = 0; t < conv->count; t++) {
+            taps[t] = rows[conv->row[t]] + conv->dx[t] * channels;
+            weights[t] = _mm_set1_ps(conv->weight[t]);
+        }
+        for (; i + 4 <= count - channels; i += 4) {
+            __m128 sum = _mm_mul_ps(_mm_loadu_ps(taps[0] + i), weights[0]);
+            for (int t = 1; t < conv->count; t++) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(taps[t] + i), weights[t]));
+            }
+            _mm_storeu_ps(out + i, sum);
+        }
+    }
+#endif
+    for (; i < count - channels; i++) {
+        out[i] = conv3x3_at(conv, rows, i, -channels, channels);
+    }
+}
+
+// Ограничение строки диапазоном [lo, hi]
+static void conv3x3_clamp_row(float* row, int count, float lo, float hi) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 low = _mm_set1_ps(lo);
+    const __m128 high = _mm_set1_ps(hi);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(row + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(row + i), low), high));
+    }
+#endif
+    for (; i < count; i++) {
+        float v = row[i];
+        if (v < lo) v = lo;
+        if (v > hi) v = hi;
+        row[i] = v;
+    }
+}
+
+// Окно из трех строк, переведенных во float, - свое у каждой полосы
+// Строка y попадает в ячейку y % 3 и пересчитывается, только когда окно сдвигается
+#define CONV3X3_WINDOW_ROWS 3
+
+typedef void (*Conv3x3RowLoader)(const Image* image, int y, float* out);
+
+typedef struct {
+    float* rows;
+    int cached[CONV3X3_WINDOW_ROWS];
+    int lanes;  // Чисел в строке
+} Conv3x3Window;
+
+static bool conv3x3_window_init(Conv3x3Window* window, int lanes) {
+    window->rows = (float*)malloc((size_t)CONV3X3_WINDOW_ROWS * lanes * sizeof(float));
+    window->lanes = lanes;
+    for (int i = 0; i < CONV3X3_WINDOW_ROWS; i++) {
+        window->cached[i] = -1;
+    }
+    return window->rows != NULL;
+}
+
+// Строки y - 1, y, y + 1 (с ограничением у краев изображения)
+static void conv3x3_window_rows(Conv3x3Window* window, const Image* image, int y,
+                                Conv3x3RowLoader load, const float* rows[3]) {
+    for (int ky = -1; ky <= 1; ky++) {
+        int row_y = clamp_coord(y + ky, image->height);
+        int slot = row_y % CONV3X3_WINDOW_ROWS;
+        float* row = window->rows + (size_t)slot * window->lanes;
+        if (window->cached[slot] != row_y) {
+            load(image, row_y, row);
+            window->cached[slot] = row_y;
+        }
+        rows[ky + 1] = row;
+    }
+}
+
+// Фильтр повышения резкости (Sharpening)
+// Усиливает контраст на границах объектов
+// Центральный элемент ядра усилен для выделения деталей
+static const float sharpening_kernel[3][3] = {
+    {0, -1, 0},
+    {-1, 5, -1},
+    {0, -1, 0}
+};
+
+// Каналы r, g, b строки 8-битного формата (альфа не участвует) или яркость GRAY8
+static void sharpening_u8_load_row(const Image* image, int y, float* out) {
+    const uint8_t* row = image_row_bytes(image, y);
+    size_t step = pixel_format_size(image->format);
+
+    if (step == 1) {
+        for (int x = 0; x < image->width; x++) {
+            out[x] = row[x];
+        }
+        return;
+    }
+
+    for (int x = 0; x < image->width; x++) {
+        out[3 * x + 0] = row[x * step + 0];
+        out[3 * x + 1] = row[x * step + 1];
+        out[3 * x + 2] = row[x * step + 2];
+    }
+}
+
+// Повышение резкости для 8-битных форматов (альфа не меняется)
+static void sharpening_u8_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* image = job->src;
+    Image* result = job->dst;
+    int width = image->width;
+    size_t step = pixel_format_size(image->format);
+    int channels = (step == 1) ? 1 : 3;
+    Conv3x3 conv = conv3x3_init(sharpening_kernel);
+
+    Conv3x3Window window;
+    float* sums = (float*)malloc((size_t)width * channels * sizeof(float));
+    if (!conv3x3_window_init(&window, width * channels) || !sums) {
+        free(window.rows);
+        free(sums);
+        *(bool*)job->extra = false;
+        return;
+    }
+
+    for (int y = y_begin; y < y_end; y++) {
+        const float* rows[3];
+        conv3x3_window_rows(&window, image, y, sharpening_u8_load_row, rows);
+        conv3x3_row(&conv, rows, sums, width, channels);
+        conv3x3_clamp_row(sums, width * channels, 0.0f, 255.0f);
+
+        const uint8_t* in = image_row_bytes(image, y);
+        uint8_t* out = image_row_bytes(result, y);
+        if (channels == 1) {
+            for (int x = 0; x < width; x++) {
+                out[x] = (uint8_t)sums[x];
+            }
+            continue;
+        }
+        for (int x = 0; x < width; x++) {
+            out[x * step + 0] = (uint8_t)sums[3 * x + 0];
+            out[x * step + 1] = (uint8_t)sums[3 * x + 1];
+            out[x * step + 2] = (uint8_t)sums[3 * x + 2];
+            if (step == 4) {
+                out[x * step + 3] = in[x * step + 3];
+            }
+        }
+    }
+
+    free(window.rows);
+    free(sums);
+}
+
+// Повышение резкости для float: строки изображения свертываются напрямую
+static void sharpening_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* image = job->src;
+    Image* result = job->dst;
+    Conv3x3 conv = conv3x3_init(sharpening_kernel);
+    int planes = pixel_format_planes(image->format);
+    bool planar = (planes > 0);
+
+    for (int y = y_begin; y < y_end; y++) {
+        int up = clamp_coord(y - 1, image->height);
+        int down = clamp_coord(y + 1, image->height);
+
+        for (int c = 0; c < (planar ? planes : 1); c++) {
+            const float* rows[3];
+            float* out;
+            if (planar) {
+                rows[0] = image_plane_row(image, c, up);
+                rows[1] = image_plane_row(image, c, y);
+                rows[2] = image_plane_row(image, c, down);
+                out = image_plane_row(result, c, y);
+            } else {
+                rows[0] = (const float*)image_row_bytes(image, up);
+                rows[1] = (const float*)image_row_bytes(image, y);
+                rows[2] = (const float*)image_row_bytes(image, down);
+                out = (float*)image_row_bytes(result, y);
+            }
+
+            int channels = planar ? 1 : 3;
+            conv3x3_row(&conv, rows, out, image->width, channels);
+            conv3x3_clamp_row(out, image->width * channels, 0.0f, 1.0f);
+        }
+    }
+}
+
+static bool sharpening_buffered(Image** image, Image** spare) {
+    Image* source = *image;
+    if (!image_reshape(*spare, source->width, source->height, source->format)) {
+        return false;
+    }
+
+    bool ok = true;  // полосы сбрасывают флаг при нехватке памяти
+    FilterJob job = {source, *spare, NULL, 0, 0, &ok};
+    if (source->format == PIXEL_FORMAT_RGB_F32 || pixel_format_planes(source->format) > 0) {
+        parallel_for_rows(source->height, sharpening_rows, &job);
+    } else {
+        parallel_for_rows(source->height, sharpening_u8_rows, &job);
+    }
+    if (!ok) {
+        return false;
+    }
+
+    swap_images(image, spare);
+    return true;
+}
+
+// Фильтр обнаружения границ (Edge Detection)
+// Выделяет границы объектов на изображении
+// Свертка с ядром Лапласа (8 * центр - сумма соседей) строк яркости
+static const float edge_kernel[3][3] = {
+    {-1, -1, -1},
+    {-1,  8, -1},
+    {-1, -1, -1}
+};
+
+// Строка яркости для 8-битных форматов в целых единицах (коэффициенты x1000, без округления)
+// У GRAY8 яркость уже готова: сумма коэффициентов - 1000
+static void edge_gray_u8_row(const Image* image, int y, float* gray) {
+    const uint8_t* row = image_row_bytes(image, y);
+    size_t step = pixel_format_size(image->format);
+
+    if (step == 1) {
+        for (int x = 0; x < image->width; x++) {
+            gray[x] = (float)(1000 * row[x]);
+        }
+        return;
+    }
+
+    for (int x = 0; x < image->width; x++) {
+        const uint8_t* p = row + x * step;
+        gray[x] = (float)(299 * p[0] + 587 * p[1] + 114 * p[2]);
+    }
+}
+
+// Строка оттенков серого (та же формула, что и у фильтра Grayscale)
+static void edge_gray_row(const Image* image, int y, float* gray) {
+    const Color* row = (const Color*)image_row_bytes(image, y);
+    for (int x = 0; x < image->width; x++) {
+        gray[x] = 0.299f * row[x].r + 0.587f * row[x].g + 0.114f * row[x].b;
+    }
+}
+
+static void edge_gray_planar_row(const Image* image, int y, float* gray) {
+    const float* r = image_plane_row(image, 0, y);
+    const float* g = image_plane_row(image, 1, y);
+    const float* b = image_plane_row(image, 2, y);
+    for (int x = 0; x < image->width; x++) {
+        gray[x] = 0.299f * r[x] + 0.587f * g[x] + 0.114f * b[x];
+    }
+}
+
+// Яркость GRAY_F32 не пересчитывается
+static void edge_gray_plane_row(const Image* image, int y, float* gray) {
+    memcpy(gray, image_plane_row(image, 0, y), (size_t)image->width * sizeof(float));
+}
+
+// Обнаружение границ (у 8-битных форматов альфа не меняется)
+static void edge_detection_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* image = job->src;
+    Image* result = job->dst;
+    int width = image->width;
+    int planes = pixel_format_planes(image->format);
+    bool planar = (planes > 0);
+    bool is_float = (image->format == PIXEL_FORMAT_RGB_F32) || planar;
+    size_t step = pixel_format_size(image->format);
+    Conv3x3 conv = conv3x3_init(edge_kernel);
+    Conv3x3RowLoader load = (planes == 1) ? edge_gray_plane_row
+                          : planar ? edge_gray_planar_row
+                          : (is_float ? edge_gray_row : edge_gray_u8_row);
+
+    // Порог задан для каналов [0.0, 1.0], яркость 8-битных форматов - в единицах 255 * 1000
+    double threshold = is_float ? job->threshold : job->threshold * 255.0 * 1000.0;
+
+    Conv3x3Window window;
+    float* sums = (float*)malloc((size_t)width * sizeof(float));
+    if (!conv3x3_window_init(&window, width) || !sums) {
+        free(window.rows);
+        free(sums);
+        *(bool*)job->extra = false;
+        return;
+    }
+
+    for (int y = y_begin; y < y_end; y++) {
+        const float* rows[3];
+        conv3x3_window_rows(&window, image, y, load, rows);
+        conv3x3_row(&conv, rows, sums, width, 1);
+
+        // Бинаризация по порогу: белый - граница, черный - фон
+        if (planar) {
+            for (int x = 0; x < width; x++) {
+                sums[x] = (sums[x] > threshold) ? 1.0f : 0.0f;
+            }
+            for (int c = 0; c < planes; c++) {
+                memcpy(image_plane_row(result, c, y), sums, (size_t)width * sizeof(float));
+            }
+        } else if (is_float) {
+            Color* out = (Color*)image_row_bytes(result, y);
+            for (int x = 0; x < width; x++) {
+                float value = (sums[x] > threshold) ? 1.0f : 0.0f;
+                out[x].r = out[x].g = out[x].b = value;
+            }
+        } else {
+            const uint8_t* in = image_row_bytes(image, y);
+            uint8_t* out = image_row_bytes(result, y);
+            for (int x = 0; x < width; x++) {
+                uint8_t color = (sums[x] > threshold) ? 255 : 0;
+                if (step == 1) {
+                    out[x] = color;
+                    continue;
+                }
+                out[x * step + 0] = out[x * step + 1] = out[x * step + 2] = color;
+                if (step == 4) {
+                    out[x * step + 3] = in[x * step + 3];
+                }
+            }
+        }
+    }
+
+    free(window.rows);
+    free(sums);
+}
+
+static bool edge_detection_buffered(Image** image, Image** spare, float threshold) {
+    Image* source = *image;
+    if (!image_reshape(*spare, source->width, source->height, source->format)) {
+        return false;
+    }
+
+    bool ok = true;  // полосы сбрасывают флаг при нехватке памяти
+    FilterJob job = {source, *spare, NULL, 0, threshold, &ok};
+    parallel_for_rows(source->height, edge_detection_rows, &job);
+    if (!ok) {
+        return false;
+    }
+
+    swap_images(image, spare);
+    return true;
+}
+
+// Свертка с ядром пользователя (Convolution)
+// Разделимое ядро (ранга 1: вес = column[y] * row[x]) применяется двумя одномерными
+// проходами - 2n умножений на пиксель вместо n^2. Иначе ядро 3x3 идет через общую
+// свертку 3x3, остальные - прямой двумерной сверткой. Функции для размеров 3, 5 и 7
+// получают размер константой и компилируются с полностью развернутыми циклами
+// Результат ограничивается диапазоном [0.0, 1.0], как у повышения резкости
+
+// Допуск проверки разделимости относительно наибольшего по модулю веса
+#define CONV_SEPARABLE_EPSILON 1e-6f
+
+// Ядро разделимо: находит множители column (высота ядра) и row (ширина)
+static bool conv_kernel_separate(const ConvKernel* kernel, float* column, float* row) {
+    int width = kernel->width;
+    int height = kernel->height;
+    const float* w = kernel->weights;
+
+    // Опорный элемент - наибольший по модулю вес
+    int pivot = 0;
+    for (int i = 1; i < width * height; i++) {
+        if (fabsf(w[i]) > fabsf(w[pivot])) {
+            pivot = i;
+        }
+    }
+    float scale = w[pivot];
+    if (scale == 0.0f) {
+        return false;
+    }
+
+    int pivot_y = pivot / width;
+    int pivot_x = pivot % width;
+    for (int y = 0; y < height; y++) {
+        column[y] = w[y * width + pivot_x];
+    }
+    for (int x = 0; x < width; x++) {
+        row[x] = w[pivot_y * width + x] / scale;
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            if (fabsf(w[y * width + x] - column[y] * row[x]) > CONV_SEPARABLE_EPSILON * fabsf(scale)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Строка горизонтальной свертки ядром из size весов
+// Строка - width пикселей по channels чисел, как у свертки 3x3
+static inline void conv_horizontal_row(const float* in, float* out, int width, int channels,
+                                       const float* weights, int size) {
+    int radius = size / 2;
+    int count = width * channels;
+    int edge = radius * channels;
+
+    // Крайние пиксели [0, left) и [right, width) - с ограничением координат
+    int left = (radius < width) ? radius : width;
+    int right = (width - radius > left) ? width - radius : left;
+    for (int x = 0; x < width; x++) {
+        if (x == left) {
+            x = right;  // внутренняя часть - ниже
+            if (x >= width) break;
+        }
+        for (int c = 0; c < channels; c++) {
+            float sum = 0.0f;
+            for (int k = 0; k < size; k++) {
+                sum += in[clamp_coord(x + k - radius, width) * channels + c] * weights[k];
+            }
+            out[x * channels + c] = sum;
+        }
+    }
+
+    // Внутренняя часть строки - без проверок
+    int i = edge;
+#ifdef __SSE2__
+    for (; i + 4 <= count - edge; i += 4) {
+        __m128 sum = _mm_mul_ps(_mm_loadu_ps(in + i - edge), _mm_set1_ps(weights[0]));
+        for (int k = 1; k < size; k++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(in + i - edge + k * channels), _mm_set1_ps(weights[k])));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count - edge; i++) {
+        float sum = 0.0f;
+        for (int k = 0; k < size; k++) {
+            sum += in[i - edge + k * channels] * weights[k];
+        }
+        out[i] = sum;
+    }
+}
+
+// Строка вертикальной свертки: rows - size строк окна (с ограничением у краев)
+static inline void conv_vertical_row(const float* const* rows, float* out, int count,
+                                     const float* weights, int size) {
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_mul_ps(_mm_loadu_ps(rows[0] + i), _mm_set1_ps(weights[0]));
+        for (int k = 1; k < size; k++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(weights[k])));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count; i++) {
+        float sum = 0.0f;
+        for (int k = 0; k < size; k++) {
+            sum += rows[k][i] * weights[k];
+        }
+        out[i] = sum;
+    }
+}
+
+// Строка двумерной свертки ядром size_x x size_y (rows - size_y строк окна)
+static inline void conv_2d_row(const float* const* rows, float* out, int width, int channels,
+                               const float* weights, int size_x, int size_y) {
+    int radius = size_x / 2;
+    int count = width * channels;
+    int edge = radius * channels;
+
+    int left = (radius < width) ? radius : width;
+    int right = (width - radius > left) ? width - radius : left;
+    for (int x = 0; x < width; x++) {
+        if (x == left) {
+            x = right;
+            if (x >= width) break;
+        }
+        for (int c = 0; c < channels; c++) {
+            float sum = 0.0f;
+            for (int ky = 0; ky < size_y; ky++) {
+                for (int kx = 0; kx < size_x; kx++) {
+                    sum += rows[ky][clamp_coord(x + kx - radius, width) * channels + c] * weights[ky * size_x + kx];
+                }
+            }
+            out[x * channels + c] = sum;
+        }
+    }
+
+    int i = edge;
+#ifdef __SSE2__
+    for (; i + 4 <= count - edge; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int ky = 0; ky < size_y; ky++) {
+            const float* row = rows[ky] + i - edge;
+            for (int kx = 0; kx < size_x; kx++) {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + kx * channels),
+                                                 _mm_set1_ps(weights[ky * size_x + kx])));
+            }
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < count - edge; i++) {
+        float sum = 0.0f;
+        for (int ky = 0; ky < size_y; ky++) {
+            for (int kx = 0; kx < size_x; kx++) {
+                sum += rows[ky][i - edge + kx * channels] * weights[ky * size_x + kx];
+            }
+        }
+        out[i] = sum;
+    }
+}
+
+// Варианты с размером-константой для частых размеров ядра
+typedef void (*ConvHorizontalRowFunc)(const float* in, float* out, int width, int channels, const float* weights);
+typedef void (*ConvVerticalRowFunc)(const float* const* rows, float* out, int count, const float* weights);
+typedef void (*Conv2DRowFunc)(const float* const* rows, float* out, int width, int channels, const float* weights);
+
+#define CONV_SPECIALIZE_1D(SIZE) \
+    static void conv_horizontal_row_##SIZE(const float* in, float* out, int width, int channels, \
+                                           const float* weights) { \
+        conv_horizontal_row(in, out, width, channels, weights, SIZE); \
+    } \
+    static void conv_vertical_row_##SIZE(const float* const* rows, float* out, int count, const float* weights) { \
+        conv_vertical_row(rows, out, count, weights, SIZE); \
+    }
+
+#define CONV_SPECIALIZE_2D(SIZE) \
+    static void conv_2d_row_##SIZE(const float* const* rows, float* out, int width, int channels, \
+                                   const float* weights) { \
+        conv_2d_row(rows, out, width, channels, weights, SIZE, SIZE); \
+    }
+
+CONV_SPECIALIZE_1D(3)
+CONV_SPECIALIZE_1D(5)
+CONV_SPECIALIZE_1D(7)
+CONV_SPECIALIZE_2D(5)  // Неразделимое 3x3 - общая свертка 3x3
+CONV_SPECIALIZE_2D(7)
+
+static ConvHorizontalRowFunc conv_horizontal_row_func(int size) {
+    switch (size) {
+        case 3: return conv_horizontal_row_3;
+        case 5: return conv_horizontal_row_5;
+        case 7: return conv_horizontal_row_7;
+        default: return NULL;
+    }
+}
+
+static ConvVerticalRowFunc conv_vertical_row_func(int size) {
+    switch (size) {
+        case 3: return conv_vertical_row_3;
+        case 5: return conv_vertical_row_5;
+        case 7: return conv_vertical_row_7;
+        default: return NULL;
+    }
+}
+
+static Conv2DRowFunc conv_2d_row_func(int size_x, int size_y) {
+    if (size_x != size_y) return NULL;
+    switch (size_x) {
+        case 5: return conv_2d_row_5;
+        case 7: return conv_2d_row_7;
+        default: return NULL;
+    }
+}
+
+// Способ применения ядра, общий для всех полос
+typedef struct {
+    const ConvKernel* kernel;
+    bool separable;
+    float column[CONV_KERNEL_MAX_SIZE];
+    float row[CONV_KERNEL_MAX_SIZE];
+    Conv3x3 conv3x3;  // Неразделимое ядро 3x3
+} ConvPlan;
+
+// Строки плоскости (или упакованного формата float) для канала c
+static float* conv_image_row(const Image* image, int c, int y) {
+    if (pixel_format_planes(image->format) > 0) {
+        return image_plane_row(image, c, y);
+    }
+    return (float*)image_row_bytes(image, y);
+}
+
+static void conv_horizontal_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const ConvPlan* plan = (const ConvPlan*)job->extra;
+    const Image* image = job->src;
+    int planes = pixel_format_planes(image->format);
+    bool planar = (planes > 0);
+    int channels = planar ? 1 : 3;
+    int size = plan->kernel->width;
+    ConvHorizontalRowFunc specialized = conv_horizontal_row_func(size);
+
+    for (int y = y_begin; y < y_end; y++) {
+        for (int c = 0; c < (planar ? planes : 1); c++) {
+            const float* in = conv_image_row(image, c, y);
+            float* out = conv_image_row(job->dst, c, y);
+            if (specialized) {
+                specialized(in, out, image->width, channels, plan->row);
+            } else {
+                conv_horizontal_row(in, out, image->width, channels, plan->row, size);
+            }
+        }
+    }
+}
+
+static void conv_vertical_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const ConvPlan* plan = (const ConvPlan*)job->extra;
+    const Image* image = job->src;
+    int planes = pixel_format_planes(image->format);
+    bool planar = (planes > 0);
+    int count = planar ? image->width : 3 * image->width;
+    int size = plan->kernel->height;
+    int radius = size / 2;
+    ConvVerticalRowFunc specialized = conv_vertical_row_func(size);
+
+    for (int y = y_begin; y < y_end; y++) {
+        for (int c = 0; c < (planar ? planes : 1); c++) {
+            const float* rows[CONV_KERNEL_MAX_SIZE];
+            for (int k = 0; k < size; k++) {
+                rows[k] = conv_image_row(image, c, clamp_coord(y + k - radius, image->height));
+            }
+            float* out = conv_image_row(job->dst, c, y);
+            if (specialized) {
+                specialized(rows, out, count, plan->column);
+            } else {
+                conv_vertical_row(rows, out, count, plan->column, size);
+            }
+            conv3x3_clamp_row(out, count, 0.0f, 1.0f);
+        }
+    }
+}
+
+static void conv_2d_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const ConvPlan* plan = (const ConvPlan*)job->extra;
+    const Image* image = job->src;
+    int planes = pixel_format_planes(image->format);
+    bool planar = (planes > 0);
+    int channels = planar ? 1 : 3;
+    int size_x = plan->kernel->width;
+    int size_y = plan->kernel->height;
+    int radius = size_y / 2;
+    Conv2DRowFunc specialized = conv_2d_row_func(size_x, size_y);
+
+    for (int y = y_begin; y < y_end; y++) {
+        for (int c = 0; c < (planar ? planes : 1); c++) {
+            const float* rows[CONV_KERNEL_MAX_SIZE];
+            for (int k = 0; k < size_y; k++) {
+                rows[k] = conv_image_row(image, c, clamp_coord(y + k - radius, image->height));
+            }
+            float* out = conv_image_row(job->dst, c, y);
+            if (size_x == 3 && size_y == 3) {
+                conv3x3_row(&plan->conv3x3, rows, out, image->width, channels);
+            } else if (specialized) {
+                specialized(rows, out, image->width, channels, plan->kernel->weights);
+            } else {
+                conv_2d_row(rows, out, image->width, channels, plan->kernel->weights, size_x, size_y);
+            }
+            conv3x3_clamp_row(out, image->width * channels, 0.0f, 1.0f);
+        }
+    }
+}
+
+static bool convolution_buffered(Image** image, Image** spare, const ConvKernel* kernel) {
+    if (!kernel) {
+        return false;
+    }
+
+    Image* source = *image;
+    if (!image_reshape(*spare, source->width, source->height, source->format)) {
+        return false;
+    }
+
+    ConvPlan plan;
+    plan.kernel = kernel;
+    plan.separable = conv_kernel_separate(kernel, plan.column, plan.row);
+
+    if (plan.separable) {
+        // По горизонтали в запасной буфер, по вертикали - обратно
+        FilterJob horizontal = {source, *spare, NULL, 0, 0, &plan};
+        FilterJob vertical = {*spare, source, NULL, 0, 0, &plan};
+        parallel_for_rows(source->height, conv_horizontal_rows, &horizontal);
+        parallel_for_rows(source->height, conv_vertical_rows, &vertical);
+        return true;
+    }
+
+    if (kernel->width == 3 && kernel->height == 3) {
+        plan.conv3x3 = conv3x3_init((const float (*)[3])kernel->weights);
+    }
+    FilterJob job = {source, *spare, NULL, 0, 0, &plan};
+    parallel_for_rows(source->height, conv_2d_rows, &job);
+    swap_images(image, spare);
+    return true;
+}
+
+// Разбор ядра: числа через пробелы, запятые или переводы строк
+// Ширина - число значений в первой строке (для строки "WxH:" задана явно)
+static bool conv_kernel_read_values(const char* text, ConvKernel* kernel, bool rows_by_lines) {
+    int capacity = CONV_KERNEL_MAX_SIZE * CONV_KERNEL_MAX_SIZE;
+    int count = 0;
+    int row_width = 0;      // Значений в текущей строке
+    float divisor = 1.0f;
+
+    const char* p = text;
+    while (*p) {
+        if (*p == '#') {
+            while (*p && *p != '\n') p++;
+            continue;
+        }
+        if (*p == '\n') {
+            if (rows_by_lines && row_width > 0) {
+                if (kernel->width == 0) {
+                    kernel->width = row_width;
+                } else if (row_width != kernel->width) {
+                    return false;  // строки разной длины
+                }
+                row_width = 0;
+            }
+            p++;
+            continue;
+        }
+        if (*p == ' ' || *p == '\t' || *p == '\r' || *p == ',' || *p == ';') {
+            p++;
+            continue;
+        }
+        if (*p == '/') {
+            char* end;
+            divisor = strtof(p + 1, &end);
+            if (end == p + 1 || divisor == 0.0f) {
+                return false;
+            }
+            p = end;
+            continue;
+        }
+
+        char* end;
+        float value = strtof(p, &end);
+        if (end == p || count >= capacity) {
+            return false;
+        }
+        kernel->weights[count++] = value;
+        row_width++;
+        p = end;
+    }
+    if (rows_by_lines && row_width > 0) {
+        if (kernel->width == 0) {
+            kernel->width = row_width;
+        } else if (row_width != kernel->width) {
+            return false;
+        }
+    }
+
+    if (kernel->width <= 0 || count == 0 || count % kernel->width != 0) {
+        return false;
+    }
+    if (kernel->height == 0) {
+        kernel->height = count / kernel->width;
+    }
+    if (count != kernel->width * kernel->height) {
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        kernel->weights[i] /= divisor;
+    }
+    return true;
+}
+
+// Содержимое текстового файла (NULL при ошибке)
+static char* conv_read_file(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    size_t capacity = 4096, length = 0;
+    char* text = (char*)malloc(capacity);
+    while (text) {
+        length += fread(text + length, 1, capacity - length - 1, file);
+        if (length < capacity - 1) {
+            break;
+        }
+        capacity *= 2;
+        char* grown = (char*)realloc(text, capacity);
+        if (!grown) {
+            free(text);
+        }
+        text = grown;
+    }
+    bool failed = ferror(file);
+    fclose(file);
+    if (!text || failed) {
+        free(text);
+        return NULL;
+    }
+
+    text[length] = '\0';
+    return text;
+}
+
+ConvKernel* conv_kernel_parse(const char* spec) {
+    ConvKernel* kernel = (ConvKernel*)calloc(1, sizeof(ConvKernel));
+    if (!kernel) {
+        return NULL;
+    }
+    kernel->weights = (float*)malloc((size_t)CONV_KERNEL_MAX_SIZE * CONV_KERNEL_MAX_SIZE * sizeof(float));
+    if (!kernel->weights) {
+        conv_kernel_free(kernel);
+        return NULL;
+    }
+
+    // "WxH:веса" - ядро в строке, иначе - имя файла
+    int width, height, consumed = 0;
+    bool ok;
+    if (sscanf(spec, "%dx%d:%n", &width, &height, &consumed) == 2 && consumed > 0) {
+        kernel->width = width;
+        kernel->height = height;
+        ok = width > 0 && height > 0 && conv_kernel_read_values(spec + consumed, kernel, false);
+    } else {
+        char* text = conv_read_file(spec);
+        ok = text && conv_kernel_read_values(text, kernel, true);
+        free(text);
+    }
+
+    if (!ok || kernel->width % 2 == 0 || kernel->height % 2 == 0 ||
+        kernel->width > CONV_KERNEL_MAX_SIZE || kernel->height > CONV_KERNEL_MAX_SIZE) {
+        conv_kernel_free(kernel);
+        return NULL;
+    }
+    return kernel;
+}
+
+ConvKernel* conv_kernel_clone(const ConvKernel* kernel) {
+    ConvKernel* copy = (ConvKernel*)malloc(sizeof(ConvKernel));
+    if (!copy) {
+        return NULL;
+    }
+    size_t size = (size_t)kernel->width * kernel->height * sizeof(float);
+    copy->width = kernel->width;
+    copy->height = kernel->height;
+    copy->weights = (float*)malloc(size);
+    if (!copy->weights) {
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy->weights, kernel->weights, size);
+    return copy;
+}
+
+void conv_kernel_free(ConvKernel* kernel) {
+    if (!kernel) return;
+    free(kernel->weights);
+    free(kernel);
+}
+
+// Медианный фильтр (Median Filter)
+// Удаляет шум, сохраняя границы
+// Окна 3x3 и 5x5 обрабатываются сетями сравнений, большие окна - скользящими
+// гистограммами за время, не зависящее от размера окна
+
+// Наибольший радиус окна: гистограмма столбца считает до 2r + 1 значений
+// в uint16_t, гистограмма окна - до (2r + 1)^2 в uint32_t
+#define MEDIAN_WINDOW_MAX_RADIUS 32767
+
+// Сети выбора медианы 9 и 25 значений (Devillard, "Fast median search")
+// После сети медиана стоит в середине массива
+// MEDIAN_MIN и MEDIAN_MAX задаются перед каждой функцией с сетью
+#define MEDIAN_SWAP(a, b) { lo = MEDIAN_MIN(p[a], p[b]); hi = MEDIAN_MAX(p[a], p[b]); p[a] = lo; p[b] = hi; }
+
+#define MEDIAN9_NETWORK \
+    MEDIAN_SWAP(1, 2) MEDIAN_SWAP(4, 5) MEDIAN_SWAP(7, 8) MEDIAN_SWAP(0, 1) MEDIAN_SWAP(3, 4) \
+    MEDIAN_SWAP(6, 7) MEDIAN_SWAP(1, 2) MEDIAN_SWAP(4, 5) MEDIAN_SWAP(7, 8) MEDIAN_SWAP(0, 3) \
+    MEDIAN_SWAP(5, 8) MEDIAN_SWAP(4, 7) MEDIAN_SWAP(3, 6) MEDIAN_SWAP(1, 4) MEDIAN_SWAP(2, 5) \
+    MEDIAN_SWAP(4, 7) MEDIAN_SWAP(4, 2) MEDIAN_SWAP(6, 4) MEDIAN_SWAP(4, 2)
+
+#define MEDIAN25_NETWORK \
+    MEDIAN_SWAP(0, 1) MEDIAN_SWAP(3, 4) MEDIAN_SWAP(2, 4) MEDIAN_SWAP(2, 3) MEDIAN_SWAP(6, 7) \
+    MEDIAN_SWAP(5, 7) MEDIAN_SWAP(5, 6) MEDIAN_SWAP(9, 10) MEDIAN_SWAP(8, 10) MEDIAN_SWAP(8, 9) \
+    MEDIAN_SWAP(12, 13) MEDIAN_SWAP(11, 13) MEDIAN_SWAP(11, 12) MEDIAN_SWAP(15, 16) MEDIAN_SWAP(14, 16) \
+    MEDIAN_SWAP(14, 15) MEDIAN_SWAP(18, 19) MEDIAN_SWAP(17, 19) MEDIAN_SWAP(17, 18) MEDIAN_SWAP(21, 22) \
+    MEDIAN_SWAP(20, 22) MEDIAN_SWAP(20, 21) MEDIAN_SWAP(23, 24) MEDIAN_SWAP(2, 5) MEDIAN_SWAP(3, 6) \
+    MEDIAN_SWAP(0, 6) MEDIAN_SWAP(0, 3) MEDIAN_SWAP(4, 7) MEDIAN_SWAP(1, 7) MEDIAN_SWAP(1, 4) \
+    MEDIAN_SWAP(11, 14) MEDIAN_SWAP(8, 14) MEDIAN_SWAP(8, 11) MEDIAN_SWAP(12, 15) MEDIAN_SWAP(9, 15) \
+    MEDIAN_SWAP(9, 12) MEDIAN_SWAP(13, 16) MEDIAN_SWAP(10, 16) MEDIAN_SWAP(10, 13) MEDIAN_SWAP(20, 23) \
+    MEDIAN_SWAP(17, 23) MEDIAN_SWAP(17, 20) MEDIAN_SWAP(21, 24) MEDIAN_SWAP(18, 24) MEDIAN_SWAP(18, 21) \
+    MEDIAN_SWAP(19, 22) MEDIAN_SWAP(8, 17) MEDIAN_SWAP(9, 18) MEDIAN_SWAP(0, 18) MEDIAN_SWAP(0, 9) \
+    MEDIAN_SWAP(10, 19) MEDIAN_SWAP(1, 19) MEDIAN_SWAP(1, 10) MEDIAN_SWAP(11, 20) MEDIAN_SWAP(2, 20) \
+    MEDIAN_SWAP(2, 11) MEDIAN_SWAP(12, 21) MEDIAN_SWAP(3, 21) MEDIAN_SWAP(3, 12) MEDIAN_SWAP(13, 22) \
+    MEDIAN_SWAP(4, 22) MEDIAN_SWAP(4, 13) MEDIAN_SWAP(14, 23) MEDIAN_SWAP(5, 23) MEDIAN_SWAP(5, 14) \
+    MEDIAN_SWAP(15, 24) MEDIAN_SWAP(6, 24) MEDIAN_SWAP(6, 15) MEDIAN_SWAP(7, 16) MEDIAN_SWAP(7, 19) \
+    MEDIAN_SWAP(13, 21) MEDIAN_SWAP(15, 23) MEDIAN_SWAP(7, 13) MEDIAN_SWAP(7, 15) MEDIAN_SWAP(1, 9) \
+    MEDIAN_SWAP(3, 11) MEDIAN_SWAP(5, 17) MEDIAN_SWAP(11, 17) MEDIAN_SWAP(9, 17) MEDIAN_SWAP(4, 10) \
+    MEDIAN_SWAP(6, 12) MEDIAN_SWAP(7, 14) MEDIAN_SWAP(4, 6) MEDIAN_SWAP(4, 7) MEDIAN_SWAP(12, 14) \
+    MEDIAN_SWAP(10, 14) MEDIAN_SWAP(6, 7) MEDIAN_SWAP(10, 12) MEDIAN_SWAP(6, 10) MEDIAN_SWAP(6, 17) \
+    MEDIAN_SWAP(12, 17) MEDIAN_SWAP(7, 17) MEDIAN_SWAP(7, 10) MEDIAN_SWAP(12, 18) MEDIAN_SWAP(7, 12) \
+    MEDIAN_SWAP(10, 18) MEDIAN_SWAP(12, 20) MEDIAN_SWAP(10, 20) MEDIAN_SWAP(10, 12)
+
+// Медиана count значений (9 или 25); массив переставляется
+// Каналы пикселя лежат в полосах вектора, и одна сеть обрабатывает сразу R, G и B
+#ifdef __SSE2__
+#define MEDIAN_MIN(a, b) _mm_min_ps(a, b)
+#define MEDIAN_MAX(a, b) _mm_max_ps(a, b)
+static inline __m128 median_network_float(__m128* p, int count) {
+    __m128 lo, hi;
+    if (count == 9) {
+        MEDIAN9_NETWORK
+        return p[4];
+    }
+    MEDIAN25_NETWORK
+    return p[12];
+}
+#undef MEDIAN_MIN
+#undef MEDIAN_MAX
+
+#define MEDIAN_MIN(a, b) _mm_min_epu8(a, b)
+#define MEDIAN_MAX(a, b) _mm_max_epu8(a, b)
+static inline __m128i median_network_byte(__m128i* p, int count) {
+    __m128i lo, hi;
+    if (count == 9) {
+        MEDIAN9_NETWORK
+        return p[4];
+    }
+    MEDIAN25_NETWORK
+    return p[12];
+}
+#undef MEDIAN_MIN
+#undef MEDIAN_MAX
+#else
+// Без SSE2 - по одному каналу
+#define MEDIAN_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MEDIAN_MAX(a, b) ((a) < (b) ? (b) : (a))
+static inline float median_network_float(float* p, int count) {
+    float lo, hi;
+    if (count == 9) {
+        MEDIAN9_NETWORK
+        return p[4];
+    }
+    MEDIAN25_NETWORK
+    return p[12];
+}
+
+static inline uint8_t median_network_byte(uint8_t* p, int count) {
+    uint8_t lo, hi;
+    if (count == 9) {
+        MEDIAN9_NETWORK
+        return p[4];
+    }
+    MEDIAN25_NETWORK
+    return p[12];
+}
+#undef MEDIAN_MIN
+#undef MEDIAN_MAX
+#endif
+
+// Медиана count значений одного канала (пиксели у краев строки одноканальных форматов)
+#ifdef __SSE2__
+static inline float median_network_scalar_float(const float* values, int count) {
+    __m128 p[25];
+    for (int i = 0; i < count; i++) p[i] = _mm_set_ss(values[i]);
+    return _mm_cvtss_f32(median_network_float(p, count));
+}
+
+static inline uint8_t median_network_scalar_byte(const uint8_t* values, int count) {
+    __m128i p[25];
+    for (int i = 0; i < count; i++) p[i] = _mm_cvtsi32_si128(values[i]);
+    return (uint8_t)_mm_cvtsi128_si32(median_network_byte(p, count));
+}
+#else
+static inline float median_network_scalar_float(const float* values, int count) {
+    float p[25];
+    memcpy(p, values, count * sizeof(float));
+    return median_network_float(p, count);
+}
+
+static inline uint8_t median_network_scalar_byte(const uint8_t* values, int count) {
+    uint8_t p[25];
+    memcpy(p, values, count);
+    return median_network_byte(p, count);
+}
+#endif
+
+// Медиана окон 3x3 и 5x5 сетями сравнений
+static void median_network_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* image = job->src;
+    Image* result = job->dst;
+    int radius = job->radius;
+    int count = (2 * radius + 1) * (2 * radius + 1);
+
+    for (int y = y_begin; y < y_end; y++) {
+        for (int x = 0; x < image->width; x++) {
+#ifdef __SSE2__
+            __m128 values[25];
+#else
+            float reds[25], greens[25], blues[25];
+#endif
+            int i = 0;
+
+            for (int wy = -radius; wy <= radius; wy++) {
+                for (int wx = -radius; wx <= radius; wx++, i++) {
+                    Color color = image_get_pixel_clamped(image, x + wx, y + wy);
+#ifdef __SSE2__
+                    values[i] = _mm_set_ps(0.0f, color.b, color.g, color.r);
+#else
+                    reds[i] = color.r;
+                    greens[i] = color.g;
+                    blues[i] = color.b;
+#endif
+                }
+            }
+
+#ifdef __SSE2__
+            float channels[4];
+            _mm_storeu_ps(channels, median_network_float(values, count));
+            Color median = {channels[0], channels[1], channels[2]};
+#else
+            Color median = {
+                median_network_float(reds, count),
+                median_network_float(greens, count),
+                median_network_float(blues, count)
+            };
+#endif
+            image_set_pixel(result, x, y, median);
+        }
+    }
+}
+
+// То же для 8-битных форматов (альфа не меняется)
+static void median_network_u8_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* image = job->src;
+    Image* result = job->dst;
+    int radius = job->radius;
+    int count = (2 * radius + 1) * (2 * radius + 1);
+    size_t step = pixel_format_size(image->format);
+
+    for (int y = y_begin; y < y_end; y++) {
+        const uint8_t* in = image_row_bytes(image, y);
+        uint8_t* out = image_row_bytes(result, y);
+        for (int x = 0; x < image->width; x++) {
+#ifdef __SSE2__
+            __m128i values[25];
+#else
+            uint8_t channels[3][25];
+#endif
+            int i = 0;
+
+            for (int wy = -radius; wy <= radius; wy++) {
+                const uint8_t* row = image_row_bytes(image, clamp_coord(y + wy, image->height));
+                for (int wx = -radius; wx <= radius; wx++, i++) {
+                    const uint8_t* p = row + clamp_coord(x + wx, image->width) * step;
+#ifdef __SSE2__
+                    values[i] = _mm_cvtsi32_si128(p[0] | (p[1] << 8) | (p[2] << 16));
+#else
+                    channels[0][i] = p[0];
+                    channels[1][i] = p[1];
+                    channels[2][i] = p[2];
+#endif
+                }
+            }
+
+#ifdef __SSE2__
+            int median = _mm_cvtsi128_si32(median_network_byte(values, count));
+            out[x * step + 0] = (uint8_t)median;
+            out[x * step + 1] = (uint8_t)(median >> 8);
+            out[x * step + 2] = (uint8_t)(median >> 16);
+#else
+            for (int c = 0; c < 3; c++) {
+                out[x * step + c] = median_network_byte(channels[c], count);
+            }
+#endif
+            if (step == 4) {
+                out[x * step + 3] = in[x * step + 3];
+            }
+        }
+    }
+}
+
+// То же для одноканальных форматов: с SSE2 одна сеть обрабатывает соседние
+// пиксели в полосах вектора - 16 пикселей GRAY8 или 4 пикселя GRAY_F32
+// Окна пикселей у краев строки выходят за изображение и считаются по одному
+static void median_network_gray_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* image = job->src;
+    Image* result = job->dst;
+    int radius = job->radius;
+    int window = 2 * radius + 1;
+    int count = window * window;
+    int width = image->width;
+    bool is_float = (image->format == PIXEL_FORMAT_GRAY_F32);
+
+    for (int y = y_begin; y < y_end; y++) {
+        // Строки окна (у верхнего и нижнего краев повторяются)
+        const float* float_rows[5];
+        const uint8_t* byte_rows[5];
+        for (int k = 0; k < window; k++) {
+            int row_y = clamp_coord(y + k - radius, image->height);
+            float_rows[k] = is_float ? image_plane_row(image, 0, row_y) : NULL;
+            byte_rows[k] = is_float ? NULL : image_row_bytes(image, row_y);
+        }
+        float* float_out = is_float ? image_plane_row(result, 0, y) : NULL;
+        uint8_t* byte_out = is_float ? NULL : image_row_bytes(result, y);
+
+        int x = 0;
+        while (x < width) {
+#ifdef __SSE2__
+            int lanes = is_float ? 4 : 16;
+            if (x >= radius && x + lanes + radius <= width) {
+                int i = 0;
+                if (is_float) {
+                    __m128 values[25];
+                    for (int k = 0; k < window; k++) {
+                        for (int wx = -radius; wx <= radius; wx++) {
+                            values[i++] = _mm_loadu_ps(float_rows[k] + x + wx);
+                        }
+                    }
+                    _mm_storeu_ps(float_out + x, median_network_float(values, count));
+                } else {
+                    __m128i values[25];
+                    for (int k = 0; k < window; k++) {
+                        for (int wx = -radius; wx <= radius; wx++) {
+                            values[i++] = _mm_loadu_si128((const __m128i*)(byte_rows[k] + x + wx));
+                        }
+                    }
+                    _mm_storeu_si128((__m128i*)(byte_out + x), median_network_byte(values, count));
+                }
+                x += lanes;
+                continue;
+            }
+#endif
+            int i = 0;
+            if (is_float) {
+                float values[25];
+                for (int k = 0; k < window; k++) {
+                    for (int wx = -radius; wx <= radius; wx++) {
+                        values[i++] = float_rows[k][clamp_coord(x + wx, width)];
+                    }
+                }
+                float_out[x] = median_network_scalar_float(values, count);
+            } else {
+                uint8_t values[25];
+                for (int k = 0; k < window; k++) {
+                    for (int wx = -radius; wx <= radius; wx++) {
+                        values[i++] = byte_rows[k][clamp_coord(x + wx, width)];
+                    }
+                }
+                byte_out[x] = median_network_scalar_byte(values, count);
+            }
+            x++;
+        }
+    }
+}
+
+// Медиана по скользящим гистограммам (Perreault, Hebert, "Median Filtering in Constant Time")
+// Для каждого столбца хранится гистограмма его отрезка высотой в окно; при переходе
+// к следующей строке в ней одно значение убирается и одно добавляется. Грубая
+// гистограмма окна (16 корзин по 16 значений) при сдвиге вдоль строки получает
+// один столбец и теряет другой; точная обновляется лениво, только в той корзине,
+// где оказалась медиана, - догоняя пропущенные сдвиги или собираясь заново
+// Полоса строк обрабатывается вертикальными частями по MEDIAN_STRIPE_WIDTH столбцов,
+// чтобы гистограммы столбцов оставались в кэше
+// Значения 8-битные: форматы float квантуются с тем же округлением, что и при записи
+// в файл; квантование монотонно, поэтому результат равен округленной точной медиане
+// У одноканальных форматов гистограммы строятся для одного канала вместо трех
+#define MEDIAN_STRIPE_WIDTH 256
+#define MEDIAN_BINS 256
+#define MEDIAN_COARSE_BINS 16
+#define MEDIAN_FINE_BINS (MEDIAN_BINS / MEDIAN_COARSE_BINS)  // Значений в грубой корзине
+
+typedef struct {
+    uint16_t coarse[MEDIAN_COARSE_BINS];
+    uint16_t fine[MEDIAN_BINS];
+} MedianHistogram;
+
+// Выбор медианы и проход полосы встраиваются в функции полос каждой ширины
+// счетчиков: ширина в них - константа, и ее проверки уходят из горячих циклов
+#ifdef __GNUC__
+#define MEDIAN_ALWAYS_INLINE __attribute__((always_inline)) inline
+#else
+#define MEDIAN_ALWAYS_INLINE inline
+#endif
+
+// Гистограмма окна одного канала: грубая (MEDIAN_COARSE_BINS счетчиков), за ней точная
+// Счетчики 16-битные, а у окон радиуса больше MEDIAN_NARROW_MAX_RADIUS, где значений
+// больше 65535, - 32-битные (wide); ширина одна для всех окон вызова фильтра
+#define MEDIAN_NARROW_MAX_RADIUS 127
+
+typedef struct {
+    union {
+        uint16_t narrow[MEDIAN_COARSE_BINS + MEDIAN_BINS];
+        uint32_t wide[MEDIAN_COARSE_BINS + MEDIAN_BINS];
+    } counts;
+    int updated[MEDIAN_COARSE_BINS];  // Для какого x обновлена корзина точной гистограммы
+} MedianWindow;
+
+// dst += src или dst -= src для 16 счетчиков
+static inline void median_counters_add16(uint16_t* dst, const uint16_t* src) {
+#ifdef __SSE2__
+    __m128i lo = _mm_add_epi16(_mm_loadu_si128((const __m128i*)dst), _mm_loadu_si128((const __m128i*)src));
+    __m128i hi = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(dst + 8)), _mm_loadu_si128((const __m128i*)(src + 8)));
+    _mm_storeu_si128((__m128i*)dst, lo);
+    _mm_storeu_si128((__m128i*)(dst + 8), hi);
+#else
+    for (int i = 0; i < 16; i++) dst[i] = (uint16_t)(dst[i] + src[i]);
+#endif
+}
+
+static inline void median_counters_sub16(uint16_t* dst, const uint16_t* src) {
+#ifdef __SSE2__
+    __m128i lo = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)dst), _mm_loadu_si128((const __m128i*)src));
+    __m128i hi = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(dst + 8)), _mm_loadu_si128((const __m128i*)(src + 8)));
+    _mm_storeu_si128((__m128i*)dst, lo);
+    _mm_storeu_si128((__m128i*)(dst + 8), hi);
+#else
+    for (int i = 0; i < 16; i++) dst[i] = (uint16_t)(dst[i] - src[i]);
+#endif
+}
+
+// То же для 32-битных счетчиков окна (счетчики столбцов остаются 16-битными)
+static inline void median_counters_add32(uint32_t* dst, const uint16_t* src) {
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (int i = 0; i < 16; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(dst + i)), _mm_unpacklo_epi16(s, zero));
+        __m128i hi = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(dst + i + 4)), _mm_unpackhi_epi16(s, zero));
+        _mm_storeu_si128((__m128i*)(dst + i), lo);
+        _mm_storeu_si128((__m128i*)(dst + i + 4), hi);
+    }
+#else
+    for (int i = 0; i < 16; i++) dst[i] += src[i];
+#endif
+}
+
+static inline void median_counters_sub32(uint32_t* dst, const uint16_t* src) {
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (int i = 0; i < 16; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i lo = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(dst + i)), _mm_unpacklo_epi16(s, zero));
+        __m128i hi = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(dst + i + 4)), _mm_unpackhi_epi16(s, zero));
+        _mm_storeu_si128((__m128i*)(dst + i), lo);
+        _mm_storeu_si128((__m128i*)(dst + i + 4), hi);
+    }
+#else
+    for (int i = 0; i < 16; i++) dst[i] -= src[i];
+#endif
+}
+
+// Счетчики окна [offset, offset + 16) += src или -= src
+static inline void median_window_add(MedianWindow* window, bool wide, int offset, const uint16_t* src) {
+    if (wide) {
+        median_counters_add32(window->counts.wide + offset, src);
+    } else {
+        median_counters_add16(window->counts.narrow + offset, src);
+    }
+}
+
+static inline void median_window_sub(MedianWindow* window, bool wide, int offset, const uint16_t* src) {
+    if (wide) {
+        median_counters_sub32(window->counts.wide + offset, src);
+    } else {
+        median_counters_sub16(window->counts.narrow + offset, src);
+    }
+}
+
+static inline uint32_t median_window_count(const MedianWindow* window, bool wide, int index) {
+    return wide ? window->counts.wide[index] : window->counts.narrow[index];
+}
+
+static inline void median_window_clear(MedianWindow* window, bool wide, int offset, int count) {
+    if (wide) {
+        memset(window->counts.wide + offset, 0, (size_t)count * sizeof(uint32_t));
+    } else {
+        memset(window->counts.narrow + offset, 0, (size_t)count * sizeof(uint16_t));
+    }
+}
+
+// Перевод канала [0.0, 1.0] в байт (как при записи BMP)
+static inline uint8_t median_quantize(float value) {
+    float v = value * 255.0f;
+    if (!(v > 0.0f)) v = 0.0f;
+    if (v > 255.0f) v = 255.0f;
+    return (uint8_t)(v + 0.5f);
+}
+
+// Пиксели [x_begin, x_end) строки как 8-битные каналы R, G, B подряд (или яркость)
+static void median_row_bytes(const Image* image, int y, int x_begin, int x_end, uint8_t* out) {
+    if (image->format == PIXEL_FORMAT_GRAY_F32) {
+        const float* in = image_plane_row(image, 0, y);
+        for (int x = x_begin; x < x_end; x++) {
+            *out++ = median_quantize(in[x]);
+        }
+        return;
+    }
+    if (image->format == PIXEL_FORMAT_GRAY8) {
+        memcpy(out, image_row_bytes(image, y) + x_begin, (size_t)(x_end - x_begin));
+        return;
+    }
+    if (image->format == PIXEL_FORMAT_RGB_F32) {
+        const float* in = (const float*)image_row_bytes(image, y) + 3 * x_begin;
+        for (int i = 0; i < (x_end - x_begin) * 3; i++) {
+            out[i] = median_quantize(in[i]);
+        }
+        return;
+    }
+
+    size_t step = pixel_format_size(image->format);
+    const uint8_t* in = image_row_bytes(image, y);
+    for (int x = x_begin; x < x_end; x++, out += 3) {
+        out[0] = in[x * step + 0];
+        out[1] = in[x * step + 1];
+        out[2] = in[x * step + 2];
+    }
+}
+
+// Добавление (delta = 1) или удаление (delta = -1) строки из гистограмм столбцов
+// count - число значений строки (столбцов, умноженное на число каналов)
+static void median_columns_update(MedianHistogram* columns, const uint8_t* row, int count, int delta) {
+    for (int i = 0; i < count; i++) {
+        uint8_t v = row[i];
+        columns[i].fine[v] = (uint16_t)(columns[i].fine[v] + delta);
+        columns[i].coarse[v / MEDIAN_FINE_BINS] = (uint16_t)(columns[i].coarse[v / MEDIAN_FINE_BINS] + delta);
+    }
+}
+
+// Значение с номером rank (от 0) в порядке возрастания в окне с центром x
+// columns - гистограммы столбцов этого канала (с шагом channels), начиная со столбца base
+static MEDIAN_ALWAYS_INLINE uint8_t median_window_select(MedianWindow* window, bool wide, const MedianHistogram* columns, int channels,
+                                           int base, int x, int radius, int width, int rank) {
+    uint32_t remaining = (uint32_t)rank;
+    int bin = 0;
+    while (remaining >= median_window_count(window, wide, bin)) {
+        remaining -= median_window_count(window, wide, bin);
+        bin++;
+    }
+
+    // Корзина точной гистограммы догоняет окно: сдвиг за сдвигом,
+    // а если отстала больше чем на ширину окна - собирается заново
+    int fine = MEDIAN_COARSE_BINS + bin * MEDIAN_FINE_BINS;
+    int updated = window->updated[bin];
+    if (updated < 0 || x - updated > 2 * radius + 1) {
+        median_window_clear(window, wide, fine, MEDIAN_FINE_BINS);
+        for (int wx = -radius; wx <= radius; wx++) {
+            median_window_add(window, wide, fine, columns[channels * (clamp_coord(x + wx, width) - base)].fine + bin * MEDIAN_FINE_BINS);
+        }
+    } else {
+        for (int k = updated + 1; k <= x; k++) {
+            int added = clamp_coord(k + radius, width) - base;
+            int removed = clamp_coord(k - radius - 1, width) - base;
+            if (added != removed) {
+                median_window_add(window, wide, fine, columns[channels * added].fine + bin * MEDIAN_FINE_BINS);
+                median_window_sub(window, wide, fine, columns[channels * removed].fine + bin * MEDIAN_FINE_BINS);
+            }
+        }
+    }
+    window->updated[bin] = x;
+
+    int value = 0;
+    while (remaining >= median_window_count(window, wide, fine + value)) {
+        remaining -= median_window_count(window, wide, fine + value);
+        value++;
+    }
+    return (uint8_t)(bin * MEDIAN_FINE_BINS + value);
+}
+
+static MEDIAN_ALWAYS_INLINE void median_histogram_run(void* context, int y_begin, int y_end, bool wide) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* image = job->src;
+    Image* result = job->dst;
+    int radius = job->radius;
+    int width = image->width;
+    int height = image->height;
+    int rank = (2 * radius + 1) * (2 * radius + 1) / 2;
+    size_t step = pixel_format_size(image->format);
+    int channels = (pixel_format_channels(image->format) == 1) ? 1 : 3;
+    bool packed = (image->format != PIXEL_FORMAT_RGB_F32 && image->format != PIXEL_FORMAT_GRAY_F32);
+
+    // Гистограммы столбцов части (по каналам) и строка - свои у каждой полосы
+    int max_columns = MEDIAN_STRIPE_WIDTH + 2 * radius;
+    if (max_columns > width) max_columns = width;
+    MedianHistogram* columns = (MedianHistogram*)malloc((size_t)max_columns * channels * sizeof(MedianHistogram));
+    uint8_t* row = (uint8_t*)malloc((size_t)max_columns * channels);
+    if (!columns || !row) {
+        free(columns);
+        free(row);
+        *(bool*)job->extra = false;
+        return;
+    }
+
+    for (int x_begin = 0; x_begin < width; x_begin += MEDIAN_STRIPE_WIDTH) {
+        int x_end = (x_begin + MEDIAN_STRIPE_WIDTH < width) ? x_begin + MEDIAN_STRIPE_WIDTH : width;
+
+        // Столбцы, которые видят окна пикселей части
+        int base = (x_begin - radius > 0) ? x_begin - radius : 0;
+        int limit = (x_end + radius < width) ? x_end + radius : width;
+        int count = limit - base;
+
+        // Столбцы для первой строки полосы (у краев изображения строки повторяются)
+        memset(columns, 0, (size_t)count * channels * sizeof(MedianHistogram));
+        for (int wy = -radius; wy <= radius; wy++) {
+            median_row_bytes(image, clamp_coord(y_begin + wy, height), base, limit, row);
+            median_columns_update(columns, row, count * channels, 1);
+        }
+
+        for (int y = y_begin; y < y_end; y++) {
+            if (y > y_begin) {
+                median_row_bytes(image, clamp_coord(y - radius - 1, height), base, limit, row);
+                median_columns_update(columns, row, count * channels, -1);
+                median_row_bytes(image, clamp_coord(y + radius, height), base, limit, row);
+                median_columns_update(columns, row, count * channels, 1);
+            }
+
+            // Грубые гистограммы окна первого пикселя части; точные соберутся по требованию
+            MedianWindow windows[3];
+            for (int c = 0; c < channels; c++) {
+                median_window_clear(&windows[c], wide, 0, MEDIAN_COARSE_BINS);
+                for (int bin = 0; bin < MEDIAN_COARSE_BINS; bin++) {
+                    windows[c].updated[bin] = -1;
+                }
+                for (int wx = -radius; wx <= radius; wx++) {
+                    int column = clamp_coord(x_begin + wx, width) - base;
+                    median_window_add(&windows[c], wide, 0, columns[channels * column + c].coarse);
+                }
+            }
+
+            const uint8_t* in = packed ? image_row_bytes(image, y) : NULL;
+            uint8_t* out = packed ? image_row_bytes(result, y) : NULL;
+
+            for (int x = x_begin; x < x_end; x++) {
+                if (x > x_begin) {
+                    int added = clamp_coord(x + radius, width) - base;
+                    int removed = clamp_coord(x - radius - 1, width) - base;
+                    if (added != removed) {
+                        for (int c = 0; c < channels; c++) {
+                            median_window_add(&windows[c], wide, 0, columns[channels * added + c].coarse);
+                            median_window_sub(&windows[c], wide, 0, columns[channels * removed + c].coarse);
+                        }
+                    }
+                }
+
+                uint8_t median[3];
+                for (int c = 0; c < channels; c++) {
+                    median[c] = median_window_select(&windows[c], wide, columns + c, channels, base, x, radius, width, rank);
+                }
+
+                if (image->format == PIXEL_FORMAT_GRAY_F32) {
+                    image_plane_row(result, 0, y)[x] = median[0] / 255.0f;
+                } else if (step == 1) {
+                    out[x] = median[0];
+                } else if (image->format == PIXEL_FORMAT_RGB_F32) {
+                    Color color = {median[0] / 255.0f, median[1] / 255.0f, median[2] / 255.0f};
+                    image_set_pixel(result, x, y, color);
+                } else {
+                    out[x * step + 0] = median[0];
+                    out[x * step + 1] = median[1];
+                    out[x * step + 2] = median[2];
+                    if (step == 4) {
+                        out[x * step + 3] = in[x * step + 3];
+                    }
+                }
+            }
+        }
+    }
+
+    free(columns);
+    free(row);
+}
+
+static void median_histogram_rows(void* context, int y_begin, int y_end) {
+    median_histogram_run(context, y_begin, y_end, false);
+}
+
+static void median_histogram_wide_rows(void* context, int y_begin, int y_end) {
+    median_histogram_run(context, y_begin, y_end, true);
+}
+
+static bool median_buffered(Image** image, Image** spare, int window) {
+    Image* source = *image;
+    int radius = window / 2;
+    if (radius <= 0) {
+        return true;  // Окно из одного пикселя ничего не меняет
+    }
+    if (radius > MEDIAN_WINDOW_MAX_RADIUS) {
+        return false;
+    }
+
+    if (!image_reshape(*spare, source->width, source->height, source->format)) {
+        return false;
+    }
+
+    bool is_float = (source->format == PIXEL_FORMAT_RGB_F32);
+    RowBandFunc rows;
+    if (radius <= 2 && pixel_format_channels(source->format) == 1) {
+        rows = median_network_gray_rows;
+    } else if (radius <= 2) {
+        rows = is_float ? median_network_rows : median_network_u8_rows;
+    } else {
+        rows = (radius <= MEDIAN_NARROW_MAX_RADIUS) ? median_histogram_rows : median_histogram_wide_rows;
+    }
+
+    bool ok = true;  // полосы сбрасывают флаг при нехватке памяти
+    FilterJob job = {source, *spare, NULL, radius, 0, &ok};
+    parallel_for_rows(source->height, rows, &job);
+    if (!ok) {
+        return false;
+    }
+
+    swap_images(image, spare);
+    return true;
+}
+
+// Гауссово размытие (Gaussian Blur)
+// Плавное размытие изображения
+// Свертка строки in длины width с ядром в точке x; clamped - координаты
+// за краями строки ограничиваются (нужно только у краев)
+static inline Color blur_row_tap(const Color* in, int x, int width, const float* kernel, int radius, bool clamped) {
+    Color sum = {0, 0, 0};
+    for (int i = 0; i <= 2 * radius; i++) {
+        const Color* neighbor = clamped ? &in[clamp_coord(x + i - radius, width)] : &in[x + i - radius];
+        float weight = kernel[i];
+
+        sum.r += neighbor->r * weight;
+        sum.g += neighbor->g * weight;
+        sum.b += neighbor->b * weight;
+    }
+    return sum;
+}
+
+// Горизонтальная свертка: внутренние пиксели читаются прямо из строки,
+// координаты ограничиваются только в полосах шириной radius у краев
+static void blur_horizontal_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* image = job->src;
+    Image* temp = job->dst;
+    const float* kernel = job->kernel;
+    int radius = job->radius;
+    int width = image->width;
+    int inner_begin = (radius < width) ? radius : width;
+    int inner_end = (width - radius > inner_begin) ? width - radius : inner_begin;
+
+    for (int y = y_begin; y < y_end; y++) {
+        const Color* in = image->data + (size_t)y * width;
+        Color* out = temp->data + (size_t)y * width;
+
+        for (int x = 0; x < inner_begin; x++) {
+            out[x] = blur_row_tap(in, x, width, kernel, radius, true);
+        }
+        for (int x = inner_begin; x < inner_end; x++) {
+            out[x] = blur_row_tap(in, x, width, kernel, radius, false);
+        }
+        for (int x = inner_end; x < width; x++) {
+            out[x] = blur_row_tap(in, x, width, kernel, radius, true);
+        }
+    }
+}
+
+// Вертикальная свертка: сумма накапливается по строке результата целиком,
+// отсчет за отсчетом ядра; строка отсчета (с ограничением у краев)
+// выбирается один раз на всю строку
+static void blur_vertical_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const Image* temp = job->src;
+    Image* result = job->dst;
+    const float* kernel = job->kernel;
+    int radius = job->radius;
+    int size = 2 * radius + 1;
+    int width = temp->width;
+
+    for (int y = y_begin; y < y_end; y++) {
+        Color* out = result->data + (size_t)y * width;
+
+        for (int x = 0; x < width; x++) {
+            out[x].r = out[x].g = out[x].b = 0.0f;
+        }
+        for (int i = 0; i < size; i++) {
+            const Color* in = temp->data + (size_t)clamp_coord(y + i - radius, temp->height) * width;
+            float weight = kernel[i];
+            for (int x = 0; x < width; x++) {
+                out[x].r += in[x].r * weight;
+                out[x].g += in[x].g * weight;
+                out[x].b += in[x].b * weight;
+            }
+        }
+    }
+}
+
+static void blur_horizontal_planar_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    planar_blur_horizontal_rows(job->src, job->dst, job->kernel, job->radius, y_begin, y_end);
+}
+
+static void blur_vertical_planar_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    if (!planar_blur_vertical_rows(job->src, job->dst, job->kernel, job->radius, y_begin, y_end)) {
+        *(bool*)job->extra = false;
+    }
+}
+
+// Кэш ядер Гаусса: в постоянном режиме одни и те же sigma повторяются
+// от задания к заданию. Записи только добавляются и живут до
+// filter_release_caches, поэтому ядро читается без блокировки
+#define GAUSSIAN_CACHE_SIZE 32
+
+typedef struct {
+    float sigma;
+    int radius;
+    float* weights;          // 2 * radius + 1 весов с суммой 1
+} GaussianKernel;
+
+static GaussianKernel gaussian_cache[GAUSSIAN_CACHE_SIZE];
+static int gaussian_cache_count = 0;
+static pthread_mutex_t gaussian_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Ядро радиуса radius для sigma с полным радиусом full_radius >= radius:
+// веса отсчетов дальше radius прибавляются к крайним отсчетам
+static float* gaussian_kernel_create(float sigma, int radius, int full_radius) {
+    int size = 2 * radius + 1;  // Размер ядра
+    float* kernel = (float*)malloc(size * sizeof(float));
+    if (!kernel) {
+        return NULL;
+    }
+    
+    // Вычисление значений Гауссовой функции
+    float sum = 0.0f;
+    for (int i = 0; i < size; i++) {
+        int x = i - radius;
+        kernel[i] = exp(-(x * x) / (2 * sigma * sigma));
+        sum += kernel[i];
+    }
+    for (int x = radius + 1; x <= full_radius; x++) {
+        float weight = exp(-(x * x) / (2 * sigma * sigma));
+        kernel[0] += weight;
+        kernel[size - 1] += weight;
+        sum += 2 * weight;
+    }
+    
+    // Нормализация ядра (сумма весов = 1)
+    for (int i = 0; i < size; i++) {
+        kernel[i] /= sum;
+    }
+    return kernel;
+}
+
+// Ядро из кэша или новое; *owned - ядро не попало в кэш (кэш полон)
+// и освобождается вызывающим
+static float* gaussian_kernel(float sigma, int radius, int full_radius, bool* owned) {
+    pthread_mutex_lock(&gaussian_cache_lock);
+    for (int i = 0; i < gaussian_cache_count; i++) {
+        if (gaussian_cache[i].sigma == sigma && gaussian_cache[i].radius == radius) {
+            pthread_mutex_unlock(&gaussian_cache_lock);
+            *owned = false;
+            return gaussian_cache[i].weights;
+        }
+    }
+
+    float* kernel = gaussian_kernel_create(sigma, radius, full_radius);
+    *owned = true;
+    if (kernel && gaussian_cache_count < GAUSSIAN_CACHE_SIZE) {
+        gaussian_cache[gaussian_cache_count].sigma = sigma;
+        gaussian_cache[gaussian_cache_count].radius = radius;
+        gaussian_cache[gaussian_cache_count].weights = kernel;
+        gaussian_cache_count++;
+        *owned = false;
+    }
+    pthread_mutex_unlock(&gaussian_cache_lock);
+    return kernel;
+}
+
+void filter_release_caches(void) {
+    pthread_mutex_lock(&gaussian_cache_lock);
+    for (int i = 0; i < gaussian_cache_count; i++) {
+        free(gaussian_cache[i].weights);
+    }
+    gaussian_cache_count = 0;
+    pthread_mutex_unlock(&gaussian_cache_lock);
+}
+
+static bool gaussian_blur_exact_buffered(Image** image, Image** spare, float sigma) {
+    // Вычисление радиуса ядра (3σ покрывает 99.7% распределения)
+    Image* source = *image;
+    int full_radius = (int)ceil(3 * sigma);
+
+    // Отсчеты дальше длины строки (столбца) у любого пикселя попадают на один
+    // и тот же край, поэтому ядро обрезается до длины с переносом их весов
+    int length = (source->width > source->height) ? source->width : source->height;
+    int radius = (full_radius < length) ? full_radius : length;
+    
+    // Одномерное ядро Гаусса (для известной sigma - из кэша)
+    bool owned;
+    float* kernel = gaussian_kernel(sigma, radius, full_radius, &owned);
+    if (!kernel) {
+        return false;
+    }
+    
+    // Разделяемая свертка: сначала по горизонтали в запасной буфер,
+    // затем по вертикали обратно в исходный
+    Image* temp = *spare;
+    if (!image_reshape(temp, source->width, source->height, source->format)) {
+        if (owned) free(kernel);
+        return false;
+    }
+    
+    // Второй проход начинается после завершения первого во всех полосах,
+    // поэтому строки соседних полос (ореол ядра) уже готовы
+    bool ok = true;  // полосы сбрасывают флаг при нехватке памяти
+    FilterJob horizontal = {source, temp, kernel, radius, 0, NULL};
+    FilterJob vertical = {temp, source, kernel, radius, 0, &ok};
+    if (pixel_format_planes(source->format) > 0) {
+        parallel_for_rows(source->height, blur_horizontal_planar_rows, &horizontal);
+        parallel_for_rows(source->height, blur_vertical_planar_rows, &vertical);
+    } else {
+        parallel_for_rows(source->height, blur_horizontal_rows, &horizontal);
+        parallel_for_rows(source->height, blur_vertical_rows, &vertical);
+    }
+    
+    if (owned) free(kernel);
+    return ok;
+}
+
+// Размытие без зависимости от sigma: каскад box-фильтров и рекурсивный фильтр
+// Оба разделимы и работают на месте: сначала все строки, затем все столбцы
+// Одномерные функции обрабатывают lanes независимых сигналов длины count,
+// отсчет n сигнала l - data[n * step + l]. Строка формата float - 3 сигнала
+// (каналы), блок столбцов - по сигналу на каждое число строки
+// Координаты за краями, как и у точного ядра, ограничиваются
+
+// Столбцов (чисел строки) в блоке вертикального прохода
+#define BLUR_COLUMN_BLOCK 64
+
+// Фиксированная точка каскада: суммы окон целые и не зависят от порядка
+// сложения, поэтому результат в каждой точке одинаков при любом разбиении
+// изображения на плитки и полосы. Произведение суммы на вес помещается
+// в int64_t при значениях каналов по модулю до 2^(63 - 24 - 30) = 512
+#define BLUR_BOX_FIXED_ONE 16777216.0
+
+// Отсчетов, на которые сигнал продолжается за каждый край перед каскадом:
+// каждый фильтр читает radius + 1 соседей, поэтому в пределах сигнала каскад
+// видит исходные края, как и точное ядро, а не края промежуточных результатов
+static int box_cascade_padding(const BoxCascade* box) {
+    return BLUR_BOX_PASSES * (box->radius + 1);
+}
+
+// Каскад box-фильтров скользящей суммой
+// scratch - не меньше (2 * (count + 2 * box_cascade_padding) + 1) * lanes значений
+static void box_cascade_line(float* data, int count, int lanes, size_t step,
+                             const BoxCascade* box, int64_t* scratch) {
+    int padding = box_cascade_padding(box);
+    int length = count + 2 * padding;
+    int64_t* current = scratch;
+    int64_t* next = scratch + (size_t)length * lanes;
+    int64_t* sums = next + (size_t)length * lanes;
+    int radius = box->radius;
+
+    for (int n = 0; n < length; n++) {
+        const float* in = data + clamp_coord(n - padding, count) * step;
+        int64_t* out = current + (size_t)n * lanes;
+        for (int l = 0; l < lanes; l++) {
+            out[l] = (int64_t)(in[l] * BLUR_BOX_FIXED_ONE);
+        }
+    }
+
+    for (int pass = 0; pass < BLUR_BOX_PASSES; pass++) {
+        for (int l = 0; l < lanes; l++) {
+            sums[l] = 0;
+        }
+        for (int k = -radius; k <= radius; k++) {
+            const int64_t* in = current + (size_t)clamp_coord(k, length) * lanes;
+            for (int l = 0; l < lanes; l++) {
+                sums[l] += in[l];
+            }
+        }
+
+        for (int n = 0; n < length; n++) {
+            const int64_t* leaving = current + (size_t)clamp_coord(n - radius, length) * lanes;
+            const int64_t* before = current + (size_t)clamp_coord(n - radius - 1, length) * lanes;
+            const int64_t* after = current + (size_t)clamp_coord(n + radius + 1, length) * lanes;
+            int64_t* out = next + (size_t)n * lanes;
+            for (int l = 0; l < lanes; l++) {
+                int64_t weighted = box->inner * sums[l] + box->outer * (before[l] + after[l]);
+                out[l] = (weighted + ((int64_t)1 << (BLUR_BOX_WEIGHT_BITS - 1))) >> BLUR_BOX_WEIGHT_BITS;
+                sums[l] += after[l] - leaving[l];
+            }
+        }
+
+        int64_t* temp = current;
+        current = next;
+        next = temp;
+    }
+
+    for (int n = 0; n < count; n++) {
+        const int64_t* in = current + (size_t)(n + padding) * lanes;
+        float* out = data + n * step;
+        for (int l = 0; l < lanes; l++) {
+            out[l] = (float)(in[l] / BLUR_BOX_FIXED_ONE);
+        }
+    }
+}
+
+// Рекурсивный фильтр Дерише 4-го порядка: сумма причинной части (проход вперед)
+// и антипричинной (проход назад), обе считаются по исходному сигналу
+// y+[n] = sum(k=0..3) np[k] * x[n-k] - sum(k=1..4) d[k-1] * y+[n-k]
+// y-[n] = sum(k=1..4) nm[k-1] * x[n+k] - sum(k=1..4) d[k-1] * y-[n+k]
+// Полюса близки к 1, и при больших sigma точности float не хватает,
+// поэтому коэффициенты и состояние фильтра хранятся в double
+typedef struct {
+    double np[4];
+    double nm[4];
+    double d[4];
+    // Отклик частей на постоянный сигнал 1 (состояние за краем при продолжении краевым отсчетом)
+    double causal_gain;
+    double anticausal_gain;
+} IirCoeffs;
+
+static void iir_init(IirCoeffs* coeffs, float sigma) {
+    // Приближение Гауссианы суммой двух затухающих гармоник (Deriche, 1993)
+    const double a0 = 1.680, a1 = 3.735, b0 = 1.783, b1 = 1.723;
+    const double c0 = -0.6803, c1 = -0.2598, w0 = 0.6318, w1 = 1.9970;
+
+    double cos0 = cos(w0 / sigma), sin0 = sin(w0 / sigma);
+    double cos1 = cos(w1 / sigma), sin1 = sin(w1 / sigma);
+    double e0 = exp(-b0 / sigma), e1 = exp(-b1 / sigma);
+
+    double np[4], nm[4], d[4];
+    np[0] = a0 + c0;
+    np[1] = e1 * (c1 * sin1 - (c0 + 2 * a0) * cos1) + e0 * (a1 * sin0 - (2 * c0 + a0) * cos0);
+    np[2] = 2 * e0 * e1 * ((a0 + c0) * cos1 * cos0 - a1 * cos1 * sin0 - c1 * cos0 * sin1) +
+            c0 * e0 * e0 + a0 * e1 * e1;
+    np[3] = e1 * e0 * e0 * (c1 * sin1 - c0 * cos1) + e0 * e1 * e1 * (a1 * sin0 - a0 * cos0);
+
+    d[0] = -2 * e1 * cos1 - 2 * e0 * cos0;
+    d[1] = 4 * cos1 * cos0 * e0 * e1 + e1 * e1 + e0 * e0;
+    d[2] = -2 * cos0 * e0 * e1 * e1 - 2 * cos1 * e1 * e0 * e0;
+    d[3] = e0 * e0 * e1 * e1;
+
+    for (int k = 0; k < 3; k++) {
+        nm[k] = np[k + 1] - d[k] * np[0];
+    }
+    nm[3] = -d[3] * np[0];
+
+    // Нормировка: сумма отклика равна 1
+    double denominator = 1.0 + d[0] + d[1] + d[2] + d[3];
+    double causal = (np[0] + np[1] + np[2] + np[3]) / denominator;
+    double anticausal = (nm[0] + nm[1] + nm[2] + nm[3]) / denominator;
+    double scale = 1.0 / (causal + anticausal);
+
+    for (int k = 0; k < 4; k++) {
+        coeffs->np[k] = np[k] * scale;
+        coeffs->nm[k] = nm[k] * scale;
+        coeffs->d[k] = d[k];
+    }
+    coeffs->causal_gain = causal * scale;
+    coeffs->anticausal_gain = anticausal * scale;
+}
+
+// scratch - не меньше (count + 10) * lanes значений
+static void iir_line(float* data, int count, int lanes, size_t step,
+                     const IirCoeffs* coeffs, double* scratch) {
+    double* causal = scratch;                             // y+ всего сигнала
+    double* first = causal + (size_t)count * lanes;       // x[0]
+    double* causal_edge = first + lanes;                  // y+ левее сигнала
+    double* inputs[4];                                    // x[n+1..n+4]
+    double* outputs[4];                                   // y-[n+1..n+4]
+    for (int k = 0; k < 4; k++) {
+        inputs[k] = causal_edge + (size_t)(1 + k) * lanes;
+        outputs[k] = causal_edge + (size_t)(5 + k) * lanes;
+    }
+    const double* np = coeffs->np;
+    const double* nm = coeffs->nm;
+    const double* d = coeffs->d;
+
+    // Слева сигнал продолжается первым отсчетом, справа - последним
+    const float* last = data + (count - 1) * step;
+    for (int l = 0; l < lanes; l++) {
+        first[l] = data[l];
+        causal_edge[l] = coeffs->causal_gain * data[l];
+        for (int k = 0; k < 4; k++) {
+            inputs[k][l] = last[l];
+            outputs[k][l] = coeffs->anticausal_gain * last[l];
+        }
+    }
+
+    // Проход вперед (до четвертого отсчета часть входов и состояний - за краем)
+    for (int n = 0; n < count; n++) {
+        const float* in = data + n * step;
+        const double* y[4];
+        for (int k = 0; k < 4; k++) {
+            y[k] = (n - 1 - k >= 0) ? causal + (size_t)(n - 1 - k) * lanes : causal_edge;
+        }
+        double* out = causal + (size_t)n * lanes;
+
+        if (n >= 3) {
+            for (int l = 0; l < lanes; l++) {
+                out[l] = np[0] * in[l] + np[1] * in[l - step] + np[2] * in[l - 2 * step] + np[3] * in[l - 3 * step]
+                       - d[0] * y[0][l] - d[1] * y[1][l] - d[2] * y[2][l] - d[3] * y[3][l];
+            }
+        } else {
+            for (int l = 0; l < lanes; l++) {
+                double sum = 0;
+                for (int k = 0; k < 4; k++) {
+                    sum += np[k] * ((n - k >= 0) ? (double)data[(n - k) * step + l] : first[l]);
+                }
+                out[l] = sum - d[0] * y[0][l] - d[1] * y[1][l] - d[2] * y[2][l] - d[3] * y[3][l];
+            }
+        }
+    }
+
+    // Проход назад: исходные отсчеты правее n уже перезаписаны результатом,
+    // поэтому последние четыре из них хранятся отдельно
+    for (int n = count - 1; n >= 0; n--) {
+        float* cur = data + n * step;
+        const double* forward = causal + (size_t)n * lanes;
+        double* x4 = inputs[3];
+        double* y4 = outputs[3];
+        for (int l = 0; l < lanes; l++) {
+            double value = nm[0] * inputs[0][l] + nm[1] * inputs[1][l] + nm[2] * inputs[2][l] + nm[3] * x4[l]
+                        - d[0] * outputs[0][l] - d[1] * outputs[1][l] - d[2] * outputs[2][l] - d[3] * y4[l];
+            x4[l] = cur[l];
+            y4[l] = value;
+            cur[l] = (float)(forward[l] + value);
+        }
+
+        // Сдвиг окна: самый дальний буфер теперь хранит отсчет n
+        for (int k = 3; k > 0; k--) {
+            inputs[k] = inputs[k - 1];
+            outputs[k] = outputs[k - 1];
+        }
+        inputs[0] = x4;
+        outputs[0] = y4;
+    }
+}
+
+// Задание размытия строк или блоков столбцов
+typedef struct {
+    Image* image;
+    BlurMethod method;       // BLUR_METHOD_BOX или BLUR_METHOD_IIR
+    BoxCascade box;
+    IirCoeffs iir;
+    int blocks_per_plane;    // Блоков столбцов на плоскость (на строку формата float)
+    bool ok;                 // Сбрасывается при нехватке памяти
+} BlurLineJob;
+
+// Один сигнал или блок сигналов выбранным способом
+// scratch рассчитан на длину count и lanes сигналов
+static void blur_line(const BlurLineJob* job, float* data, int count, int lanes, size_t step, void* scratch) {
+    if (job->method == BLUR_METHOD_BOX) {
+        box_cascade_line(data, count, lanes, step, &job->box, (int64_t*)scratch);
+    } else {
+        iir_line(data, count, lanes, step, &job->iir, (double*)scratch);
+    }
+}
+
+static void* blur_line_scratch(const BlurLineJob* job, int count, int lanes) {
+    if (job->method == BLUR_METHOD_BOX) {
+        size_t length = (size_t)count + 2 * box_cascade_padding(&job->box);
+        return malloc((2 * length + 1) * lanes * sizeof(int64_t));
+    }
+    return malloc(((size_t)count + 10) * lanes * sizeof(double));
+}
+
+static void blur_lines_horizontal_rows(void* context, int y_begin, int y_end) {
+    BlurLineJob* job = (BlurLineJob*)context;
+    Image* image = job->image;
+    int planes = pixel_format_planes(image->format);
+    bool planar = (planes > 0);
+
+    void* scratch = blur_line_scratch(job, image->width, planar ? 1 : 3);
+    if (!scratch) {
+        job->ok = false;
+        return;
+    }
+
+    for (int y = y_begin; y < y_end; y++) {
+        if (planar) {
+            for (int c = 0; c < planes; c++) {
+                blur_line(job, image_plane_row(image, c, y), image->width, 1, 1, scratch);
+            }
+        } else {
+            blur_line(job, (float*)image_row_bytes(image, y), image->width, 3, 3, scratch);
+        }
+    }
+
+    free(scratch);
+}
+
+// Полоса [block_begin, block_end) блоков столбцов
+static void blur_lines_vertical_blocks(void* context, int block_begin, int block_end) {
+    BlurLineJob* job = (BlurLineJob*)context;
+    Image* image = job->image;
+    int planes = pixel_format_planes(image->format);
+    bool planar = (planes > 0);
+    int row_lanes = planar ? image->width : 3 * image->width;
+
+    void* scratch = blur_line_scratch(job, image->height, BLUR_COLUMN_BLOCK);
+    if (!scratch) {
+        job->ok = false;
+        return;
+    }
+
+    for (int block = block_begin; block < block_end; block++) {
+        int plane = block / job->blocks_per_plane;
+        int offset = (block % job->blocks_per_plane) * BLUR_COLUMN_BLOCK;
+        int lanes = (row_lanes - offset < BLUR_COLUMN_BLOCK) ? row_lanes - offset : BLUR_COLUMN_BLOCK;
+
+        if (planar) {
+            blur_line(job, image_plane_row(image, plane, 0) + offset, image->height, lanes,
+                      (size_t)image->stride, scratch);
+        } else {
+            blur_line(job, (float*)image_row_bytes(image, 0) + offset, image->height, lanes,
+                      (size_t)row_lanes, scratch);
+        }
+    }
+
+    free(scratch);
+}
+
+static bool gaussian_blur_lines(Image* image, BlurMethod method, float sigma) {
+    BlurLineJob job;
+    memset(&job, 0, sizeof(job));
+    job.image = image;
+    job.method = method;
+    job.ok = true;
+
+    if (method == BLUR_METHOD_BOX) {
+        job.box = box_cascade_init(sigma);
+    } else {
+        iir_init(&job.iir, sigma);
+    }
+
+    int planes = pixel_format_planes(image->format);
+    bool planar = (planes > 0);
+    int row_lanes = planar ? image->width : 3 * image->width;
+    job.blocks_per_plane = (row_lanes + BLUR_COLUMN_BLOCK - 1) / BLUR_COLUMN_BLOCK;
+
+    parallel_for_rows(image->height, blur_lines_horizontal_rows, &job);
+    if (job.ok) {
+        parallel_for_rows(job.blocks_per_plane * (planar ? planes : 1), blur_lines_vertical_blocks, &job);
+    }
+    return job.ok;
+}
+
+// Изменение размеров (Resize)
+// Разделимая передискретизация: для столбцов и строк результата один раз
+// вычисляются таблицы весов, затем каждая строка источника сжимается (или
+// растягивается) по горизонтали, а строки результата собираются из этих
+// строк по вертикали. Во время проходов пиксель - 4 числа float (r, g, b
+// и альфа RGBA8) в единицах формата, поэтому отсчет ядра для всех каналов -
+// одно умножение-сложение SSE2, и альфа масштабируется вместе с цветом
+// Пиксель одноканального формата - одно число
+// Строки источника подаются блоками по порядку (ResizeStream): в памяти
+// остаются только строки, которые еще нужны строкам результата
+
+// Радиус ядра Ланцоша в пикселях источника (при уменьшении - в шагах результата)
+#define RESIZE_LANCZOS_A 3
+// Строк источника в блоке при изменении размеров изображения целиком
+#define RESIZE_BLOCK_ROWS 64
+
+#define RESIZE_PI 3.14159265358979323846
+
+// Таблица весов одной оси
+typedef struct {
+    int size;        // Отсчетов результата
+    int taps;        // Шаг таблицы (наибольшее число весов отсчета)
+    int* start;      // Первый отсчет источника (не убывает от отсчета к отсчету)
+    int* count;      // Число весов отсчета
+    float* weights;  // Веса отсчета i - с weights[i * taps], их сумма равна 1
+} ResizeWeights;
+
+static double resize_sinc(double x) {
+    if (x == 0.0) return 1.0;
+    x *= RESIZE_PI;
+    return sin(x) / x;
+}
+
+// Вес пикселя источника [j, j + 1) для отсчета результата с центром center
+// footprint - ширина отсчета результата в пикселях источника (не меньше 1)
+static double resize_weight(ResizeMethod method, int j, double center, double footprint) {
+    double t = (j + 0.5 - center) / footprint;
+    switch (method) {
+        case RESIZE_METHOD_BILINEAR:
+            return (t < 1.0 && t > -1.0) ? 1.0 - fabs(t) : 0.0;
+        case RESIZE_METHOD_LANCZOS:
+            return (t < RESIZE_LANCZOS_A && t > -RESIZE_LANCZOS_A) ? resize_sinc(t) * resize_sinc(t / RESIZE_LANCZOS_A)
+                                                                   : 0.0;
+        default: {
+            // Площадь пересечения пикселя с отсчетом результата
+            double left = center - 0.5 * footprint;
+            double right = center + 0.5 * footprint;
+            double overlap = ((j + 1 < right) ? j + 1 : right) - ((j > left) ? j : left);
+            return (overlap > 0.0) ? overlap : 0.0;
+        }
+    }
+}
+
+static void resize_weights_free(ResizeWeights* table) {
+    free(table->start);
+    free(table->count);
+    free(table->weights);
+}
+
+// Таблица для оси из source отсчетов в size отсчетов
+// У краев ядро обрезается, а оставшиеся веса нормируются
+static bool resize_weights_init(ResizeWeights* table, ResizeMethod method, int source, int size) {
+    double scale = (double)source / size;
+    double footprint = (scale > 1.0) ? scale : 1.0;
+    double support = footprint * ((method == RESIZE_METHOD_LANCZOS) ? RESIZE_LANCZOS_A :
+                                  (method == RESIZE_METHOD_BILINEAR) ? 1.0 : 0.5);
+
+    table->size = size;
+    table->taps = (int)ceil(2.0 * support) + 2;
+    if (table->taps > source) table->taps = source;
+    table->start = (int*)malloc((size_t)size * sizeof(int));
+    table->count = (int*)malloc((size_t)size * sizeof(int));
+    table->weights = (float*)malloc((size_t)size * table->taps * sizeof(float));
+    double* weights = (double*)malloc((size_t)table->taps * sizeof(double));
+    if (!table->start || !table->count || !table->weights || !weights) {
+        free(weights);
+        resize_weights_free(table);
+        return false;
+    }
+
+    for (int i = 0; i < size; i++) {
+        double center = (i + 0.5) * scale;
+        int lo = (int)floor(center - support);
+        int hi = (int)ceil(center + support);
+        if (lo < 0) lo = 0;
+        if (hi > source) hi = source;
+        if (hi - lo > table->taps) hi = lo + table->taps;
+
+        // Первый отсчет не сдвигается и при нулевом весе: начала отсчетов
+        // не убывают, и строки источника можно отбрасывать по порядку
+        double sum = 0.0;
+        int count = 0;
+        for (int j = lo; j < hi; j++) {
+            weights[j - lo] = resize_weight(method, j, center, footprint);
+            sum += weights[j - lo];
+            if (weights[j - lo] != 0.0) count = j - lo + 1;
+        }
+
+        float* out = table->weights + (size_t)i * table->taps;
+        table->start[i] = lo;
+        if (sum <= 0.0) {
+            // Ядро не накрыло ни одного пикселя - ближайший пиксель
+            table->count[i] = 1;
+            out[0] = 1.0f;
+            continue;
+        }
+        table->count[i] = count;
+        for (int k = 0; k < count; k++) {
+            out[k] = (float)(weights[k] / sum);
+        }
+    }
+
+    free(weights);
+    return true;
+}
+
+// Строка источника в 4 числа на пиксель (альфа - только у RGBA8)
+// или в 1 число у одноканальных форматов
+static void resize_load_row(const Image* image, int y, float* out) {
+    int width = image->width;
+
+    if (image->format == PIXEL_FORMAT_GRAY_F32) {
+        memcpy(out, image_plane_row(image, 0, y), (size_t)width * sizeof(float));
+        return;
+    }
+
+    if (image->format == PIXEL_FORMAT_PLANAR_F32) {
+        const float* r = image_plane_row(image, 0, y);
+        const float* g = image_plane_row(image, 1, y);
+        const float* b = image_plane_row(image, 2, y);
+        for (int x = 0; x < width; x++) {
+            out[4 * x + 0] = r[x];
+            out[4 * x + 1] = g[x];
+            out[4 * x + 2] = b[x];
+            out[4 * x + 3] = 0.0f;
+        }
+        return;
+    }
+
+    const uint8_t* row = image_row_bytes(image, y);
+    switch (image->format) {
+        case PIXEL_FORMAT_RGB_F32: {
+            const Color* src = (const Color*)row;
+            for (int x = 0; x < width; x++) {
+                out[4 * x + 0] = src[x].r;
+                out[4 * x + 1] = src[x].g;
+                out[4 * x + 2] = src[x].b;
+                out[4 * x + 3] = 0.0f;
+            }
+            break;
+        }
+        case PIXEL_FORMAT_RGB8:
+            for (int x = 0; x < width; x++) {
+                out[4 * x + 0] = row[3 * x + 0];
+                out[4 * x + 1] = row[3 * x + 1];
+                out[4 * x + 2] = row[3 * x + 2];
+                out[4 * x + 3] = 0.0f;
+            }
+            break;
+        case PIXEL_FORMAT_RGBA8:
+            for (int x = 0; x < 4 * width; x++) {
+                out[x] = row[x];
+            }
+            break;
+        case PIXEL_FORMAT_RGB16: {
+            const uint16_t* src = (const uint16_t*)row;
+            for (int x = 0; x < width; x++) {
+                out[4 * x + 0] = src[3 * x + 0];
+                out[4 * x + 1] = src[3 * x + 1];
+                out[4 * x + 2] = src[3 * x + 2];
+                out[4 * x + 3] = 0.0f;
+            }
+            break;
+        }
+        case PIXEL_FORMAT_GRAY8:
+            for (int x = 0; x < width; x++) {
+                out[x] = row[x];
+            }
+            break;
+        case PIXEL_FORMAT_PLANAR_F32:
+        case PIXEL_FORMAT_GRAY_F32:
+            break;  // обработаны выше
+    }
+}
+
+// Ограничение диапазоном [0, max]: ядро Ланцоша выходит за пределы диапазона
+static inline float resize_clamp(float value, float max) {
+    if (!(value > 0.0f)) return 0.0f;
+    return (value < max) ? value : max;
+}
+
+// Строка результата из 4 чисел на пиксель (у одноканальных форматов - из одного)
+static void resize_store_row(Image* image, int y, const float* in) {
+    int width = image->width;
+
+    if (image->format == PIXEL_FORMAT_GRAY_F32) {
+        float* out = image_plane_row(image, 0, y);
+        for (int x = 0; x < width; x++) {
+            out[x] = resize_clamp(in[x], 1.0f);
+        }
+        return;
+    }
+
+    if (image->format == PIXEL_FORMAT_PLANAR_F32) {
+        float* r = image_plane_row(image, 0, y);
+        float* g = image_plane_row(image, 1, y);
+        float* b = image_plane_row(image, 2, y);
+        for (int x = 0; x < width; x++) {
+            r[x] = resize_clamp(in[4 * x + 0], 1.0f);
+            g[x] = resize_clamp(in[4 * x + 1], 1.0f);
+            b[x] = resize_clamp(in[4 * x + 2], 1.0f);
+        }
+        return;
+    }
+
+    uint8_t* row = image_row_bytes(image, y);
+    switch (image->format) {
+        case PIXEL_FORMAT_RGB_F32: {
+            Color* dst = (Color*)row;
+            for (int x = 0; x < width; x++) {
+                dst[x].r = resize_clamp(in[4 * x + 0], 1.0f);
+                dst[x].g = resize_clamp(in[4 * x + 1], 1.0f);
+                dst[x].b = resize_clamp(in[4 * x + 2], 1.0f);
+            }
+            break;
+        }
+        case PIXEL_FORMAT_RGB8:
+            for (int x = 0; x < width; x++) {
+                row[3 * x + 0] = (uint8_t)(resize_clamp(in[4 * x + 0], 255.0f) + 0.5f);
+                row[3 * x + 1] = (uint8_t)(resize_clamp(in[4 * x + 1], 255.0f) + 0.5f);
+                row[3 * x + 2] = (uint8_t)(resize_clamp(in[4 * x + 2], 255.0f) + 0.5f);
+            }
+            break;
+        case PIXEL_FORMAT_RGBA8:
+            for (int x = 0; x < 4 * width; x++) {
+                row[x] = (uint8_t)(resize_clamp(in[x], 255.0f) + 0.5f);
+            }
+            break;
+        case PIXEL_FORMAT_RGB16: {
+            uint16_t* dst = (uint16_t*)row;
+            for (int x = 0; x < width; x++) {
+                dst[3 * x + 0] = (uint16_t)(resize_clamp(in[4 * x + 0], 65535.0f) + 0.5f);
+                dst[3 * x + 1] = (uint16_t)(resize_clamp(in[4 * x + 1], 65535.0f) + 0.5f);
+                dst[3 * x + 2] = (uint16_t)(resize_clamp(in[4 * x + 2], 65535.0f) + 0.5f);
+            }
+            break;
+        }
+        case PIXEL_FORMAT_GRAY8:
+            for (int x = 0; x < width; x++) {
+                row[x] = (uint8_t)(resize_clamp(in[x], 255.0f) + 0.5f);
+            }
+            break;
+        case PIXEL_FORMAT_PLANAR_F32:
+        case PIXEL_FORMAT_GRAY_F32:
+            break;  // обработаны выше
+    }
+}
+
+// Горизонтальный проход одной строки: in - пиксели источника, out - результата
+// lanes - чисел на пиксель (4 или 1)
+static void resize_horizontal_row(const ResizeWeights* table, const float* in, float* out, int lanes) {
+    if (lanes == 1) {
+        for (int i = 0; i < table->size; i++) {
+            const float* weights = table->weights + (size_t)i * table->taps;
+            const float* src = in + table->start[i];
+            float sum = 0.0f;
+            for (int k = 0; k < table->count[i]; k++) {
+                sum += weights[k] * src[k];
+            }
+            out[i] = sum;
+        }
+        return;
+    }
+
+    for (int i = 0; i < table->size; i++) {
+        const float* weights = table->weights + (size_t)i * table->taps;
+        const float* src = in + 4 * (size_t)table->start[i];
+        int count = table->count[i];
+#ifdef __SSE2__
+        __m128 sum = _mm_setzero_ps();
+        for (int k = 0; k < count; k++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(src + 4 * k)));
+        }
+        _mm_storeu_ps(out + 4 * i, sum);
+#else
+        float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int k = 0; k < count; k++) {
+            for (int c = 0; c < 4; c++) {
+                sum[c] += weights[k] * src[4 * k + c];
+            }
+        }
+        memcpy(out + 4 * i, sum, sizeof(sum));
+#endif
+    }
+}
+
+// Вертикальный проход: строка результата из count строк, начиная с rows
+// (строки подряд с шагом length чисел)
+static void resize_vertical_row(const float* rows, size_t length, const float* weights, int count, float* out) {
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= length; i += 4) {
+        __m128 sum = _mm_setzero_ps();
+        const float* src = rows + i;
+        for (int k = 0; k < count; k++, src += length) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(src)));
+        }
+        _mm_storeu_ps(out + i, sum);
+    }
+#endif
+    for (; i < length; i++) {
+        float sum = 0.0f;
+        const float* src = rows + i;
+        for (int k = 0; k < count; k++, src += length) {
+            sum += weights[k] * *src;
+        }
+        out[i] = sum;
+    }
+}
+
+struct ResizeStream {
+    ResizeWeights columns;
+    ResizeWeights rows;
+    int lanes;             // Чисел на пиксель в строках прохода (4 или 1)
+    int source_width;
+    int source_height;
+    Image* result;
+    float* lines;          // Строки источника после горизонтального прохода
+    int capacity;          // Строк, на которые хватает lines
+    int first;             // Номер строки источника в начале lines
+    int filled;            // Строк в lines
+    int next;              // Следующая строка результата
+};
+
+// Задание прохода: строки источника (горизонтальный) или результата (вертикальный)
+typedef struct {
+    ResizeStream* stream;
+    const Image* source;
+    int source_y;          // Строка source, с которой начинается блок
+    int line;              // Строка lines для первой строки блока
+    int row;               // Первая строка результата
+    bool ok;
+} ResizeJob;
+
+static void resize_horizontal_rows(void* context, int y_begin, int y_end) {
+    ResizeJob* job = (ResizeJob*)context;
+    ResizeStream* stream = job->stream;
+    size_t length = (size_t)stream->lanes * stream->columns.size;
+
+    float* in = (float*)malloc((size_t)stream->lanes * stream->source_width * sizeof(float));
+    if (!in) {
+        job->ok = false;
+        return;
+    }
+    for (int y = y_begin; y < y_end; y++) {
+        resize_load_row(job->source, job->source_y + y, in);
+        resize_horizontal_row(&stream->columns, in, stream->lines + (size_t)(job->line + y) * length, stream->lanes);
+    }
+    free(in);
+}
+
+static void resize_vertical_rows(void* context, int y_begin, int y_end) {
+    ResizeJob* job = (ResizeJob*)context;
+    ResizeStream* stream = job->stream;
+    size_t length = (size_t)stream->lanes * stream->columns.size;
+
+    float* out = (float*)malloc(length * sizeof(float));
+    if (!out) {
+        job->ok = false;
+        return;
+    }
+    for (int y = job->row + y_begin; y < job->row + y_end; y++) {
+        const float* weights = stream->rows.weights + (size_t)y * stream->rows.taps;
+        const float* rows = stream->lines + (size_t)(stream->rows.start[y] - stream->first) * length;
+        resize_vertical_row(rows, length, weights, stream->rows.count[y], out);
+        resize_store_row(stream->result, y, out);
+    }
+    free(out);
+}
+
+ResizeStream* resize_stream_create(const Filter* filter, int width, int height, PixelFormat format, Image* result) {
+    if (filter->param1 <= 0 || filter->param2 <= 0 || width <= 0 || height <= 0 ||
+        !image_reshape(result, filter->param1, filter->param2, format)) {
+        return NULL;
+    }
+
+    ResizeStream* stream = (ResizeStream*)calloc(1, sizeof(ResizeStream));
+    if (!stream) {
+        return NULL;
+    }
+    ResizeMethod method = (ResizeMethod)filter->param4;
+    if (!resize_weights_init(&stream->columns, method, width, filter->param1)) {
+        free(stream);
+        return NULL;
+    }
+    if (!resize_weights_init(&stream->rows, method, height, filter->param2)) {
+        resize_weights_free(&stream->columns);
+        free(stream);
+        return NULL;
+    }
+    stream->lanes = (pixel_format_channels(format) == 1) ? 1 : 4;
+    stream->source_width = width;
+    stream->source_height = height;
+    stream->result = result;
+    return stream;
+}
+
+bool resize_stream_push(ResizeStream* stream, const Image* source, int y, int count) {
+    int received = stream->first + stream->filled;
+    if (source->width != stream->source_width || count <= 0 || y < 0 || y + count > source->height ||
+        received + count > stream->source_height) {
+        return false;
     }
-    
-    for (int y = 0; y < image->height; y++) {
-        for (int x = 0; x < image->width; x++) {
-            Color color = image_get_pixel(image, x, y);
-            // Инвертируем каждый канал: новый = 1.0 - исходный
-            Color negative = {1.0f - color.r, 1.0f - color.g, 1.0f - color.b};
-            image_set_pixel(result, x, y, negative);
+
+    size_t length = (size_t)stream->lanes * stream->columns.size;
+    if (stream->filled + count > stream->capacity) {
+        float* lines = (float*)realloc(stream->lines, (size_t)(stream->filled + count) * length * sizeof(float));
+        if (!lines) {
+            return false;
         }
+        stream->lines = lines;
+        stream->capacity = stream->filled + count;
     }
-    
-    return result;
+
+    ResizeJob job = {stream, source, y, stream->filled, 0, true};
+    parallel_for_rows(count, resize_horizontal_rows, &job);
+    stream->filled += count;
+    received += count;
+
+    // Строки результата, для которых получены все строки источника
+    int end = stream->next;
+    while (end < stream->rows.size && stream->rows.start[end] + stream->rows.count[end] <= received) {
+        end++;
+    }
+    if (end > stream->next) {
+        job.row = stream->next;
+        parallel_for_rows(end - stream->next, resize_vertical_rows, &job);
+        stream->next = end;
+    }
+
+    // Строки до начала следующей строки результата больше не нужны
+    int keep = (stream->next < stream->rows.size) ? stream->rows.start[stream->next] : received;
+    if (keep > stream->first) {
+        int drop = keep - stream->first;
+        stream->filled -= drop;
+        memmove(stream->lines, stream->lines + (size_t)drop * length, (size_t)stream->filled * length * sizeof(float));
+        stream->first = keep;
+    }
+    return job.ok;
 }
 
-// Фильтр повышения резкости (Sharpening)
-// Усиливает контраст на границах объектов
-Image* filter_apply_sharpening(const Image* image) {
-    Image* result = image_clone(image);
-    if (!result) {
-        return NULL;
+bool resize_stream_finish(ResizeStream* stream) {
+    if (!stream) {
+        return false;
     }
-    
-    // Ядро свертки для повышения резкости
-    // Центральный элемент усилен для выделения деталей
-    float kernel[3][3] = {
-        {0, -1, 0},
-        {-1, 5, -1},
-        {0, -1, 0}
+    bool done = stream->next == stream->rows.size;
+    resize_weights_free(&stream->columns);
+    resize_weights_free(&stream->rows);
+    free(stream->lines);
+    free(stream);
+    return done;
+}
+
+// Изменение размеров изображения целиком: строки подаются блоками,
+// поэтому строк после горизонтального прохода в памяти немного
+static bool resize_buffered(Image** image, Image** spare, const Filter* filter) {
+    Image* source = *image;
+    if (filter->param1 == source->width && filter->param2 == source->height) {
+        return true;  // Ядра всех способов при том же размере дают исходные пиксели
+    }
+
+    ResizeStream* stream = resize_stream_create(filter, source->width, source->height, source->format, *spare);
+    bool ok = stream != NULL;
+    for (int y = 0; y < source->height && ok; y += RESIZE_BLOCK_ROWS) {
+        int rows = (source->height - y < RESIZE_BLOCK_ROWS) ? source->height - y : RESIZE_BLOCK_ROWS;
+        ok = resize_stream_push(stream, source, y, rows);
+    }
+    if (!resize_stream_finish(stream) || !ok) {
+        return false;
+    }
+
+    swap_images(image, spare);
+    return true;
+}
+
+bool resize_method_parse(const char* name, ResizeMethod* method) {
+    static const struct { const char* name; ResizeMethod method; } names[] = {
+        {"box", RESIZE_METHOD_BOX},
+        {"bilinear", RESIZE_METHOD_BILINEAR},
+        {"lanczos", RESIZE_METHOD_LANCZOS}
     };
-    
-    // Применяем свертку с ядром
-    for (int y = 0; y < image->height; y++) {
-        for (int x = 0; x < image->width; x++) {
-            Color sum = {0, 0, 0};
-            
-            // Проходим по окрестности 3x3
-            for (int ky = -1; ky <= 1; ky++) {
-                for (int kx = -1; kx <= 1; kx++) {
-                    // Берем пиксель с учетом границ
-                    Color neighbor = image_get_pixel_clamped(image, x + kx, y + ky);
-                    float weight = kernel[ky + 1][kx + 1];
-                    
-                    // Суммируем взвешенные значения
-                    sum.r += neighbor.r * weight;
-                    sum.g += neighbor.g * weight;
-                    sum.b += neighbor.b * weight;
-                }
-            }
-            
-            // Ограничиваем результат и сохраняем
-            image_set_pixel(result, x, y, color_clamp(sum));
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i].name) == 0) {
+            *method = names[i].method;
+            return true;
         }
     }
-    
-    return result;
+    return false;
 }
 
-// Фильтр обнаружения границ (Edge Detection)
-// Выделяет границы объектов на изображении
-Image* filter_apply_edge_detection(const Image* image, float threshold) {
-    // Сначала преобразуем в оттенки серого
-    Image* grayscale = filter_apply_grayscale(image);
-    if (!grayscale) {
-        return NULL;
+static bool gaussian_blur_buffered(Image** image, Image** spare, const Filter* filter) {
+    float sigma = filter->param3;
+    if (!blur_sigma_valid(sigma)) {
+        return false;
     }
-    
-    Image* result = image_create(image->width, image->height);
-    if (!result) {
-        image_free(grayscale);
-        return NULL;
+    if (sigma <= 0) {
+        return true;  // Без размытия
     }
-    
-    // Ядро Лапласа для обнаружения границ
-    float kernel[3][3] = {
-        {-1, -1, -1},
-        {-1,  8, -1},
-        {-1, -1, -1}
+
+    BlurMethod method = blur_resolve_method(filter);
+    if (method == BLUR_METHOD_EXACT) {
+        return gaussian_blur_exact_buffered(image, spare, sigma);
+    }
+    return gaussian_blur_lines(*image, method, sigma);
+}
+
+bool blur_method_parse(const char* name, BlurMethod* method) {
+    static const struct { const char* name; BlurMethod method; } names[] = {
+        {"auto", BLUR_METHOD_AUTO},
+        {"exact", BLUR_METHOD_EXACT},
+        {"box", BLUR_METHOD_BOX},
+        {"iir", BLUR_METHOD_IIR}
     };
-    
-    for (int y = 0; y < image->height; y++) {
-        for (int x = 0; x < image->width; x++) {
-            float sum = 0.0f;
-            
-            // Свертка с ядром Лапласа
-            for (int ky = -1; ky <= 1; ky++) {
-                for (int kx = -1; kx <= 1; kx++) {
-                    Color neighbor = image_get_pixel_clamped(grayscale, x + kx, y + ky);
-                    float weight = kernel[ky + 1][kx + 1];
-                    sum += neighbor.r * weight;  // Все каналы одинаковы в grayscale
-                }
-            }
-            
-            // Бинаризация по порогу
-            Color color;
-            if (sum > threshold) {
-                color.r = color.g = color.b = 1.0f;  // Белый - граница
-            } else {
-                color.r = color.g = color.b = 0.0f;  // Черный - фон
-            }
-            
-            image_set_pixel(result, x, y, color);
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(name, names[i].name) == 0) {
+            *method = names[i].method;
+            return true;
         }
     }
-    
-    image_free(grayscale);
-    return result;
+    return false;
 }
 
-// Медианный фильтр (Median Filter)
-// Удаляет шум, сохраняя границы
-Image* filter_apply_median(const Image* image, int window) {
-    Image* result = image_create(image->width, image->height);
-    if (!result) {
-        return NULL;
-    }
-    
-    int radius = window / 2;  // Радиус окна
-    int window_size = window * window;  // Общее количество пикселей в окне
-    
-    // Буферы для хранения значений каналов в окне
-    float* reds = (float*)malloc(window_size * sizeof(float));
-    float* greens = (float*)malloc(window_size * sizeof(float));
-    float* blues = (float*)malloc(window_size * sizeof(float));
-    
-    if (!reds || !greens || !blues) {
-        free(reds);
-        free(greens);
-        free(blues);
-        image_free(result);
-        return NULL;
-    }
-    
-    for (int y = 0; y < image->height; y++) {
-        for (int x = 0; x < image->width; x++) {
-            int count = 0;
-            
-            // Собираем все пиксели в окне
-            for (int wy = -radius; wy <= radius; wy++) {
-                for (int wx = -radius; wx <= radius; wx++) {
-                    Color color = image_get_pixel_clamped(image, x + wx, y + wy);
-                    reds[count] = color.r;
-                    greens[count] = color.g;
-                    blues[count] = color.b;
-                    count++;
-                }
+// Генератор случайных чисел без состояния
+// Число - хеш от (зерно, x, y), поэтому его можно получить для любого пикселя
+// или ячейки независимо, в любом порядке и в любом потоке, а результат фильтра
+// при одном зерне всегда одинаков
+
+// Перемешивание битов (функция lowbias32 Криса Веллонса)
+static inline uint32_t random_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// Ключ строки y (считается один раз на строку)
+static inline uint32_t random_row_key(uint32_t seed, int y) {
+    return random_mix(random_mix(seed + 0x9e3779b9u) ^ (uint32_t)y);
+}
+
+// Случайное число пикселя x строки с ключом key
+static inline uint32_t random_at(uint32_t key, int x) {
+    return random_mix(key ^ (uint32_t)x * 0x9e3779b9u);
+}
+
+// Фильтр кристаллизации (Crystallize)
+// Диаграмма Вороного: в каждой ячейке сетки со стороной cell_size лежит
+// случайная точка-центр, пиксель относится к ближайшему центру и получает
+// средний цвет всех пикселей своей области. Центр ближайшей области ищется
+// только среди 3x3 соседних ячеек сетки, поэтому время линейно по числу пикселей
+typedef struct {
+    int cell_size;
+    int cells_x;          // Ячеек сетки в ряду
+    int cells_y;          // Рядов ячеек
+    uint32_t seed;        // Зерно генератора
+} VoronoiGrid;
+
+// Сумма цветов и число пикселей области
+typedef struct {
+    double r, g, b;
+    int count;
+} VoronoiCell;
+
+// Центры трех рядов ячеек [cell_y - 1, cell_y + 1] по паре (x, y) на ячейку
+// Ряды вне сетки помечаются координатой x = -1
+typedef struct {
+    int cell_y;           // Средний ряд (-1 - еще не загружен)
+    int* points;          // 3 * cells_x пар координат
+} VoronoiRows;
+
+// Центр ячейки (cell_x, cell_y): у ячеек на краю - в пределах изображения
+static void voronoi_point(const VoronoiGrid* grid, const Image* image, uint32_t key,
+                          int cell_x, int cell_y, int* px, int* py) {
+    int x0 = cell_x * grid->cell_size;
+    int y0 = cell_y * grid->cell_size;
+    int w = (image->width - x0 < grid->cell_size) ? image->width - x0 : grid->cell_size;
+    int h = (image->height - y0 < grid->cell_size) ? image->height - y0 : grid->cell_size;
+    uint32_t hash = random_at(key, cell_x);
+    *px = x0 + (int)(hash % (uint32_t)w);
+    *py = y0 + (int)(random_mix(hash) % (uint32_t)h);
+}
+
+// Загружает центры рядов вокруг ряда cell_y (если он изменился)
+static void voronoi_load_rows(const VoronoiGrid* grid, const Image* image, VoronoiRows* rows, int cell_y) {
+    if (rows->cell_y == cell_y) return;
+    rows->cell_y = cell_y;
+
+    for (int i = 0; i < 3; i++) {
+        int* points = rows->points + 2 * i * grid->cells_x;
+        int y = cell_y + i - 1;
+        if (y < 0 || y >= grid->cells_y) {
+            for (int cx = 0; cx < grid->cells_x; cx++) {
+                points[2 * cx] = -1;
             }
-            
-            // Сортируем значения каждого канала
-            qsort(reds, count, sizeof(float), compare_floats);
-            qsort(greens, count, sizeof(float), compare_floats);
-            qsort(blues, count, sizeof(float), compare_floats);
-            
-            // Берем медиану (серединное значение)
-            int mid = count / 2;
-            Color median = {reds[mid], greens[mid], blues[mid]};
-            image_set_pixel(result, x, y, median);
+            continue;
+        }
+        uint32_t key = random_row_key(grid->seed, y);
+        for (int cx = 0; cx < grid->cells_x; cx++) {
+            voronoi_point(grid, image, key, cx, y, &points[2 * cx], &points[2 * cx + 1]);
         }
     }
-    
-    free(reds);
-    free(greens);
-    free(blues);
-    
-    return result;
 }
 
-// Гауссово размытие (Gaussian Blur)
-// Плавное размытие изображения
-Image* filter_apply_gaussian_blur(const Image* image, float sigma) {
-    if (sigma <= 0) {
-        return image_clone(image);  // Без размытия
-    }
-    
-    // Вычисление радиуса ядра (3σ покрывает 99.7% распределения)
-    int radius = (int)ceil(3 * sigma);
-    int size = 2 * radius + 1;  // Размер ядра
-    
-    // Создание одномерного ядра Гаусса
-    float* kernel = (float*)malloc(size * sizeof(float));
-    if (!kernel) {
-        return NULL;
-    }
-    
-    // Вычисление значений Гауссовой функции
-    float sum = 0.0f;
-    for (int i = 0; i < size; i++) {
-        int x = i - radius;
-        kernel[i] = exp(-(x * x) / (2 * sigma * sigma));
-        sum += kernel[i];
+// Номер ячейки, центр которой ближе всего к пикселю (x, y) ряда rows->cell_y
+// При равных расстояниях выбирается первая в порядке обхода ячейка
+static inline int voronoi_nearest(const VoronoiGrid* grid, const VoronoiRows* rows, int x, int y) {
+    int cell_x = x / grid->cell_size;
+    int x_begin = (cell_x > 0) ? cell_x - 1 : 0;
+    int x_end = (cell_x + 1 < grid->cells_x) ? cell_x + 1 : grid->cells_x - 1;
+    int64_t best = INT64_MAX;
+    int nearest = 0;
+
+    for (int i = 0; i < 3; i++) {
+        const int* points = rows->points + 2 * i * grid->cells_x;
+        for (int cx = x_begin; cx <= x_end; cx++) {
+            if (points[2 * cx] < 0) break;  // ряд вне сетки
+            int64_t dx = points[2 * cx] - x;
+            int64_t dy = points[2 * cx + 1] - y;
+            int64_t distance = dx * dx + dy * dy;
+            if (distance < best) {
+                best = distance;
+                nearest = (rows->cell_y + i - 1) * grid->cells_x + cx;
+            }
+        }
     }
-    
-    // Нормализация ядра (сумма весов = 1)
-    for (int i = 0; i < size; i++) {
-        kernel[i] /= sum;
+    return nearest;
+}
+
+typedef struct {
+    const VoronoiGrid* grid;
+    VoronoiCell* cells;
+    int phase;            // Ряды ячеек сетки с номером phase по модулю 3
+    bool ok;
+} CrystallizeJob;
+
+static bool voronoi_rows_init(const VoronoiGrid* grid, VoronoiRows* rows, Color** line, int width) {
+    rows->cell_y = -1;
+    rows->points = (int*)malloc((size_t)6 * grid->cells_x * sizeof(int));
+    *line = (Color*)malloc((size_t)width * sizeof(Color));
+    if (!rows->points || !*line) {
+        free(rows->points);
+        free(*line);
+        return false;
     }
-    
-    // Разделяемая свертка: сначала по горизонтали
-    Image* temp = image_create(image->width, image->height);
-    if (!temp) {
-        free(kernel);
-        return NULL;
+    return true;
+}
+
+// Суммирование цветов по областям: полоса строк одного ряда ячеек вносит
+// вклад только в соседние ряды, поэтому ряды с номерами одного остатка по
+// модулю 3 обрабатываются параллельно без гонок, а порядок сложения
+// не зависит от числа потоков
+static void crystallize_sum_rows(void* context, int begin, int end) {
+    CrystallizeJob* crystal = (CrystallizeJob*)((FilterJob*)context)->extra;
+    const Image* image = ((FilterJob*)context)->src;
+    const VoronoiGrid* grid = crystal->grid;
+
+    VoronoiRows rows;
+    Color* line;
+    if (!voronoi_rows_init(grid, &rows, &line, image->width)) {
+        crystal->ok = false;
+        return;
     }
-    
-    // Горизонтальное размытие
-    for (int y = 0; y < image->height; y++) {
-        for (int x = 0; x < image->width; x++) {
-            Color sum = {0, 0, 0};
-            
-            for (int i = 0; i < size; i++) {
-                int dx = i - radius;
-                Color neighbor = image_get_pixel_clamped(image, x + dx, y);
-                float weight = kernel[i];
-                
-                sum.r += neighbor.r * weight;
-                sum.g += neighbor.g * weight;
-                sum.b += neighbor.b * weight;
+
+    for (int i = begin; i < end; i++) {
+        int cell_y = 3 * i + crystal->phase;
+        int y_end = (cell_y + 1) * grid->cell_size;
+        if (y_end > image->height) y_end = image->height;
+        voronoi_load_rows(grid, image, &rows, cell_y);
+
+        for (int y = cell_y * grid->cell_size; y < y_end; y++) {
+            image_read_row(image, y, line);
+            for (int x = 0; x < image->width; x++) {
+                VoronoiCell* cell = &crystal->cells[voronoi_nearest(grid, &rows, x, y)];
+                cell->r += line[x].r;
+                cell->g += line[x].g;
+                cell->b += line[x].b;
+                cell->count++;
             }
-            
-            image_set_pixel(temp, x, y, sum);
         }
     }
-    
-    // Вертикальное размытие
-    Image* result = image_create(image->width, image->height);
-    if (!result) {
-        free(kernel);
-        image_free(temp);
-        return NULL;
+
+    free(rows.points);
+    free(line);
+}
+
+// Заливка: каждый пиксель получает средний цвет своей области
+static void crystallize_fill_rows(void* context, int y_begin, int y_end) {
+    CrystallizeJob* crystal = (CrystallizeJob*)((FilterJob*)context)->extra;
+    Image* image = ((FilterJob*)context)->dst;
+    const VoronoiGrid* grid = crystal->grid;
+
+    VoronoiRows rows;
+    Color* line;
+    if (!voronoi_rows_init(grid, &rows, &line, image->width)) {
+        crystal->ok = false;
+        return;
     }
-    
-    for (int y = 0; y < image->height; y++) {
+
+    for (int y = y_begin; y < y_end; y++) {
+        voronoi_load_rows(grid, image, &rows, y / grid->cell_size);
         for (int x = 0; x < image->width; x++) {
-            Color sum = {0, 0, 0};
-            
-            for (int i = 0; i < size; i++) {
-                int dy = i - radius;
-                Color neighbor = image_get_pixel_clamped(temp, x, y + dy);
-                float weight = kernel[i];
-                
-                sum.r += neighbor.r * weight;
-                sum.g += neighbor.g * weight;
-                sum.b += neighbor.b * weight;
-            }
-            
-            image_set_pixel(result, x, y, sum);
+            const VoronoiCell* cell = &crystal->cells[voronoi_nearest(grid, &rows, x, y)];
+            line[x].r = (float)(cell->r / cell->count);
+            line[x].g = (float)(cell->g / cell->count);
+            line[x].b = (float)(cell->b / cell->count);
         }
+        image_write_row(image, y, line);
     }
-    
-    free(kernel);
-    image_free(temp);
-    
-    return result;
+
+    free(rows.points);
+    free(line);
 }
 
-// Фильтр кристаллизации (Crystallize)
-// Создает эффект разбиения на ячейки с однородным цветом
-Image* filter_apply_crystallize(const Image* image, int cell_size) {
+// Результат пишется на место исходного изображения (запасной буфер не нужен)
+static bool crystallize_buffered(Image** image, int cell_size, uint32_t seed) {
     if (cell_size <= 1) {
-        return image_clone(image);  // Без эффекта
+        return true;  // Без эффекта
     }
-    
-    Image* result = image_create(image->width, image->height);
-    if (!result) {
-        return NULL;
+
+    Image* source = *image;
+    VoronoiGrid grid = {
+        cell_size,
+        (source->width + cell_size - 1) / cell_size,
+        (source->height + cell_size - 1) / cell_size,
+        seed
+    };
+    if (grid.cells_x == 0 || grid.cells_y == 0) {
+        return true;
     }
-    
-    srand(time(NULL));  // Инициализация генератора случайных чисел
-    
-    // Разбиваем изображение на ячейки
-    for (int cell_y = 0; cell_y < image->height; cell_y += cell_size) {
-        for (int cell_x = 0; cell_x < image->width; cell_x += cell_size) {
-            // Выбираем случайный пиксель в ячейке как эталон
-            int offset_x = rand() % cell_size;
-            int offset_y = rand() % cell_size;
-            
-            int ref_x = cell_x + offset_x;
-            int ref_y = cell_y + offset_y;
-            
-            // Ограничиваем координаты границами изображения
-            if (ref_x >= image->width) ref_x = image->width - 1;
-            if (ref_y >= image->height) ref_y = image->height - 1;
-            
-            Color reference = image_get_pixel(image, ref_x, ref_y);
-            
-            // Заполняем всю ячейку эталонным цветом
-            for (int y = cell_y; y < cell_y + cell_size && y < image->height; y++) {
-                for (int x = cell_x; x < cell_x + cell_size && x < image->width; x++) {
-                    image_set_pixel(result, x, y, reference);
-                }
-            }
-        }
+
+    // Сумма по каждой области; центр лежит в своей области, поэтому count > 0
+    VoronoiCell* cells = (VoronoiCell*)calloc((size_t)grid.cells_x * grid.cells_y, sizeof(VoronoiCell));
+    if (!cells) {
+        return false;
     }
-    
-    return result;
+
+    CrystallizeJob crystal = {&grid, cells, 0, true};
+    FilterJob job = {source, source, NULL, 0, 0, &crystal};
+    for (crystal.phase = 0; crystal.phase < 3 && crystal.ok; crystal.phase++) {
+        int count = (grid.cells_y - crystal.phase + 2) / 3;
+        parallel_for_rows(count, crystallize_sum_rows, &job);
+    }
+    if (crystal.ok) {
+        parallel_for_rows(source->height, crystallize_fill_rows, &job);
+    }
+
+    free(cells);
+    return crystal.ok;
 }
 
 // Стеклянный фильтр (Glass Filter)
 // Создает эффект просмотра через текстурированное стекло
-Image* filter_apply_glass(const Image* image, float distortion) {
-    Image* result = image_create(image->width, image->height);
-    if (!result) {
-        return NULL;
-    }
-    
-    srand(time(NULL));  // Инициализация генератора случайных чисел
-    
-    for (int y = 0; y < image->height; y++) {
-        for (int x = 0; x < image->width; x++) {
-            // Генерируем случайное смещение
-            float dx = (rand() / (float)RAND_MAX - 0.5f) * 2.0f * distortion;
-            float dy = (rand() / (float)RAND_MAX - 0.5f) * 2.0f * distortion;
+typedef struct {
+    float distortion;
+    uint32_t seed;        // Зерно генератора
+} GlassJob;
+
+static void glass_rows(void* context, int y_begin, int y_end) {
+    const FilterJob* job = (const FilterJob*)context;
+    const GlassJob* glass = (const GlassJob*)job->extra;
+    const Image* source = job->src;
+    float distortion = glass->distortion;
+    size_t step = pixel_format_size(source->format);  // Пиксели копируются побайтно
+    int planes = pixel_format_planes(source->format);      // или по плоскостям
+
+    for (int y = y_begin; y < y_end; y++) {
+        uint32_t key = random_row_key(glass->seed, y);
+        uint8_t* row = (planes > 0) ? NULL : image_row_bytes(job->dst, y);
+        for (int x = 0; x < source->width; x++) {
+            // Случайное смещение: по 16 бит одного числа на каждую ось
+            uint32_t h = random_at(key, x);
+            float dx = ((h & 0xffff) / 65535.0f - 0.5f) * 2.0f * distortion;
+            float dy = ((h >> 16) / 65535.0f - 0.5f) * 2.0f * distortion;
             
             // Вычисляем координаты источника с учетом смещения
             int source_x = (int)(x + dx * 10);
@@ -393,42 +3449,150 @@ Image* filter_apply_glass(const Image* image, float distortion) {
             
             // Ограничиваем координаты
             if (source_x < 0) source_x = 0;
-            if (source_x >= image->width) source_x = image->width - 1;
+            if (source_x >= source->width) source_x = source->width - 1;
             if (source_y < 0) source_y = 0;
-            if (source_y >= image->height) source_y = image->height - 1;
+            if (source_y >= source->height) source_y = source->height - 1;
             
             // Берем цвет из смещенной позиции
-            Color color = image_get_pixel(image, source_x, source_y);
-            image_set_pixel(result, x, y, color);
+            if (planes > 0) {
+                for (int c = 0; c < planes; c++) {
+                    image_plane_row(job->dst, c, y)[x] = image_plane_row(source, c, source_y)[source_x];
+                }
+            } else {
+                memcpy(row + x * step, image_row_bytes(source, source_y) + source_x * step, step);
+            }
         }
     }
+}
+
+static bool glass_buffered(Image** image, Image** spare, float distortion, uint32_t seed) {
+    Image* source = *image;
+    if (!image_reshape(*spare, source->width, source->height, source->format)) {
+        return false;
+    }
     
-    return result;
+    GlassJob glass = {distortion, seed};
+    FilterJob job = {source, *spare, NULL, 0, 0, &glass};
+    parallel_for_rows(source->height, glass_rows, &job);
+    
+    swap_images(image, spare);
+    return true;
 }
 
-// Общая функция применения фильтра
+// Применение фильтра с переиспользованием буферов
 // Вызывает соответствующую функцию фильтра по типу
-Image* filter_apply(const Filter* filter, const Image* image) {
+bool filter_apply_buffered(const Filter* filter, Image** image, Image** spare) {
+    // Формат, с которым фильтр не работает напрямую, обрабатывается через float
+    if (!filter_supports_format(filter->type, (*image)->format)) {
+        Image* result = filter_apply_promoted(filter, *image);
+        if (!result) {
+            return false;
+        }
+        image_free(*image);
+        *image = result;
+        return true;
+    }
+
     switch (filter->type) {
         case FILTER_CROP:
-            return filter_apply_crop(image, filter->param1, filter->param2);
+            return crop_buffered(image, spare, filter->param4, filter->param5, filter->param1, filter->param2);
         case FILTER_GRAYSCALE:
-            return filter_apply_grayscale(image);
+            if (pixel_format_gray((*image)->format) != (*image)->format) {
+                return filter_apply_point_chain(filter, 1, image, spare);
+            }
+            point_in_place(*image, grayscale_rows);
+            return true;
         case FILTER_NEGATIVE:
-            return filter_apply_negative(image);
+            point_in_place(*image, negative_rows);
+            return true;
         case FILTER_SHARPENING:
-            return filter_apply_sharpening(image);
+            return sharpening_buffered(image, spare);
         case FILTER_EDGE_DETECTION:
-            return filter_apply_edge_detection(image, filter->param3);
+            return edge_detection_buffered(image, spare, filter->param3);
         case FILTER_MEDIAN:
-            return filter_apply_median(image, filter->param1);
+            return median_buffered(image, spare, filter->param1);
         case FILTER_GAUSSIAN_BLUR:
-            return filter_apply_gaussian_blur(image, filter->param3);
+            return gaussian_blur_buffered(image, spare, filter);
         case FILTER_CRYSTALLIZE:
-            return filter_apply_crystallize(image, filter->param1);
+            return crystallize_buffered(image, filter->param1, (uint32_t)filter->param2);
         case FILTER_GLASS:
-            return filter_apply_glass(image, filter->param3);
+            return glass_buffered(image, spare, filter->param3, (uint32_t)filter->param2);
+        case FILTER_CONVOLUTION:
+            return convolution_buffered(image, spare, filter->kernel);
+        case FILTER_RESIZE:
+            return resize_buffered(image, spare, filter);
         default:
-            return NULL;  // Неизвестный тип фильтра
+            return false;  // Неизвестный тип фильтра
+    }
+}
+
+// Общая функция применения фильтра
+// Исходное изображение не меняется, результат - новое изображение
+Image* filter_apply(const Filter* filter, const Image* image) {
+    Image* result = image_clone(image);
+    Image* spare = image_create_empty();
+    if (!result || !spare || !filter_apply_buffered(filter, &result, &spare)) {
+        image_free(result);
+        image_free(spare);
+        return NULL;
     }
+
+    image_free(spare);
+    return result;
+}
+
+// Функции отдельных фильтров
+Image* filter_apply_crop(const Image* image, int x, int y, int width, int height) {
+    Filter filter = {FILTER_CROP, width, height, 0, x, y, NULL};
+    return filter_apply(&filter, image);
+}
+
+Image* filter_apply_grayscale(const Image* image) {
+    Filter filter = {FILTER_GRAYSCALE, 0, 0, 0, 0, 0, NULL};
+    return filter_apply(&filter, image);
+}
+
+Image* filter_apply_negative(const Image* image) {
+    Filter filter = {FILTER_NEGATIVE, 0, 0, 0, 0, 0, NULL};
+    return filter_apply(&filter, image);
+}
+
+Image* filter_apply_sharpening(const Image* image) {
+    Filter filter = {FILTER_SHARPENING, 0, 0, 0, 0, 0, NULL};
+    return filter_apply(&filter, image);
+}
+
+Image* filter_apply_edge_detection(const Image* image, float threshold) {
+    Filter filter = {FILTER_EDGE_DETECTION, 0, 0, threshold, 0, 0, NULL};
+    return filter_apply(&filter, image);
+}
+
+Image* filter_apply_median(const Image* image, int window) {
+    Filter filter = {FILTER_MEDIAN, window, 0, 0, 0, 0, NULL};
+    return filter_apply(&filter, image);
+}
+
+Image* filter_apply_gaussian_blur(const Image* image, float sigma) {
+    Filter filter = {FILTER_GAUSSIAN_BLUR, BLUR_METHOD_AUTO, 0, sigma, 0, 0, NULL};
+    return filter_apply(&filter, image);
+}
+
+Image* filter_apply_crystallize(const Image* image, int cell_size) {
+    Filter filter = {FILTER_CRYSTALLIZE, cell_size, 0, 0, 0, 0, NULL};
+    return filter_apply(&filter, image);
+}
+
+Image* filter_apply_glass(const Image* image, float distortion) {
+    Filter filter = {FILTER_GLASS, 0, 0, distortion, 0, 0, NULL};
+    return filter_apply(&filter, image);
+}
+
+Image* filter_apply_convolution(const Image* image, const ConvKernel* kernel) {
+    Filter filter = {FILTER_CONVOLUTION, 0, 0, 0, 0, 0, kernel};
+    return filter_apply(&filter, image);
+}
+
+Image* filter_apply_resize(const Image* image, int width, int height, ResizeMethod method) {
+    Filter filter = {FILTER_RESIZE, width, height, 0, method, 0, NULL};
+    return filter_apply(&filter, image);
 }
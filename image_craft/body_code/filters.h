@@ -14,32 +14,130 @@ typedef enum {
     FILTER_MEDIAN,         // Медианный фильтр
     FILTER_GAUSSIAN_BLUR,  // Гауссово размытие
     FILTER_CRYSTALLIZE,    // Кристаллизация
-    FILTER_GLASS           // Стеклянный эффект
+    FILTER_GLASS,          // Стеклянный эффект
+    FILTER_CONVOLUTION,    // Свертка с ядром пользователя
+    FILTER_RESIZE          // Изменение размеров
 } FilterType;
 
+// Способ вычисления Гауссова размытия (param1 фильтра FILTER_GAUSSIAN_BLUR)
+// Точное ядро стоит O(sigma) на пиксель, каскад box-фильтров и рекурсивный
+// фильтр - O(1) независимо от sigma. Отличие от точного ядра в 8-битном
+// результате (тестовые изображения, sigma от 1 до 50):
+//   BLUR_METHOD_BOX - не более 3 уровней яркости дальше 3 * sigma от краев,
+//                     не более 5 у краев
+//   BLUR_METHOD_IIR - не более 1 уровня; отклик бесконечен, поэтому фильтр
+//                     не делится на плитки и полосы (--stream)
+typedef enum {
+    BLUR_METHOD_AUTO,   // Точное ядро при sigma < 2, иначе каскад box-фильтров
+    BLUR_METHOD_EXACT,  // Свертка с ядром радиуса ceil(3 * sigma)
+    BLUR_METHOD_BOX,    // Каскад из 4 расширенных box-фильтров
+    BLUR_METHOD_IIR     // Рекурсивный фильтр Дерише 4-го порядка (при sigma < 1 - точное ядро)
+} BlurMethod;
+
+// Наибольшая sigma размытия: ядро уже шире любого реального изображения,
+// а большая sigma (или не число) не дает вычислить радиус ядра
+#define BLUR_MAX_SIGMA 1000.0f
+
+// Способ изменения размеров (param4 фильтра FILTER_RESIZE)
+// При уменьшении ядро растягивается на шаг результата, поэтому каждый
+// пиксель источника входит в результат (без наложения спектров)
+typedef enum {
+    RESIZE_METHOD_BOX,       // Среднее по площади: пиксель результата - среднее покрытых им пикселей
+    RESIZE_METHOD_BILINEAR,  // Треугольное ядро
+    RESIZE_METHOD_LANCZOS    // Ядро Ланцоша (a = 3): резче, у контрастных границ - слабый ореол
+} ResizeMethod;
+
+// Ядро свертки пользователя: нечетные размеры до CONV_KERNEL_MAX_SIZE,
+// веса по строкам сверху вниз
+#define CONV_KERNEL_MAX_SIZE 63
+
+typedef struct {
+    int width;
+    int height;
+    float* weights;
+} ConvKernel;
+
 // Структура для параметров фильтра
-// param1, param2 - целочисленные параметры
+// param1, param2, param4, param5 - целочисленные параметры
 // param3 - параметр с плавающей точкой
 typedef struct {
     FilterType type;  // Тип фильтра
-    int param1;       // Например: ширина для crop, размер окна для median
-    int param2;       // Например: высота для crop
+    int param1;       // Например: ширина для crop и resize, размер окна для median, BlurMethod для blur
+    int param2;       // Например: высота для crop и resize, зерно генератора для crystallize и glass
     float param3;     // Например: порог для edge detection, sigma для blur
+    int param4;       // Например: левый край окна crop, ResizeMethod для resize
+    int param5;       // Например: верхний край окна crop
+    const ConvKernel* kernel;  // Ядро для FILTER_CONVOLUTION (иначе NULL)
 } Filter;
 
 // Функции фильтров (каждая применяет соответствующий фильтр)
-Image* filter_apply_crop(const Image* image, int width, int height);
+Image* filter_apply_crop(const Image* image, int x, int y, int width, int height);
 Image* filter_apply_grayscale(const Image* image);
 Image* filter_apply_negative(const Image* image);
 Image* filter_apply_sharpening(const Image* image);
 Image* filter_apply_edge_detection(const Image* image, float threshold);
 Image* filter_apply_median(const Image* image, int window);
 Image* filter_apply_gaussian_blur(const Image* image, float sigma);
-Image* filter_apply_crystallize(const Image* image, int cell_size);
-Image* filter_apply_glass(const Image* image, float distortion);
+Image* filter_apply_crystallize(const Image* image, int cell_size);  // зерно 0
+Image* filter_apply_glass(const Image* image, float distortion);    // зерно 0
+Image* filter_apply_convolution(const Image* image, const ConvKernel* kernel);
+Image* filter_apply_resize(const Image* image, int width, int height, ResizeMethod method);
+
+// Ядро свертки из строки "WxH:w1,w2,...[/делитель]" или из файла
+// (строки ядра по строкам файла, числа через пробелы или запятые,
+// '#' - комментарий до конца строки, строка "/делитель" делит все веса)
+// Возвращает NULL при ошибке
+ConvKernel* conv_kernel_parse(const char* spec);
+ConvKernel* conv_kernel_clone(const ConvKernel* kernel);
+void conv_kernel_free(ConvKernel* kernel);
+
+// Имя фильтра для отчетов - как в командной строке без дефиса (crop, gs, blur, ...)
+const char* filter_name(FilterType type);
+
+// Разбор названия способа размытия (auto, exact, box, iir)
+bool blur_method_parse(const char* name, BlurMethod* method);
+
+// Разбор названия способа изменения размеров (box, bilinear, lanczos)
+bool resize_method_parse(const char* name, ResizeMethod* method);
+
+// Изменение размеров по мере чтения: строки источника width x height
+// подаются блоками сверху вниз, и каждая строка результата пишется в result,
+// как только получены все нужные ей строки, - изображение источника целиком
+// в памяти не нужно. result получает размеры фильтра и формат format
+typedef struct ResizeStream ResizeStream;
+ResizeStream* resize_stream_create(const Filter* filter, int width, int height, PixelFormat format, Image* result);
+// Следующие count строк источника - строки [y, y + count) изображения source
+bool resize_stream_push(ResizeStream* stream, const Image* source, int y, int count);
+// Освобождает состояние; true, если все строки результата записаны
+bool resize_stream_finish(ResizeStream* stream);
+
+// Ядра Гаусса для повторяющихся sigma вычисляются один раз за процесс
+// Освобождение кэша - только когда фильтры больше не выполняются
+void filter_release_caches(void);
+
+// Может ли фильтр работать с форматом пикселей напрямую
+// (иначе изображение временно переводится во float)
+bool filter_supports_format(FilterType type, PixelFormat format);
+
+// Радиус окрестности, которую фильтр читает вокруг пикселя
+// -1 - фильтр нелокален или меняет размеры изображения
+int filter_halo(const Filter* filter);
+
+// Применение фильтра с переиспользованием буферов
+// *image - исходное изображение, фильтр может изменить его на месте;
+// *spare - запасной буфер любого размера (его память переиспользуется)
+// После вызова *image - результат, *spare - снова свободный буфер
+// При ошибке возвращает false, оба изображения остаются во владении вызывающего
+bool filter_apply_buffered(const Filter* filter, Image** image, Image** spare);
+
+// Поэлементные фильтры (обрезка, оттенки серого, негатив) и их слитное
+// выполнение за один проход по памяти без промежуточных изображений
+// Буферы - как у filter_apply_buffered
+bool filter_is_pointwise(FilterType type);
+bool filter_apply_point_chain(const Filter* filters, int count, Image** image, Image** spare);
 
 // Общая функция применения фильтра
-// Выбирает нужную функцию по типу фильтра
+// Выбирает нужную функцию по типу фильтра, исходное изображение не меняется
 Image* filter_apply(const Filter* filter, const Image* image);
 
 #endif // FILTERS_H
@@ -0,0 +1,157 @@
+#include "filters_planar.h"
+#include <stdlib.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Порядок операций во всех ядрах совпадает с фильтрами для формата Color,
+// поэтому результат побитово тот же, что и без SIMD
+// Ядра, кроме оттенков серого, проходят по всем плоскостям формата:
+// три у PLANAR_F32, одна у GRAY_F32
+
+// Ограничение координаты диапазоном [0, size - 1]
+static inline int clamp_coord(int v, int size) {
+    if (v < 0) return 0;
+    if (v >= size) return size - 1;
+    return v;
+}
+
+// Оттенки серого: все три плоскости получают яркость
+void planar_grayscale_rows(Image* image, int y_begin, int y_end) {
+    for (int y = y_begin; y < y_end; y++) {
+        float* r = image_plane_row(image, 0, y);
+        float* g = image_plane_row(image, 1, y);
+        float* b = image_plane_row(image, 2, y);
+        int x = 0;
+
+#ifdef __SSE2__
+        const __m128 kr = _mm_set1_ps(0.299f);
+        const __m128 kg = _mm_set1_ps(0.587f);
+        const __m128 kb = _mm_set1_ps(0.114f);
+        for (; x < image->stride; x += 4) {
+            __m128 gray = _mm_add_ps(_mm_add_ps(_mm_mul_ps(kr, _mm_load_ps(r + x)),
+                                                _mm_mul_ps(kg, _mm_load_ps(g + x))),
+                                     _mm_mul_ps(kb, _mm_load_ps(b + x)));
+            _mm_store_ps(r + x, gray);
+            _mm_store_ps(g + x, gray);
+            _mm_store_ps(b + x, gray);
+        }
+#endif
+
+        for (; x < image->width; x++) {
+            float gray = 0.299f * r[x] + 0.587f * g[x] + 0.114f * b[x];
+            r[x] = g[x] = b[x] = gray;
+        }
+    }
+}
+
+// Негатив: каждый канал 1.0 - значение
+void planar_negative_rows(Image* image, int y_begin, int y_end) {
+    int planes = pixel_format_planes(image->format);
+    for (int y = y_begin; y < y_end; y++) {
+        for (int c = 0; c < planes; c++) {
+            float* row = image_plane_row(image, c, y);
+            int x = 0;
+
+#ifdef __SSE2__
+            const __m128 one = _mm_set1_ps(1.0f);
+            for (; x < image->stride; x += 4) {
+                _mm_store_ps(row + x, _mm_sub_ps(one, _mm_load_ps(row + x)));
+            }
+#endif
+
+            for (; x < image->width; x++) {
+                row[x] = 1.0f - row[x];
+            }
+        }
+    }
+}
+
+// Горизонтальная свертка одной строки плоскости
+static void blur_row(const float* in, float* out, int width, const float* kernel, int radius) {
+    int size = 2 * radius + 1;
+    int x = 0;
+
+    // Левый край и узкие изображения - с ограничением координат
+    for (; x < width && x < radius; x++) {
+        float sum = 0.0f;
+        for (int i = 0; i < size; i++) {
+            sum += in[clamp_coord(x + i - radius, width)] * kernel[i];
+        }
+        out[x] = sum;
+    }
+
+#ifdef __SSE2__
+    for (; x + 4 <= width - radius; x += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for (int i = 0; i < size; i++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(in + x + i - radius), _mm_set1_ps(kernel[i])));
+        }
+        _mm_storeu_ps(out + x, sum);
+    }
+#endif
+
+    for (; x < width; x++) {
+        float sum = 0.0f;
+        for (int i = 0; i < size; i++) {
+            sum += in[clamp_coord(x + i - radius, width)] * kernel[i];
+        }
+        out[x] = sum;
+    }
+}
+
+void planar_blur_horizontal_rows(const Image* image, Image* result,
+                                 const float* kernel, int radius, int y_begin, int y_end) {
+    int planes = pixel_format_planes(image->format);
+    for (int y = y_begin; y < y_end; y++) {
+        for (int c = 0; c < planes; c++) {
+            blur_row(image_plane_row(image, c, y), image_plane_row(result, c, y), image->width, kernel, radius);
+        }
+    }
+}
+
+// Вертикальная свертка: строки окна выровнены, SIMD идет по всему шагу строки
+// Возвращает false при нехватке памяти
+bool planar_blur_vertical_rows(const Image* image, Image* result,
+                               const float* kernel, int radius, int y_begin, int y_end) {
+    int height = image->height;
+    int planes = pixel_format_planes(image->format);
+    int size = 2 * radius + 1;
+
+    const float** rows = (const float**)malloc(size * sizeof(float*));
+    if (!rows) {
+        return false;
+    }
+
+    for (int y = y_begin; y < y_end; y++) {
+        for (int c = 0; c < planes; c++) {
+            for (int i = 0; i < size; i++) {
+                rows[i] = image_plane_row(image, c, clamp_coord(y + i - radius, height));
+            }
+            float* out = image_plane_row(result, c, y);
+            int x = 0;
+
+#ifdef __SSE2__
+            for (; x < image->stride; x += 4) {
+                __m128 sum = _mm_setzero_ps();
+                for (int i = 0; i < size; i++) {
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(rows[i] + x), _mm_set1_ps(kernel[i])));
+                }
+                _mm_store_ps(out + x, sum);
+            }
+#endif
+
+            for (; x < image->width; x++) {
+                float sum = 0.0f;
+                for (int i = 0; i < size; i++) {
+                    sum += rows[i][x] * kernel[i];
+                }
+                out[x] = sum;
+            }
+        }
+    }
+
+    free(rows);
+    return true;
+}
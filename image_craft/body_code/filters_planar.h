@@ -0,0 +1,24 @@
+#ifndef FILTERS_PLANAR_H
+#define FILTERS_PLANAR_H
+
+#include "image.h"
+
+// SIMD-ядра фильтров для планарных форматов PIXEL_FORMAT_PLANAR_F32
+// и PIXEL_FORMAT_GRAY_F32 (одна плоскость яркости)
+// Плоскости выровнены, а шаг строки кратен IMAGE_PLANE_ALIGN, поэтому
+// точечные фильтры обрабатывают строку целиком, включая дополнение
+// Каждая функция обрабатывает полосу строк [y_begin, y_end) всех плоскостей
+// (оттенки серого - только трех плоскостей PLANAR_F32)
+
+// Точечные фильтры (изменяют изображение на месте)
+void planar_grayscale_rows(Image* image, int y_begin, int y_end);
+void planar_negative_rows(Image* image, int y_begin, int y_end);
+
+// Фильтры окрестности (читают image, пишут в result того же размера)
+// Свертки 3x3 (повышение резкости) выполняет общий для всех форматов код filters.c
+void planar_blur_horizontal_rows(const Image* image, Image* result,
+                                 const float* kernel, int radius, int y_begin, int y_end);
+bool planar_blur_vertical_rows(const Image* image, Image* result,
+                               const float* kernel, int radius, int y_begin, int y_end);
+
+#endif // FILTERS_PLANAR_H
@@ -6,33 +6,105 @@
 // СОЗДАНИЕ И УДАЛЕНИЕ КАРТИНКИ
 //:):)
 Image* image_create(int width, int height) {
+    return image_create_format(width, height, PIXEL_FORMAT_RGB_F32);
+}
+
+Image* image_create_format(int width, int height, PixelFormat format) {
     if (width <= 0 || height <= 0) {
         return NULL;
     }
 
-    Image* image = (Image*)malloc(sizeof(Image));
+    Image* image = image_create_empty();
     if (!image) {
         return NULL;
     }
 
-    image->width = width;
-    image->height = height;
-    image->data = (Color*)malloc(width * height * sizeof(Color));
-    
-    if (!image->data) {
+    if (!image_reshape(image, width, height, format)) {
         free(image);
         return NULL;
     }
 
     // Инициализация нулями
-    memset(image->data, 0, width * height * sizeof(Color));
+    memset(image->buffer, 0, image->capacity);
     
     return image;
 }
 
+//*создает изображение без пикселей: буфер выделит image_reshape
+Image* image_create_empty(void) {
+    Image* image = (Image*)malloc(sizeof(Image));
+    if (!image) {
+        return NULL;
+    }
+
+    image->width = 0;
+    image->height = 0;
+    image->format = PIXEL_FORMAT_RGB_F32;
+    image->data = NULL;
+    image->pixels = NULL;
+    image->planes[0] = image->planes[1] = image->planes[2] = NULL;
+    image->stride = 0;
+    image->buffer = NULL;
+    image->capacity = 0;
+
+    return image;
+}
+
+//*меняет размеры и формат изображения
+//*буфер переиспользуется, если его хватает; содержимое пикселей не определено
+bool image_reshape(Image* image, int width, int height, PixelFormat format) {
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+
+    int stride = width;
+    size_t size = (size_t)width * height * pixel_format_size(format);
+
+    int planes = pixel_format_planes(format);
+    if (planes > 0) {
+        // Строки дополняются до кратного выравниванию размера,
+        // блок выделяется с запасом под выравнивание начала
+        int align = IMAGE_PLANE_ALIGN / sizeof(float);
+        stride = (width + align - 1) / align * align;
+        size = planes * (size_t)stride * height * sizeof(float) + IMAGE_PLANE_ALIGN;
+    }
+
+    if (size > image->capacity) {
+        void* buffer = malloc(size);
+        if (!buffer) {
+            return false;
+        }
+        free(image->buffer);
+        image->buffer = buffer;
+        image->capacity = size;
+    }
+
+    image->width = width;
+    image->height = height;
+    image->format = format;
+    image->stride = stride;
+    image->data = NULL;
+    image->pixels = NULL;
+    image->planes[0] = image->planes[1] = image->planes[2] = NULL;
+
+    if (planes > 0) {
+        size_t plane_size = (size_t)stride * height;
+        uintptr_t base = ((uintptr_t)image->buffer + IMAGE_PLANE_ALIGN - 1) & ~(uintptr_t)(IMAGE_PLANE_ALIGN - 1);
+        for (int c = 0; c < planes; c++) {
+            image->planes[c] = (float*)base + c * plane_size;
+        }
+    } else if (format == PIXEL_FORMAT_RGB_F32) {
+        image->data = (Color*)image->buffer;
+    } else {
+        image->pixels = (uint8_t*)image->buffer;
+    }
+
+    return true;
+}
+
 void image_free(Image* image) {
     if (image) {
-        free(image->data);
+        free(image->buffer);
         free(image);
     }
 }
@@ -44,12 +116,23 @@ void image_free(Image* image) {
 
 //*создает копию изображения
 Image* image_clone(const Image* image) {
-    Image* clone = image_create(image->width, image->height);
+    Image* clone = image_create_empty();
     if (!clone) {
         return NULL;
     }
+    if (!image_reshape(clone, image->width, image->height, image->format)) {
+        image_free(clone);
+        return NULL;
+    }
     
-    memcpy(clone->data, image->data, image->width * image->height * sizeof(Color));
+    int planes = pixel_format_planes(image->format);
+    if (planes > 0) {
+        memcpy(clone->planes[0], image->planes[0], planes * (size_t)image->stride * image->height * sizeof(float));
+        return clone;
+    }
+
+    memcpy(image_row_bytes(clone, 0), image_row_bytes(image, 0),
+           (size_t)image->width * image->height * pixel_format_size(image->format));
     return clone;
 }
 //*получает цвет пикселя(по коорд)
@@ -80,3 +163,341 @@ int image_get_index(const Image* image, int x, int y) {
 
 }
 //:):):)
+
+//ФОРМАТЫ ПИКСЕЛЕЙ
+
+//*размер пикселя в байтах
+size_t pixel_format_size(PixelFormat format) {
+    switch (format) {
+        case PIXEL_FORMAT_RGB8:  return 3;
+        case PIXEL_FORMAT_RGBA8: return 4;
+        case PIXEL_FORMAT_RGB16: return 3 * sizeof(uint16_t);
+        case PIXEL_FORMAT_PLANAR_F32: return 3 * sizeof(float);  // без учета выравнивания строк
+        case PIXEL_FORMAT_GRAY8: return 1;
+        case PIXEL_FORMAT_GRAY_F32: return sizeof(float);        // без учета выравнивания строк
+        case PIXEL_FORMAT_RGB_F32:
+        default:                 return sizeof(Color);
+    }
+}
+
+//*имена форматов в командной строке
+static const struct { const char* name; PixelFormat format; } pixel_format_names[] = {
+    {"f32", PIXEL_FORMAT_RGB_F32},
+    {"rgb8", PIXEL_FORMAT_RGB8},
+    {"rgba8", PIXEL_FORMAT_RGBA8},
+    {"rgb16", PIXEL_FORMAT_RGB16},
+    {"planar", PIXEL_FORMAT_PLANAR_F32},
+    {"gray8", PIXEL_FORMAT_GRAY8},
+    {"grayf32", PIXEL_FORMAT_GRAY_F32}
+};
+
+#define PIXEL_FORMAT_NAME_COUNT (sizeof(pixel_format_names) / sizeof(pixel_format_names[0]))
+
+//*разбор имени формата из командной строки (f32, rgb8, rgba8, rgb16, planar, gray8, grayf32)
+bool pixel_format_parse(const char* name, PixelFormat* format) {
+    for (size_t i = 0; i < PIXEL_FORMAT_NAME_COUNT; i++) {
+        if (strcmp(name, pixel_format_names[i].name) == 0) {
+            *format = pixel_format_names[i].format;
+            return true;
+        }
+    }
+    return false;
+}
+
+//*имя формата для отчетов (обратное к pixel_format_parse)
+const char* pixel_format_name(PixelFormat format) {
+    for (size_t i = 0; i < PIXEL_FORMAT_NAME_COUNT; i++) {
+        if (pixel_format_names[i].format == format) {
+            return pixel_format_names[i].name;
+        }
+    }
+    return "?";
+}
+
+//*число каналов пикселя: 1 у форматов оттенков серого, 4 у RGBA8, иначе 3
+int pixel_format_channels(PixelFormat format) {
+    switch (format) {
+        case PIXEL_FORMAT_GRAY8:
+        case PIXEL_FORMAT_GRAY_F32: return 1;
+        case PIXEL_FORMAT_RGBA8:    return 4;
+        default:                    return 3;
+    }
+}
+
+//*число выровненных плоскостей float (0 - пиксели упакованы построчно)
+int pixel_format_planes(PixelFormat format) {
+    switch (format) {
+        case PIXEL_FORMAT_PLANAR_F32: return 3;
+        case PIXEL_FORMAT_GRAY_F32:   return 1;
+        default:                      return 0;
+    }
+}
+
+//*одноканальный формат для результата оттенков серого: 8-битные каналы
+//*остаются байтом, остальные переходят во float; у RGBA8 формат не меняется,
+//*чтобы не потерять альфа-канал
+PixelFormat pixel_format_gray(PixelFormat format) {
+    switch (format) {
+        case PIXEL_FORMAT_RGB8:
+        case PIXEL_FORMAT_GRAY8: return PIXEL_FORMAT_GRAY8;
+        case PIXEL_FORMAT_RGBA8: return PIXEL_FORMAT_RGBA8;
+        default:                 return PIXEL_FORMAT_GRAY_F32;
+    }
+}
+
+//*формат float, в который переводится изображение для фильтров, не умеющих
+//*работать с его форматом напрямую (одноканальные остаются одноканальными)
+PixelFormat pixel_format_float(PixelFormat format) {
+    return (pixel_format_channels(format) == 1) ? PIXEL_FORMAT_GRAY_F32 : PIXEL_FORMAT_RGB_F32;
+}
+
+//*начало строки y в памяти (для любого формата, кроме планарных)
+uint8_t* image_row_bytes(const Image* image, int y) {
+    size_t offset = (size_t)y * image->width * pixel_format_size(image->format);
+    if (image->format == PIXEL_FORMAT_RGB_F32) {
+        return (uint8_t*)image->data + offset;
+    }
+    return image->pixels + offset;
+}
+
+//*начало строки y плоскости channel (0 - R, 1 - G, 2 - B) планарного формата
+//*(у GRAY_F32 - единственная плоскость 0)
+float* image_plane_row(const Image* image, int channel, int y) {
+    return image->planes[channel] + (size_t)y * image->stride;
+}
+
+//*копирует прямоугольник width x height между изображениями одного формата
+void image_copy_region(const Image* src, int src_x, int src_y,
+                       Image* dst, int dst_x, int dst_y, int width, int height) {
+    int planes = pixel_format_planes(src->format);
+    if (planes > 0) {
+        for (int y = 0; y < height; y++) {
+            for (int c = 0; c < planes; c++) {
+                memcpy(image_plane_row(dst, c, dst_y + y) + dst_x,
+                       image_plane_row(src, c, src_y + y) + src_x, (size_t)width * sizeof(float));
+            }
+        }
+        return;
+    }
+
+    size_t pixel_size = pixel_format_size(src->format);
+    for (int y = 0; y < height; y++) {
+        memcpy(image_row_bytes(dst, dst_y + y) + dst_x * pixel_size,
+               image_row_bytes(src, src_y + y) + src_x * pixel_size, width * pixel_size);
+    }
+}
+
+//*ограничивает область изображением width x height (размеры окна не больше
+//*изображения за вычетом угла); false, если угол вне изображения или окно пусто
+bool image_region_clip(ImageRegion* region, int width, int height) {
+    if (region->x < 0 || region->y < 0 || region->x >= width || region->y >= height) {
+        return false;
+    }
+    if (region->width > width - region->x) region->width = width - region->x;
+    if (region->height > height - region->y) region->height = height - region->y;
+    return region->width > 0 && region->height > 0;
+}
+
+//*читает строку любого формата в массив Color
+void image_read_row(const Image* image, int y, Color* out) {
+    int width = image->width;
+
+    if (image->format == PIXEL_FORMAT_GRAY_F32) {
+        const float* v = image_plane_row(image, 0, y);
+        for (int x = 0; x < width; x++) {
+            out[x].r = out[x].g = out[x].b = v[x];
+        }
+        return;
+    }
+
+    if (image->format == PIXEL_FORMAT_PLANAR_F32) {
+        const float* r = image_plane_row(image, 0, y);
+        const float* g = image_plane_row(image, 1, y);
+        const float* b = image_plane_row(image, 2, y);
+        for (int x = 0; x < width; x++) {
+            out[x].r = r[x];
+            out[x].g = g[x];
+            out[x].b = b[x];
+        }
+        return;
+    }
+
+    const uint8_t* row = image_row_bytes(image, y);
+
+    switch (image->format) {
+        case PIXEL_FORMAT_RGB_F32:
+            memcpy(out, row, (size_t)width * sizeof(Color));
+            break;
+        case PIXEL_FORMAT_RGB8:
+        case PIXEL_FORMAT_RGBA8: {
+            size_t step = pixel_format_size(image->format);
+            for (int x = 0; x < width; x++) {
+                out[x].r = row[x * step + 0] / 255.0f;
+                out[x].g = row[x * step + 1] / 255.0f;
+                out[x].b = row[x * step + 2] / 255.0f;
+            }
+            break;
+        }
+        case PIXEL_FORMAT_RGB16: {
+            const uint16_t* src = (const uint16_t*)row;
+            for (int x = 0; x < width; x++) {
+                out[x].r = src[3 * x + 0] / 65535.0f;
+                out[x].g = src[3 * x + 1] / 65535.0f;
+                out[x].b = src[3 * x + 2] / 65535.0f;
+            }
+            break;
+        }
+        case PIXEL_FORMAT_GRAY8:
+            for (int x = 0; x < width; x++) {
+                out[x].r = out[x].g = out[x].b = row[x] / 255.0f;
+            }
+            break;
+        case PIXEL_FORMAT_PLANAR_F32:
+        case PIXEL_FORMAT_GRAY_F32:
+            break;  // обработаны выше
+    }
+}
+
+// Перевод канала [0.0, 1.0] в целое [0, max] с округлением и ограничением
+static inline unsigned channel_quantize(float value, float max) {
+    float v = value * max;
+    if (!(v > 0.0f)) v = 0.0f;
+    if (v > max) v = max;
+    return (unsigned)(v + 0.5f);
+}
+
+// Яркость цвета - те же веса, что у фильтра оттенков серого
+static inline float color_luminance(Color c) {
+    return 0.299f * c.r + 0.587f * c.g + 0.114f * c.b;
+}
+
+//*записывает массив Color в строку любого формата
+//*(альфа-канал RGBA8 не изменяется, в одноканальные форматы пишется яркость)
+void image_write_row(Image* image, int y, const Color* in) {
+    int width = image->width;
+
+    if (image->format == PIXEL_FORMAT_GRAY_F32) {
+        float* v = image_plane_row(image, 0, y);
+        for (int x = 0; x < width; x++) {
+            v[x] = color_luminance(in[x]);
+        }
+        return;
+    }
+
+    if (image->format == PIXEL_FORMAT_PLANAR_F32) {
+        float* r = image_plane_row(image, 0, y);
+        float* g = image_plane_row(image, 1, y);
+        float* b = image_plane_row(image, 2, y);
+        for (int x = 0; x < width; x++) {
+            r[x] = in[x].r;
+            g[x] = in[x].g;
+            b[x] = in[x].b;
+        }
+        return;
+    }
+
+    uint8_t* row = image_row_bytes(image, y);
+
+    switch (image->format) {
+        case PIXEL_FORMAT_RGB_F32:
+            memcpy(row, in, (size_t)width * sizeof(Color));
+            break;
+        case PIXEL_FORMAT_RGB8:
+        case PIXEL_FORMAT_RGBA8: {
+            size_t step = pixel_format_size(image->format);
+            for (int x = 0; x < width; x++) {
+                row[x * step + 0] = (uint8_t)channel_quantize(in[x].r, 255.0f);
+                row[x * step + 1] = (uint8_t)channel_quantize(in[x].g, 255.0f);
+                row[x * step + 2] = (uint8_t)channel_quantize(in[x].b, 255.0f);
+            }
+            break;
+        }
+        case PIXEL_FORMAT_RGB16: {
+            uint16_t* dst = (uint16_t*)row;
+            for (int x = 0; x < width; x++) {
+                dst[3 * x + 0] = (uint16_t)channel_quantize(in[x].r, 65535.0f);
+                dst[3 * x + 1] = (uint16_t)channel_quantize(in[x].g, 65535.0f);
+                dst[3 * x + 2] = (uint16_t)channel_quantize(in[x].b, 65535.0f);
+            }
+            break;
+        }
+        case PIXEL_FORMAT_GRAY8:
+            for (int x = 0; x < width; x++) {
+                row[x] = (uint8_t)channel_quantize(color_luminance(in[x]), 255.0f);
+            }
+            break;
+        case PIXEL_FORMAT_PLANAR_F32:
+        case PIXEL_FORMAT_GRAY_F32:
+            break;  // обработаны выше
+    }
+}
+
+//*создает копию изображения в другом формате
+Image* image_convert(const Image* image, PixelFormat format) {
+    if (image->format == format) {
+        return image_clone(image);
+    }
+
+    Image* result = image_create_empty();
+    if (!result) {
+        return NULL;
+    }
+
+    if (!image_convert_into(image, result, format)) {
+        image_free(result);
+        return NULL;
+    }
+    return result;
+}
+
+//*переводит изображение в другой формат, записывая результат в буфер result
+bool image_convert_into(const Image* image, Image* result, PixelFormat format) {
+    if (!image_reshape(result, image->width, image->height, format)) {
+        return false;
+    }
+
+    // В форматах без альфа-канала пиксели считаются непрозрачными
+    if (format == PIXEL_FORMAT_RGBA8) {
+        for (size_t i = 0; i < (size_t)image->width * image->height; i++) {
+            result->pixels[4 * i + 3] = 255;
+        }
+    }
+
+    if (format == PIXEL_FORMAT_RGB_F32) {
+        for (int y = 0; y < image->height; y++) {
+            image_read_row(image, y, result->data + (size_t)y * image->width);
+        }
+        return true;
+    }
+
+    // Между одноканальными форматами яркость переводится напрямую, без Color
+    if (pixel_format_channels(image->format) == 1 && pixel_format_channels(format) == 1) {
+        for (int y = 0; y < image->height; y++) {
+            if (image->format == format) {
+                image_copy_region(image, 0, y, result, 0, y, image->width, 1);
+            } else if (format == PIXEL_FORMAT_GRAY_F32) {
+                const uint8_t* src = image_row_bytes(image, y);
+                float* dst = image_plane_row(result, 0, y);
+                for (int x = 0; x < image->width; x++) dst[x] = src[x] / 255.0f;
+            } else {
+                const float* src = image_plane_row(image, 0, y);
+                uint8_t* dst = image_row_bytes(result, y);
+                for (int x = 0; x < image->width; x++) dst[x] = (uint8_t)channel_quantize(src[x], 255.0f);
+            }
+        }
+        return true;
+    }
+
+    Color* row = (Color*)malloc((size_t)image->width * sizeof(Color));
+    if (!row) {
+        return false;
+    }
+
+    for (int y = 0; y < image->height; y++) {
+        image_read_row(image, y, row);
+        image_write_row(result, y, row);
+    }
+
+    free(row);
+    return true;
+}
@@ -2,23 +2,73 @@
 #define IMAGE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 typedef struct {
     float r, g, b;
 } Color;
 
+// Формат хранения пикселей
+typedef enum {
+    PIXEL_FORMAT_RGB_F32,  // Color (3 x float), 12 байт на пиксель - по умолчанию
+    PIXEL_FORMAT_RGB8,     // r, g, b по байту, 3 байта на пиксель
+    PIXEL_FORMAT_RGBA8,    // r, g, b, a по байту, 4 байта на пиксель
+    PIXEL_FORMAT_RGB16,    // r, g, b по uint16_t, 6 байт на пиксель
+    PIXEL_FORMAT_PLANAR_F32, // отдельные плоскости R, G, B из float (для SIMD)
+    PIXEL_FORMAT_GRAY8,    // яркость одним байтом, 1 байт на пиксель
+    PIXEL_FORMAT_GRAY_F32  // одна плоскость яркости из float (устроена как планарный формат)
+} PixelFormat;
+
+// Выравнивание плоскостей и шага строки планарного формата (в байтах)
+#define IMAGE_PLANE_ALIGN 64
+
 typedef struct {
     int width;
     int height;
-    Color* data;
+    Color* data;          // Пиксели формата PIXEL_FORMAT_RGB_F32 (иначе NULL)
+    PixelFormat format;   // Формат хранения
+    uint8_t* pixels;      // Пиксели упакованных форматов, строки подряд без выравнивания (иначе NULL)
+    float* planes[3];     // Плоскости R, G, B формата PIXEL_FORMAT_PLANAR_F32 или яркость
+                          // PIXEL_FORMAT_GRAY_F32 в planes[0] (иначе NULL)
+    int stride;           // Шаг строки плоскости в float (кратен IMAGE_PLANE_ALIGN)
+    void* buffer;         // Выделенная память, на которую указывают data/pixels/planes
+    size_t capacity;      // Ее размер в байтах (может быть больше нужного)
 } Image;
 
+// Прямоугольная область изображения (окно обрезки)
+typedef struct {
+    int x, y;             // Левый верхний угол
+    int width, height;
+} ImageRegion;
+
 // Создание и освобождение
 Image* image_create(int width, int height);
+Image* image_create_format(int width, int height, PixelFormat format);
+Image* image_create_empty(void);
+bool image_reshape(Image* image, int width, int height, PixelFormat format);
 void image_free(Image* image);
 Image* image_clone(const Image* image);
 
-// Доступ к пикселям
+// Форматы пикселей
+size_t pixel_format_size(PixelFormat format);
+bool pixel_format_parse(const char* name, PixelFormat* format);
+const char* pixel_format_name(PixelFormat format);
+int pixel_format_channels(PixelFormat format);
+int pixel_format_planes(PixelFormat format);
+PixelFormat pixel_format_gray(PixelFormat format);
+PixelFormat pixel_format_float(PixelFormat format);
+Image* image_convert(const Image* image, PixelFormat format);
+bool image_convert_into(const Image* image, Image* result, PixelFormat format);
+void image_read_row(const Image* image, int y, Color* out);
+void image_write_row(Image* image, int y, const Color* in);
+uint8_t* image_row_bytes(const Image* image, int y);
+float* image_plane_row(const Image* image, int channel, int y);
+void image_copy_region(const Image* src, int src_x, int src_y,
+                       Image* dst, int dst_x, int dst_y, int width, int height);
+bool image_region_clip(ImageRegion* region, int width, int height);
+
+// Доступ к пикселям (только PIXEL_FORMAT_RGB_F32)
 Color image_get_pixel(const Image* image, int x, int y);
 void image_set_pixel(Image* image, int x, int y, Color color);
 Color image_get_pixel_clamped(const Image* image, int x, int y);
@@ -6,108 +6,327 @@
 #include "image.h"
 #include "filters.h"
 #include "pipeline.h"
+#include "threadpool.h"
+#include "stream.h"
+#include "profile.h"
+#include "batch.h"
+#include "options.h"
+#include "serve.h"
 
 // Вывод справки по использованию программы
 void print_help() {
     printf("Использование: image_craft <input.bmp> <output.bmp> [фильтры...]\n");
-    printf("Пример: image_craft input.bmp output.bmp -crop 800 600 -gs -blur 0.5\n\n");
+    printf("               image_craft --batch <list.txt | 'dir/*.bmp'> [фильтры...] [--out-dir <dir>]\n");
+    printf("               image_craft --serve [--socket <path>] [параметры...]\n");
+    printf("Вход: BMP 1, 4 и 8 бит с палитрой (8 и 4 бита - и RLE), 16 и 32 бита (в т.ч. BI_BITFIELDS), 24 бита\n");
+    printf("Пример: image_craft input.bmp output.bmp -crop 800 600 -gs -blur 0.5\n");
+    printf("        image_craft --batch 'photos/*.bmp' -gs -sharp --out-dir result\n");
+    printf("        echo 'in.bmp out.bmp -blur 2' | image_craft --serve\n\n");
     printf("Доступные фильтры:\n");
-    printf("  -crop <width> <height>       Обрезать изображение\n");
+    printf("  -crop [x y] <width> <height> Обрезать изображение (окно от точки x, y; по умолчанию 0 0)\n");
     printf("  -gs                          Оттенки серого\n");
     printf("  -neg                         Негатив\n");
     printf("  -sharp                       Повышение резкости\n");
     printf("  -edge <threshold>            Выделение границ\n");
     printf("  -med <window_size>           Медианный фильтр\n");
-    printf("  -blur <sigma>                Размытие по Гауссу\n");
+    printf("  -blur <sigma>                Размытие по Гауссу (sigma до 1000)\n");
     printf("  -crystallize <cell_size>     Кристаллизация (дополнительный)\n");
     printf("  -glass <distortion>          Стеклянный эффект (дополнительный)\n");
+    printf("  -conv <WxH:w1,...[/d]|file>  Свертка с ядром пользователя (дополнительный)\n");
+    printf("  -resize <width> <height> [box|bilinear|lanczos]  Изменение размеров (по умолчанию box -\n");
+    printf("                               среднее по площади; сразу после загрузки - при чтении файла)\n\n");
+    printf("Параметры:\n");
+    printf("  --format <f32|rgb8|rgba8|rgb16|planar|gray8|grayf32>  Формат хранения пикселей (по умолчанию f32)\n");
+    printf("                               (rgba8 сохраняет альфа-канал: результат - 32-битный BMP;\n");
+    printf("                               после -gs остальные форматы - один канал, результат - 8-битный серый BMP)\n");
+    printf("  --threads <N>                Число потоков обработки (по умолчанию - по числу ядер)\n");
+    printf("  --stream                     Обработка полосами строк без загрузки изображения целиком\n");
+    printf("                               (только локальные фильтры и обрезка)\n");
+    printf("  --tile <N>                   Сторона плитки для цепочек фильтров (по умолчанию - по кэшу L2, 0 - без плиток)\n");
+    printf("  --out-dir <dir>              Каталог результатов для --batch с шаблоном файлов\n");
+    printf("  --jobs <N>                   Файлов одновременно в --batch и --serve (по умолчанию - по числу ядер)\n");
+    printf("  --socket <path>              Задания --serve через Unix-сокет (по умолчанию - из stdin)\n");
+    printf("                               Строка задания: <input.bmp> <output.bmp> [фильтры...],\n");
+    printf("                               ответ: OK <width>x<height> <мс> или ERROR <описание>\n");
+    printf("  --profile                    Время, память и пропускная способность каждого этапа (отчет в stderr)\n");
+    printf("  --profile-json <file>        То же в файл JSON (включает --profile)\n");
+    printf("  --profile-trace <file>       Трасса этапов для chrome://tracing (включает --profile)\n");
+    printf("  --seed <N>                   Зерно случайных чисел для -crystallize и -glass (по умолчанию 0)\n");
+    printf("  --no-optimize                Без оптимизации пайплайна: фильтры в точности по порядку\n");
+    printf("                               (иначе обрезка переносится вперед, повторный -gs и -neg -neg\n");
+    printf("                               в 8- и 16-битных форматах удаляются; результат тот же)\n");
+    printf("  --merge-blur                 Сливать размытия подряд в одно с sigma = sqrt(s1^2 + s2^2): быстрее,\n");
+    printf("                               но результат меняется (у краев - до десятков уровней из 255)\n");
+    printf("  --blur-method <auto|exact|box|iir>  Способ размытия (по умолчанию auto: точное ядро при sigma < 2,\n");
+    printf("                               иначе каскад box-фильтров; iir - рекурсивный фильтр, без --stream)\n");
+}
+
+// Отчет профилирования в stderr и файлы; освобождает профиль
+static void finish_profile(Profile* profile, const char* json_file, const char* trace_file) {
+    if (!profile) return;
+
+    profile_report(profile, stderr);
+    if (json_file && !profile_write_json(profile, json_file)) {
+        fprintf(stderr, "Ошибка записи профиля: %s\n", json_file);
+    }
+    if (trace_file && !profile_write_trace(profile, trace_file)) {
+        fprintf(stderr, "Ошибка записи трассы: %s\n", trace_file);
+    }
+    profile_free(profile);
 }
 
 int main(int argc, char* argv[]) {
+    // Постоянный режим (--serve) задает файлы и фильтры в заданиях
+    bool serve = argc >= 2 && strcmp(argv[1], "--serve") == 0;
+
     // Проверка минимального количества аргументов
-    if (argc < 3) {
+    if (argc < 3 && !serve) {
         print_help();
         return 0;
     }
 
     // Первые два аргумента - входной и выходной файлы
+    // или --batch и список пар файлов (шаблон файлов)
     char* input_file = argv[1];
     char* output_file = argv[2];
+    bool batch = strcmp(argv[1], "--batch") == 0;
+    const char* batch_source = argv[2];
 
-    // Загрузка исходного BMP-файла
-    BMPImage* bmp = bmp_load(input_file);
-    if (!bmp) {
-        fprintf(stderr, "Ошибка загрузки файла: %s\n", input_file);
-        return 1;
-    }
+    // Пакетный режим: каталог результатов для шаблона и файлов одновременно
+    const char* out_dir = NULL;
+    int jobs = 0;
+
+    // Постоянный режим: адрес Unix-сокета (NULL - задания из stdin)
+    const char* socket_path = NULL;
+
+    // Параметры задания: формат пикселей, способ размытия, зерно и плитки
+    JobOptions options;
+    job_options_init(&options);
+
+    // Число потоков обработки (0 - по числу ядер)
+    int threads = 0;
+
+    // Потоковая обработка полосами (изображение целиком не загружается)
+    bool stream = false;
+
+    // Профилирование этапов и файлы отчета (NULL - только stderr)
+    bool profiling = false;
+    const char* profile_json = NULL;
+    const char* profile_trace = NULL;
 
     // Создание пайплайна фильтров (последовательности обработки)
     Pipeline* pipeline = pipeline_create();
     if (!pipeline) {
         fprintf(stderr, "Ошибка создания пайплайна\n");
-        bmp_free(bmp);
         return 1;
     }
 
     // Парсинг аргументов командной строки (фильтров)
-    // Начинаем с 3-го аргумента (после входного и выходного файлов)
-    for (int i = 3; i < argc; i++) {
-        // Проверяем каждый аргумент и добавляем соответствующий фильтр в пайплайн
-        if (strcmp(argv[i], "-crop") == 0 && i + 2 < argc) {
-            int width = atoi(argv[++i]);   // Следующий аргумент - ширина
-            int height = atoi(argv[++i]);  // Еще следующий - высота
-            pipeline_add_filter(pipeline, FILTER_CROP, width, height, 0);
+    // Начинаем после входного и выходного файлов (в --serve - сразу после режима)
+    for (int i = serve ? 2 : 3; i < argc; i++) {
+        // Фильтры и параметры задания разбираются так же, как строки заданий --serve
+        char error[256];
+        OptionsResult result = options_parse(argc, argv, &i, pipeline, &options, error, sizeof(error));
+        if (result == OPTIONS_INVALID) {
+            fprintf(stderr, "%s\n", error);
+            pipeline_free(pipeline);
+            return 1;
         }
-        else if (strcmp(argv[i], "-gs") == 0) {
-            pipeline_add_filter(pipeline, FILTER_GRAYSCALE, 0, 0, 0);
+        if (result == OPTIONS_PARSED) {
+            continue;
         }
-        else if (strcmp(argv[i], "-neg") == 0) {
-            pipeline_add_filter(pipeline, FILTER_NEGATIVE, 0, 0, 0);
+
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads < 1) {
+                fprintf(stderr, "Число потоков должно быть положительным: %s\n", argv[i]);
+                pipeline_free(pipeline);
+                return 1;
+            }
         }
-        else if (strcmp(argv[i], "-sharp") == 0) {
-            pipeline_add_filter(pipeline, FILTER_SHARPENING, 0, 0, 0);
+        else if (strcmp(argv[i], "--stream") == 0) {
+            stream = true;
         }
-        else if (strcmp(argv[i], "-edge") == 0 && i + 1 < argc) {
-            float threshold = atof(argv[++i]);  // Порог для обнаружения границ
-            pipeline_add_filter(pipeline, FILTER_EDGE_DETECTION, 0, 0, threshold);
+        else if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc) {
+            out_dir = argv[++i];
         }
-        else if (strcmp(argv[i], "-med") == 0 && i + 1 < argc) {
-            int window = atoi(argv[++i]);  // Размер окна медианного фильтра
-            pipeline_add_filter(pipeline, FILTER_MEDIAN, window, 0, 0);
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+            if (jobs < 1) {
+                fprintf(stderr, "Число файлов одновременно должно быть положительным: %s\n", argv[i]);
+                pipeline_free(pipeline);
+                return 1;
+            }
         }
-        else if (strcmp(argv[i], "-blur") == 0 && i + 1 < argc) {
-            float sigma = atof(argv[++i]);  // Сигма для Гауссова размытия
-            pipeline_add_filter(pipeline, FILTER_GAUSSIAN_BLUR, 0, 0, sigma);
+        else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
         }
-        else if (strcmp(argv[i], "-crystallize") == 0 && i + 1 < argc) {
-            int cell_size = atoi(argv[++i]);  // Размер ячейки кристаллизации
-            pipeline_add_filter(pipeline, FILTER_CRYSTALLIZE, cell_size, 0, 0);
+        else if (strcmp(argv[i], "--profile") == 0) {
+            profiling = true;
         }
-        else if (strcmp(argv[i], "-glass") == 0 && i + 1 < argc) {
-            float distortion = atof(argv[++i]);  // Уровень искажения стеклянного эффекта
-            pipeline_add_filter(pipeline, FILTER_GLASS, 0, 0, distortion);
+        else if (strcmp(argv[i], "--profile-json") == 0 && i + 1 < argc) {
+            profiling = true;
+            profile_json = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile-trace") == 0 && i + 1 < argc) {
+            profiling = true;
+            profile_trace = argv[++i];
         }
         else {
             fprintf(stderr, "Неизвестный фильтр или неверные параметры: %s\n", argv[i]);
             pipeline_free(pipeline);
-            bmp_free(bmp);
             return 1;
         }
     }
 
+    // Параметры могут стоять после фильтров, поэтому применяются к готовому пайплайну
+    options_apply(pipeline, &options);
+    PixelFormat format = options.format;
+
+    if (serve && (stream || pipeline->count > 0)) {
+        fprintf(stderr, "В режиме --serve фильтры задаются в строках заданий, --stream не поддерживается\n");
+        pipeline_free(pipeline);
+        return 1;
+    }
+    if (batch && stream) {
+        fprintf(stderr, "Пакетный режим не совмещается с --stream\n");
+        pipeline_free(pipeline);
+        return 1;
+    }
+    if (stream && !stream_is_supported(pipeline)) {
+        fprintf(stderr, "Потоковый режим поддерживает только локальные фильтры и обрезку\n");
+        pipeline_free(pipeline);
+        return 1;
+    }
+
+    // Профиль принадлежит main, пайплайн только пишет в него
+    Profile* profile = NULL;
+    if (profiling) {
+        profile = profile_create();
+        if (!profile) {
+            fprintf(stderr, "Ошибка создания профиля\n");
+            pipeline_free(pipeline);
+            return 1;
+        }
+        pipeline->profile = profile;
+    }
+    ProfileMark mark;
+
+    // Постоянный режим: пул потоков, кэши ядер и буферы изображений
+    // сохраняются между заданиями до конца ввода или сигнала остановки
+    if (serve) {
+        ServeConfig config = {options, jobs, profile};
+        threadpool_init(threads);
+        bool ok = socket_path ? serve_socket(socket_path, &config) : serve_stdin(&config);
+        threadpool_shutdown();
+        filter_release_caches();
+        pipeline_free(pipeline);
+        finish_profile(profile, profile_json, profile_trace);
+        return ok ? 0 : 1;
+    }
+
+    // Пакетный режим: пайплайн разобран один раз и применяется ко всем файлам
+    if (batch) {
+        BatchList* list = NULL;
+        if (!batch_is_pattern(batch_source)) {
+            list = batch_list_load(batch_source);
+        } else if (out_dir) {
+            list = batch_list_glob(batch_source, out_dir);
+        } else {
+            fprintf(stderr, "Для шаблона файлов нужен каталог результатов --out-dir\n");
+        }
+        if (!list) {
+            fprintf(stderr, "Ошибка чтения списка файлов: %s\n", batch_source);
+            pipeline_free(pipeline);
+            profile_free(profile);
+            return 1;
+        }
+
+        // Начальные обрезка и изменение размеров выполняются при чтении каждого файла
+        PipelineSource source;
+        pipeline_take_source(pipeline, format, &source);
+        threadpool_init(threads);
+        int failed = batch_process(pipeline, &source, list, format, jobs);
+        threadpool_shutdown();
+        pipeline_free(pipeline);
+        finish_profile(profile, profile_json, profile_trace);
+
+        printf("Обработано файлов: %d из %d\n", list->count - failed, list->count);
+        batch_list_free(list);
+        return failed ? 1 : 0;
+    }
+
+    // Потоковый режим: чтение, фильтры и запись идут полосами строк
+    if (stream) {
+        threadpool_init(threads);
+        bool ok = stream_process(pipeline, input_file, output_file, format);
+        threadpool_shutdown();
+        pipeline_free(pipeline);
+        finish_profile(profile, profile_json, profile_trace);
+
+        if (!ok) {
+            fprintf(stderr, "Ошибка потоковой обработки: %s -> %s\n", input_file, output_file);
+            return 1;
+        }
+        printf("Обработка завершена успешно!\n");
+        return 0;
+    }
+
+    // Пайплайн начинается с обрезки, оттенков серого или изменения размеров:
+    // они выполняются при чтении, а файл читается и пишется блоками строк, как в --batch
+    PipelineSource source;
+    if (pipeline_take_source(pipeline, format, &source)) {
+        threadpool_init(threads);
+        Image* image = image_create_empty();
+        Image* spare = image_create_empty();
+        bool ok = image && spare &&
+                  batch_process_file(pipeline, &source, input_file, output_file, format, &image, &spare);
+        image_free(image);
+        image_free(spare);
+        threadpool_shutdown();
+        pipeline_free(pipeline);
+        finish_profile(profile, profile_json, profile_trace);
+
+        if (!ok) {
+            fprintf(stderr, "Ошибка обработки: %s -> %s\n", input_file, output_file);
+            return 1;
+        }
+        printf("Обработка завершена успешно!\n");
+        return 0;
+    }
+
+    // Загрузка исходного BMP-файла сразу в нужном формате
+    if (profile) {
+        profile_begin(&mark, NULL, NULL);
+    }
+    BMPImage* bmp = bmp_load_mapped(input_file, format);
+    if (!bmp) {
+        fprintf(stderr, "Ошибка загрузки файла: %s\n", input_file);
+        pipeline_free(pipeline);
+        finish_profile(profile, profile_json, profile_trace);
+        return 1;
+    }
+    if (profile) {
+        profile_end(profile, &mark, "load", bmp->image, NULL);
+    }
+
+    // Запуск пула потоков для фильтров
+    threadpool_init(threads);
+
     // Применение всех фильтров пайплайна к изображению
-    Image* processed_image = pipeline_apply(pipeline, bmp->image);
+    // Пайплайн забирает загруженное изображение и работает в его буфере
+    Image* processed_image = pipeline_run(pipeline, bmp->image);
+    bmp->image = NULL;
     if (!processed_image) {
         fprintf(stderr, "Ошибка применения фильтров\n");
+        threadpool_shutdown();
         pipeline_free(pipeline);
+        finish_profile(profile, profile_json, profile_trace);
         bmp_free(bmp);
         return 1;
     }
 
     // Обновление изображения в структуре BMP
-    // Освобождаем старое изображение и заменяем обработанным
-    free(bmp->image->data);
-    free(bmp->image);
     bmp->image = processed_image;
     
     // Обновление размеров в заголовке BMP
@@ -115,9 +334,18 @@ int main(int argc, char* argv[]) {
     bmp->info_header.height = -processed_image->height;  // Отрицательная высота для top-down
 
     // Сохранение результата в файл
-    if (!bmp_save(bmp, output_file)) {
+    if (profile) {
+        profile_begin(&mark, processed_image, NULL);
+    }
+    bool saved = bmp_save(bmp, output_file);
+    if (profile) {
+        profile_end(profile, &mark, "save", processed_image, NULL);
+    }
+    if (!saved) {
         fprintf(stderr, "Ошибка сохранения файла: %s\n", output_file);
+        threadpool_shutdown();
         pipeline_free(pipeline);
+        finish_profile(profile, profile_json, profile_trace);
         bmp_free(bmp);
         return 1;
     }
@@ -125,7 +353,9 @@ int main(int argc, char* argv[]) {
     printf("Обработка завершена успешно!\n");
 
     // Освобождение всех ресурсов
+    threadpool_shutdown();
     pipeline_free(pipeline);
+    finish_profile(profile, profile_json, profile_trace);
     bmp_free(bmp);
 
     return 0;
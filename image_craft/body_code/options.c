@@ -0,0 +1,172 @@
+#include "options.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Неотрицательное целое без знака и лишних символов
+static bool options_is_count(const char* arg) {
+    if (*arg == '\0') return false;
+    for (; *arg; arg++) {
+        if (*arg < '0' || *arg > '9') return false;
+    }
+    return true;
+}
+
+void job_options_init(JobOptions* options) {
+    options->format = PIXEL_FORMAT_RGB_F32;
+    options->blur_method = BLUR_METHOD_AUTO;
+    options->seed = 0;
+    options->tile_size = 0;
+    options->optimize = true;
+    options->merge_blurs = false;
+}
+
+OptionsResult options_parse(int argc, char* argv[], int* index, Pipeline* pipeline,
+                            JobOptions* options, char* error, size_t error_size) {
+    int i = *index;
+    const char* arg = argv[i];
+    bool has_value = i + 1 < argc;
+
+    // Проверяем аргумент и добавляем соответствующий фильтр в пайплайн
+    if (strcmp(arg, "-crop") == 0 && i + 4 < argc &&
+        options_is_count(argv[i + 3]) && options_is_count(argv[i + 4])) {
+        // Окно с произвольным углом: -crop x y ширина высота
+        int x = atoi(argv[++i]);
+        int y = atoi(argv[++i]);
+        int width = atoi(argv[++i]);
+        int height = atoi(argv[++i]);
+        if (x < 0 || y < 0) {
+            snprintf(error, error_size, "Угол окна обрезки не может быть отрицательным: %d %d", x, y);
+            return OPTIONS_INVALID;
+        }
+        Filter filter = {FILTER_CROP, width, height, 0, x, y, NULL};
+        pipeline_add(pipeline, &filter);
+    }
+    else if (strcmp(arg, "-crop") == 0 && i + 2 < argc) {
+        int width = atoi(argv[++i]);   // Следующий аргумент - ширина
+        int height = atoi(argv[++i]);  // Еще следующий - высота
+        pipeline_add_filter(pipeline, FILTER_CROP, width, height, 0);
+    }
+    else if (strcmp(arg, "-gs") == 0) {
+        pipeline_add_filter(pipeline, FILTER_GRAYSCALE, 0, 0, 0);
+    }
+    else if (strcmp(arg, "-neg") == 0) {
+        pipeline_add_filter(pipeline, FILTER_NEGATIVE, 0, 0, 0);
+    }
+    else if (strcmp(arg, "-sharp") == 0) {
+        pipeline_add_filter(pipeline, FILTER_SHARPENING, 0, 0, 0);
+    }
+    else if (strcmp(arg, "-edge") == 0 && has_value) {
+        float threshold = atof(argv[++i]);  // Порог для обнаружения границ
+        pipeline_add_filter(pipeline, FILTER_EDGE_DETECTION, 0, 0, threshold);
+    }
+    else if (strcmp(arg, "-med") == 0 && has_value) {
+        int window = atoi(argv[++i]);  // Размер окна медианного фильтра
+        pipeline_add_filter(pipeline, FILTER_MEDIAN, window, 0, 0);
+    }
+    else if (strcmp(arg, "-blur") == 0 && has_value) {
+        float sigma = atof(argv[++i]);  // Сигма для Гауссова размытия
+        if (!isfinite(sigma) || sigma > BLUR_MAX_SIGMA) {
+            snprintf(error, error_size, "Некорректная sigma размытия: %s (допустимо до %g)", argv[i], BLUR_MAX_SIGMA);
+            return OPTIONS_INVALID;
+        }
+        pipeline_add_filter(pipeline, FILTER_GAUSSIAN_BLUR, 0, 0, sigma);
+    }
+    else if (strcmp(arg, "-crystallize") == 0 && has_value) {
+        int cell_size = atoi(argv[++i]);  // Размер ячейки кристаллизации
+        pipeline_add_filter(pipeline, FILTER_CRYSTALLIZE, cell_size, 0, 0);
+    }
+    else if (strcmp(arg, "-glass") == 0 && has_value) {
+        float distortion = atof(argv[++i]);  // Уровень искажения стеклянного эффекта
+        pipeline_add_filter(pipeline, FILTER_GLASS, 0, 0, distortion);
+    }
+    else if (strcmp(arg, "-resize") == 0 && i + 2 < argc) {
+        // Новые размеры и необязательный способ (по умолчанию - среднее по площади)
+        int width = atoi(argv[++i]);
+        int height = atoi(argv[++i]);
+        ResizeMethod method = RESIZE_METHOD_BOX;
+        if (i + 1 < argc && resize_method_parse(argv[i + 1], &method)) {
+            i++;
+        }
+        if (width <= 0 || height <= 0) {
+            snprintf(error, error_size, "Некорректные размеры: %d %d", width, height);
+            return OPTIONS_INVALID;
+        }
+        Filter filter = {FILTER_RESIZE, width, height, 0, method, 0, NULL};
+        pipeline_add(pipeline, &filter);
+    }
+    else if (strcmp(arg, "-conv") == 0 && has_value) {
+        // Ядро свертки: "WxH:w1,w2,...[/d]" или файл с построчной матрицей
+        ConvKernel* kernel = conv_kernel_parse(argv[++i]);
+        Filter filter = {FILTER_CONVOLUTION, 0, 0, 0, 0, 0, kernel};
+        bool added = kernel && pipeline_add(pipeline, &filter);
+        conv_kernel_free(kernel);
+        if (!added) {
+            snprintf(error, error_size, "Некорректное ядро свертки: %s", argv[i]);
+            return OPTIONS_INVALID;
+        }
+    }
+    else if (strcmp(arg, "--format") == 0 && has_value) {
+        // Формат пикселей: компактные форматы экономят память
+        if (!pixel_format_parse(argv[++i], &options->format)) {
+            snprintf(error, error_size, "Неизвестный формат пикселей: %s", argv[i]);
+            return OPTIONS_INVALID;
+        }
+    }
+    else if (strcmp(arg, "--tile") == 0 && has_value) {
+        // Сторона плитки для цепочек локальных фильтров (0 - без плиток)
+        int tile = atoi(argv[++i]);
+        if (tile < 0) {
+            snprintf(error, error_size, "Размер плитки не может быть отрицательным: %s", argv[i]);
+            return OPTIONS_INVALID;
+        }
+        options->tile_size = (tile > 0) ? tile : -1;
+    }
+    else if (strcmp(arg, "--seed") == 0 && has_value) {
+        char* end;
+        unsigned long seed = strtoul(argv[++i], &end, 10);
+        if (*end != '\0' || end == argv[i] || seed > 0xffffffffUL) {
+            snprintf(error, error_size, "Некорректное зерно: %s", argv[i]);
+            return OPTIONS_INVALID;
+        }
+        options->seed = (uint32_t)seed;
+    }
+    else if (strcmp(arg, "--no-optimize") == 0) {
+        // Фильтры выполняются в точности в порядке командной строки
+        options->optimize = false;
+    }
+    else if (strcmp(arg, "--merge-blur") == 0) {
+        // Соседние размытия сливаются в одно, результат меняется (см. pipeline.h)
+        options->merge_blurs = true;
+    }
+    else if (strcmp(arg, "--blur-method") == 0 && has_value) {
+        if (!blur_method_parse(argv[++i], &options->blur_method)) {
+            snprintf(error, error_size, "Неизвестный способ размытия: %s", argv[i]);
+            return OPTIONS_INVALID;
+        }
+    }
+    else {
+        return OPTIONS_UNKNOWN;
+    }
+
+    *index = i;
+    return OPTIONS_PARSED;
+}
+
+void options_apply(Pipeline* pipeline, const JobOptions* options) {
+    for (PipelineNode* node = pipeline->head; node; node = node->next) {
+        if (node->filter.type == FILTER_GAUSSIAN_BLUR) {
+            node->filter.param1 = options->blur_method;
+        }
+        if (node->filter.type == FILTER_CRYSTALLIZE || node->filter.type == FILTER_GLASS) {
+            node->filter.param2 = (int)options->seed;
+        }
+    }
+    if (options->tile_size != 0) {
+        pipeline->tile_size = options->tile_size;
+    }
+    if (options->optimize) {
+        pipeline_optimize(pipeline, options->format, options->merge_blurs);
+    }
+}
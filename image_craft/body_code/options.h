@@ -0,0 +1,38 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include "pipeline.h"
+#include <stddef.h>
+
+// Разбор фильтров и параметров задания
+// Одни и те же правила для командной строки и строк заданий --serve
+
+// Параметры задания, которые действуют на весь пайплайн
+typedef struct {
+    PixelFormat format;        // Формат хранения пикселей
+    BlurMethod blur_method;    // Способ размытия для всех -blur
+    uint32_t seed;             // Зерно для -crystallize и -glass
+    int tile_size;             // Сторона плитки (0 - по умолчанию, < 0 - без плиток)
+    bool optimize;             // Оптимизировать пайплайн перед выполнением
+    bool merge_blurs;          // Сливать соседние размытия при оптимизации (--merge-blur)
+} JobOptions;
+
+typedef enum {
+    OPTIONS_PARSED,            // Фильтр или параметр задания разобран
+    OPTIONS_UNKNOWN,           // Аргумент не относится к заданию
+    OPTIONS_INVALID            // Неверное значение, описание в error
+} OptionsResult;
+
+void job_options_init(JobOptions* options);
+
+// Разбирает argv[*index] и его значения: фильтр добавляется в пайплайн,
+// параметр - в options. После разбора *index указывает на последний
+// использованный аргумент
+OptionsResult options_parse(int argc, char* argv[], int* index, Pipeline* pipeline,
+                            JobOptions* options, char* error, size_t error_size);
+
+// Применяет параметры к готовому пайплайну (они могут стоять после фильтров)
+// и, если не задан --no-optimize, оптимизирует его
+void options_apply(Pipeline* pipeline, const JobOptions* options);
+
+#endif // OPTIONS_H
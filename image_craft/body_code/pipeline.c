@@ -1,6 +1,12 @@
 // pipeline.c
+#define _POSIX_C_SOURCE 200112L
 #include "pipeline.h"
+#include "threadpool.h"
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 //СОЗДАНИЕ И УДАЛЕНИЕ ПАЙПЛАЙНА
 
 //*создает новый пайплайн фильтров
@@ -13,6 +19,8 @@ Pipeline* pipeline_create(void) {
     pipeline->head = NULL;
     pipeline->tail = NULL;
     pipeline->count = 0;
+    pipeline->tile_size = 0;
+    pipeline->profile = NULL;
     
     return pipeline;
 }
@@ -23,6 +31,7 @@ void pipeline_free(Pipeline* pipeline) {
     PipelineNode* current = pipeline->head;
     while (current) {
         PipelineNode* next = current->next;
+        conv_kernel_free(current->kernel);
         free(current);
         current = next;
     }
@@ -34,16 +43,29 @@ void pipeline_free(Pipeline* pipeline) {
 
 //*добавление фильтра в конец пайплайна
 void pipeline_add_filter(Pipeline* pipeline, FilterType type, int param1, int param2, float param3) {
-    if (!pipeline) return;
+    Filter filter = {type, param1, param2, param3, 0, 0, NULL};
+    pipeline_add(pipeline, &filter);
+}
+
+//*добавление фильтра с параметрами; ядро свертки копируется в узел
+//*false при нехватке памяти
+bool pipeline_add(Pipeline* pipeline, const Filter* filter) {
+    if (!pipeline) return false;
     
     PipelineNode* node = (PipelineNode*)malloc(sizeof(PipelineNode));
-    if (!node) return;
+    if (!node) return false;
     
-    node->filter.type = type;
-    node->filter.param1 = param1;
-    node->filter.param2 = param2;
-    node->filter.param3 = param3;
+    node->filter = *filter;
+    node->kernel = NULL;
     node->next = NULL;
+    if (filter->kernel) {
+        node->kernel = conv_kernel_clone(filter->kernel);
+        if (!node->kernel) {
+            free(node);
+            return false;
+        }
+        node->filter.kernel = node->kernel;
+    }
     
     if (!pipeline->head) {
         pipeline->head = node;
@@ -54,29 +76,652 @@ void pipeline_add_filter(Pipeline* pipeline, FilterType type, int param1, int pa
     }
     
     pipeline->count++;
+    return true;
+}
+
+//ОПТИМИЗАЦИЯ ПАЙПЛАЙНА
+
+//*удаляет узел node, следующий за prev (prev == NULL - первый узел)
+static void pipeline_remove(Pipeline* pipeline, PipelineNode* prev, PipelineNode* node) {
+    if (prev) {
+        prev->next = node->next;
+    } else {
+        pipeline->head = node->next;
+    }
+    if (pipeline->tail == node) {
+        pipeline->tail = prev;
+    }
+    pipeline->count--;
+    conv_kernel_free(node->kernel);
+    free(node);
+}
+
+//*вставляет фильтр без ядра после prev (prev == NULL - в начало)
+static bool pipeline_insert(Pipeline* pipeline, PipelineNode* prev, const Filter* filter) {
+    PipelineNode* node = (PipelineNode*)malloc(sizeof(PipelineNode));
+    if (!node) return false;
+
+    node->filter = *filter;
+    node->kernel = NULL;
+    node->next = prev ? prev->next : pipeline->head;
+    if (prev) {
+        prev->next = node;
+    } else {
+        pipeline->head = node;
+    }
+    if (pipeline->tail == prev) {
+        pipeline->tail = node;
+    }
+    pipeline->count++;
+    return true;
+}
+
+//*обрезка с положительными размерами и углом в изображении
+//*(иные не переставляются и не сливаются)
+static bool pipeline_is_crop(const PipelineNode* node) {
+    return node && node->filter.type == FILTER_CROP && node->filter.param1 > 0 && node->filter.param2 > 0 &&
+           node->filter.param4 >= 0 && node->filter.param5 >= 0;
+}
+
+//*сумма с насыщением (размеры обрезки с ореолом не переполняются)
+static int pipeline_add_halo(int size, int halo) {
+    return (size > INT_MAX - halo) ? INT_MAX : size + halo;
+}
+
+//*две обрезки подряд - одно окно: угол второй отсчитывается от угла первой
+//*false, если угол второго окна лежит за пределами первого
+static bool pipeline_merge_crops(const Filter* first, const Filter* second, Filter* merged) {
+    if (second->param4 >= first->param1 || second->param5 >= first->param2) {
+        return false;
+    }
+    *merged = *first;
+    merged->param4 = pipeline_add_halo(first->param4, second->param4);
+    merged->param5 = pipeline_add_halo(first->param5, second->param5);
+    merged->param1 = (second->param1 < first->param1 - second->param4) ? second->param1
+                                                                        : first->param1 - second->param4;
+    merged->param2 = (second->param2 < first->param2 - second->param5) ? second->param2
+                                                                        : first->param2 - second->param5;
+    return true;
+}
+
+//*форматы с целыми каналами: в них негатив негатива в точности равен исходному
+//*(во float 1 - (1 - v) может отличаться от v и изменить округление результата)
+static bool pipeline_format_exact(PixelFormat format) {
+    return format == PIXEL_FORMAT_RGB8 || format == PIXEL_FORMAT_RGBA8 ||
+           format == PIXEL_FORMAT_RGB16 || format == PIXEL_FORMAT_GRAY8;
+}
+
+//*сокращает соседние фильтры: пара негативов в целочисленном формате взаимно
+//*уничтожается, повторные оттенки серого и размытие с sigma <= 0 ничего не
+//*меняют, две обрезки - одно окно, а при merge_blurs два размытия подряд -
+//*одно с sigma = sqrt(s1^2 + s2^2). format - формат пикселей перед первым
+//*фильтром; после оттенков серого изображение уже серое (одноканальное или
+//*RGBA8 с r = g = b, для которых целочисленная формула яркости дает то же
+//*значение), поэтому повторные оттенки серого удаляются в любом формате
+static bool pipeline_simplify(Pipeline* pipeline, PixelFormat format, bool merge_blurs) {
+    bool changed = false;
+    PipelineNode* prev = NULL;
+    PipelineNode* node = pipeline->head;
+    while (node) {
+        Filter* filter = &node->filter;
+        PipelineNode* next = node->next;
+        FilterType next_type = next ? next->filter.type : filter->type;
+
+        if (filter->type == FILTER_GAUSSIAN_BLUR && filter->param3 <= 0) {
+            pipeline_remove(pipeline, prev, node);
+            node = next;
+        } else if (!next) {
+            break;
+        } else if (filter->type == FILTER_NEGATIVE && next_type == FILTER_NEGATIVE &&
+                   pipeline_format_exact(format)) {
+            PipelineNode* after = next->next;
+            pipeline_remove(pipeline, node, next);
+            pipeline_remove(pipeline, prev, node);
+            node = after;
+        } else if (filter->type == FILTER_GRAYSCALE && next_type == FILTER_GRAYSCALE) {
+            pipeline_remove(pipeline, node, next);
+        } else if (merge_blurs && filter->type == FILTER_GAUSSIAN_BLUR &&
+                   next_type == FILTER_GAUSSIAN_BLUR && next->filter.param3 > 0 &&
+                   filter->param1 == next->filter.param1 &&
+                   sqrtf(filter->param3 * filter->param3 + next->filter.param3 * next->filter.param3) <=
+                       BLUR_MAX_SIGMA) {
+            // Свертка двух Гауссиан - Гауссиана с суммой дисперсий (приближенно, см. pipeline.h)
+            float sigma = next->filter.param3;
+            filter->param3 = sqrtf(filter->param3 * filter->param3 + sigma * sigma);
+            pipeline_remove(pipeline, node, next);
+        } else if (pipeline_is_crop(node) && pipeline_is_crop(next) &&
+                   pipeline_merge_crops(filter, &next->filter, filter)) {
+            pipeline_remove(pipeline, node, next);
+        } else {
+            if (filter->type == FILTER_GRAYSCALE) {
+                format = pixel_format_gray(format);
+            }
+            prev = node;
+            node = next;
+            continue;
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+//*переносит обрезку вперед через участок локальных фильтров перед ней:
+//*участок обрабатывает окно, расширенное на суммарный ореол его фильтров
+//*(у краев изображения - сколько есть), а исходная обрезка отрезает ореол
+//*в конце (при нулевом ореоле она не нужна). Фильтры портят у краев окна
+//*полосу не шире ореола, поэтому результат тот же, что и без переноса
+static bool pipeline_push_crops(Pipeline* pipeline) {
+    bool changed = false;
+    PipelineNode* bound = NULL;   // узел перед участком (NULL - начало пайплайна)
+    int halo = 0;                 // суммарный ореол участка
+    PipelineNode* prev = NULL;
+    PipelineNode* node = pipeline->head;
+    while (node) {
+        PipelineNode* next = node->next;
+        int node_halo = filter_halo(&node->filter);
+
+        if (pipeline_is_crop(node) && prev != bound) {
+            // Окно, нужное участку: обрезка с ореолом со всех сторон
+            Filter* filter = &node->filter;
+            int x = (filter->param4 > halo) ? filter->param4 - halo : 0;
+            int y = (filter->param5 > halo) ? filter->param5 - halo : 0;
+            Filter needed = {FILTER_CROP,
+                             pipeline_add_halo(pipeline_add_halo(filter->param1, filter->param4 - x), halo),
+                             pipeline_add_halo(pipeline_add_halo(filter->param2, filter->param5 - y), halo),
+                             0, x, y, NULL};
+
+            bool bounded = false;
+            if (pipeline_is_crop(bound)) {
+                // Перед участком уже есть обрезка: ее окно лишь уменьшается
+                Filter merged;
+                bounded = pipeline_merge_crops(&bound->filter, &needed, &merged);
+                if (bounded && (merged.param1 != bound->filter.param1 || merged.param2 != bound->filter.param2 ||
+                                merged.param4 != bound->filter.param4 || merged.param5 != bound->filter.param5)) {
+                    bound->filter = merged;
+                    changed = true;
+                }
+            } else {
+                bounded = pipeline_insert(pipeline, bound, &needed);
+                if (bounded) {
+                    bound = bound ? bound->next : pipeline->head;
+                    changed = true;
+                }
+            }
+
+            if (bounded) {
+                // Угол исходной обрезки теперь отсчитывается от нового окна
+                if (x > 0 || y > 0) {
+                    filter->param4 -= x;
+                    filter->param5 -= y;
+                    changed = true;
+                }
+                if (halo == 0) {
+                    pipeline_remove(pipeline, prev, node);
+                    changed = true;
+                    node = next;
+                    continue;
+                }
+            }
+        }
+
+        if (node_halo < 0) {
+            // Фильтр меняет размеры или нелокален: новый участок начинается после него
+            bound = node;
+            halo = 0;
+        } else {
+            halo = pipeline_add_halo(halo, node_halo);
+        }
+        prev = node;
+        node = next;
+    }
+    return changed;
+}
+
+//*переставляет и сокращает фильтры до выполнения (см. pipeline.h)
+void pipeline_optimize(Pipeline* pipeline, PixelFormat format, bool merge_blurs) {
+    if (!pipeline) return;
+
+    bool changed = true;
+    while (changed) {
+        changed = pipeline_simplify(pipeline, format, merge_blurs);
+        if (pipeline_push_crops(pipeline)) {
+            changed = true;
+        }
+    }
+}
+
+//*снимает обрезку и изменение размеров с начала пайплайна (см. pipeline.h)
+//*изменение размеров снимается, только если его размеры допустимы, -
+//*иначе ошибка остается за фильтром
+bool pipeline_take_source(Pipeline* pipeline, PixelFormat format, PipelineSource* source) {
+    source->cropped = false;
+    source->gray = false;
+    source->resized = false;
+
+    PipelineNode* head = pipeline ? pipeline->head : NULL;
+    if (head && head->filter.type == FILTER_CROP) {
+        source->cropped = true;
+        source->region.x = head->filter.param4;
+        source->region.y = head->filter.param5;
+        source->region.width = head->filter.param1;
+        source->region.height = head->filter.param2;
+        pipeline_remove(pipeline, NULL, head);
+        head = pipeline->head;
+    }
+    if (head && head->filter.type == FILTER_GRAYSCALE && pixel_format_gray(format) != format) {
+        source->gray = true;
+        pipeline_remove(pipeline, NULL, head);
+        head = pipeline->head;
+    }
+    if (head && head->filter.type == FILTER_RESIZE && head->filter.param1 > 0 && head->filter.param2 > 0) {
+        source->resized = true;
+        source->resize = head->filter;
+        pipeline_remove(pipeline, NULL, head);
+    }
+    return source->cropped || source->gray || source->resized;
+}
+
+//*оттенки серого переводят изображение в одноканальный формат
+PixelFormat pipeline_output_format(const Pipeline* pipeline, PixelFormat format) {
+    for (const PipelineNode* node = pipeline->head; node; node = node->next) {
+        if (node->filter.type == FILTER_GRAYSCALE) {
+            format = pixel_format_gray(format);
+        }
+    }
+    return format;
 }
 
 //ПРИМЕНЕНИЕ ПАЙПЛАЙНА К ИЗОБРАЖЕНИЮ
-//*применяет все фильтры к изображению 
-Image* pipeline_apply(Pipeline* pipeline, const Image* image) {
-    if (!pipeline || !image) return NULL;
-    
-    Image* current = image_clone(image);
-    if (!current) return NULL;
+
+//*переводит текущее изображение в другой формат через запасной буфер
+//*альфа-канал RGBA8 на время перевода во float сохраняется отдельно в alpha
+//*и освобождается, когда возвращен: следующий участок во float сохранит
+//*альфа-канал заново (фильтры RGBA8 между участками могли его изменить)
+static bool pipeline_convert(Image** current, Image** spare, PixelFormat format, uint8_t** alpha) {
+    Image* image = *current;
+    size_t count = (size_t)image->width * image->height;
+
+    if (image->format == PIXEL_FORMAT_RGBA8 && !*alpha) {
+        *alpha = (uint8_t*)malloc(count);
+        if (*alpha) {
+            for (size_t i = 0; i < count; i++) {
+                (*alpha)[i] = image->pixels[4 * i + 3];
+            }
+        }
+    }
+
+    Image* converted = *spare;
+    if (!image_convert_into(image, converted, format)) {
+        return false;
+    }
+
+    // Альфа возвращается, только если размеры изображения не менялись
+    if (format == PIXEL_FORMAT_RGBA8 && *alpha) {
+        for (size_t i = 0; i < count; i++) {
+            converted->pixels[4 * i + 3] = (*alpha)[i];
+        }
+        free(*alpha);
+        *alpha = NULL;
+    }
+
+    *current = converted;
+    *spare = image;
+    return true;
+}
+
+//*выполняет серию из count поэлементных фильтров, начиная с node, за один проход
+static bool pipeline_apply_point_run(const PipelineNode* node, int count, Image** current, Image** spare) {
+    Filter* filters = (Filter*)malloc(count * sizeof(Filter));
+    if (!filters) return false;
+
+    for (int i = 0; i < count; i++, node = node->next) {
+        filters[i] = node->filter;
+    }
+
+    bool ok = filter_apply_point_chain(filters, count, current, spare);
+    free(filters);
+    return ok;
+}
+
+//ВЫПОЛНЕНИЕ ПЛИТКАМИ
+
+//*размер кэша L2 по умолчанию, если система его не сообщает
+#define PIPELINE_DEFAULT_L2 (1024 * 1024)
+
+//*наименьшая сторона плитки: меньшие плитки тратят больше времени на ореол, чем выигрывают
+#define PIPELINE_MIN_TILE 32
+
+//*участок пайплайна из локальных фильтров выполняется плитками: плитка
+//*вместе с ореолом всех фильтров участка проходит через все фильтры, пока
+//*она в кэше; фильтры считают плитку целым изображением, поэтому на ее
+//*внутренних краях каждый фильтр портит полосу шириной в свой ореол,
+//*а к концу участка остается верной ровно сама плитка
+typedef struct {
+    const PipelineNode* first;  // Первый фильтр участка
+    int count;                  // Фильтров в участке
+    int halo;                   // Суммарный ореол участка
+    int tile;                   // Сторона плитки
+    int tiles_x;                // Плиток в ряду
+    const Image* src;
+    Image* dst;
+    bool ok;                    // Сбрасывается при ошибке в любой плитке
+} PipelineTileJob;
+
+//*обрабатывает плитки [tile_begin, tile_end) (номера по строкам плиток)
+static void pipeline_tile_rows(void* context, int tile_begin, int tile_end) {
+    PipelineTileJob* job = (PipelineTileJob*)context;
+    const Image* src = job->src;
+
+    // Буферы плитки - свои у каждой полосы, переиспользуются от плитки к плитке
+    Image* tile = image_create_empty();
+    Image* spare = image_create_empty();
+    if (!tile || !spare) {
+        image_free(tile);
+        image_free(spare);
+        job->ok = false;
+        return;
+    }
+
+    for (int t = tile_begin; t < tile_end; t++) {
+        int x0 = (t % job->tiles_x) * job->tile;
+        int y0 = (t / job->tiles_x) * job->tile;
+        int x1 = (x0 + job->tile < src->width) ? x0 + job->tile : src->width;
+        int y1 = (y0 + job->tile < src->height) ? y0 + job->tile : src->height;
+
+        // Плитка с ореолом, обрезанным по краям изображения
+        int ex0 = (x0 - job->halo > 0) ? x0 - job->halo : 0;
+        int ey0 = (y0 - job->halo > 0) ? y0 - job->halo : 0;
+        int ex1 = (x1 + job->halo < src->width) ? x1 + job->halo : src->width;
+        int ey1 = (y1 + job->halo < src->height) ? y1 + job->halo : src->height;
+
+        if (!image_reshape(tile, ex1 - ex0, ey1 - ey0, src->format)) {
+            job->ok = false;
+            break;
+        }
+        image_copy_region(src, ex0, ey0, tile, 0, 0, ex1 - ex0, ey1 - ey0);
+
+        const PipelineNode* node = job->first;
+        for (int i = 0; i < job->count; i++, node = node->next) {
+            if (!filter_apply_buffered(&node->filter, &tile, &spare)) {
+                job->ok = false;
+                break;
+            }
+        }
+        if (!job->ok) break;
+
+        image_copy_region(tile, x0 - ex0, y0 - ey0, job->dst, x0, y0, x1 - x0, y1 - y0);
+    }
+
+    image_free(tile);
+    image_free(spare);
+}
+
+//*сторона плитки для участка с ореолом halo: плитка с ореолом и запасной
+//*буфер помещаются в L2; 0 - плитки не выгодны (ореол слишком велик)
+static int pipeline_tile_size(const Pipeline* pipeline, const Image* image, int halo) {
+    if (pipeline->tile_size < 0) return 0;
+
+    int tile = pipeline->tile_size;
+    if (tile == 0) {
+        long cache = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+        cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        if (cache <= 0) cache = PIPELINE_DEFAULT_L2;
+
+        size_t pixel_size = pixel_format_size(image->format);
+        int extended = (int)sqrt((double)cache / (2.0 * pixel_size));
+        tile = extended - 2 * halo;
+        if (tile < PIPELINE_MIN_TILE || tile < 2 * halo) return 0;
+    }
+
+    // Изображение целиком помещается в одну плитку - разбивать нечего
+    if (image->width <= tile && image->height <= tile) return 0;
+    return tile;
+}
+
+//*длина участка из локальных фильтров, начиная с node, в текущем формате
+//*halo - суммарный ореол участка; участок без фильтров окрестности не нужен
+//*оттенки серого, меняющие формат, заканчивают участок: плитки одного формата
+static int pipeline_local_run(const PipelineNode* node, PixelFormat format,
+                              PixelFormat current, int* halo) {
+    int count = 0;
+    bool neighborhood = false;
+    *halo = 0;
+
+    for (; node; node = node->next) {
+        int filter_halo_size = filter_halo(&node->filter);
+        PixelFormat needed = filter_supports_format(node->filter.type, format) ? format : pixel_format_float(format);
+        if (filter_halo_size < 0 || needed != current) break;
+        if (node->filter.type == FILTER_GRAYSCALE && pixel_format_gray(current) != current) break;
+
+        *halo += filter_halo_size;
+        if (filter_halo_size > 0) neighborhood = true;
+        count++;
+    }
+
+    return (count >= 2 && neighborhood) ? count : 0;
+}
+
+//*выполняет count фильтров, начиная с node, плитками стороны tile
+static bool pipeline_apply_tiled(const PipelineNode* node, int count, int halo, int tile,
+                                 Image** current, Image** spare) {
+    const Image* src = *current;
+    if (!image_reshape(*spare, src->width, src->height, src->format)) {
+        return false;
+    }
+
+    int tiles_x = (src->width + tile - 1) / tile;
+    int tiles_y = (src->height + tile - 1) / tile;
+
+    // Плитки распределяются по потокам пула; фильтры внутри плитки
+    // выполняются в своем потоке последовательно
+    PipelineTileJob job = {node, count, halo, tile, tiles_x, src, *spare, true};
+    parallel_for_rows(tiles_x * tiles_y, pipeline_tile_rows, &job);
+    if (!job.ok) {
+        return false;
+    }
+
+    *spare = *current;
+    *current = job.dst;
+    return true;
+}
+
+//ПРОФИЛИРОВАНИЕ
+
+//*описание фильтра с основным параметром для отчета (например, "blur 2")
+static int pipeline_describe_filter(const Filter* filter, char* text, size_t size) {
+    const char* name = filter_name(filter->type);
+    switch (filter->type) {
+        case FILTER_CROP:
+            if (filter->param4 != 0 || filter->param5 != 0) {
+                return snprintf(text, size, "%s %dx%d+%d+%d", name, filter->param1, filter->param2,
+                                filter->param4, filter->param5);
+            }
+            return snprintf(text, size, "%s %dx%d", name, filter->param1, filter->param2);
+        case FILTER_RESIZE:
+            return snprintf(text, size, "%s %dx%d", name, filter->param1, filter->param2);
+        case FILTER_MEDIAN:
+        case FILTER_CRYSTALLIZE:
+            return snprintf(text, size, "%s %d", name, filter->param1);
+        case FILTER_EDGE_DETECTION:
+        case FILTER_GAUSSIAN_BLUR:
+        case FILTER_GLASS:
+            return snprintf(text, size, "%s %g", name, filter->param3);
+        case FILTER_CONVOLUTION:
+            return snprintf(text, size, "%s %dx%d", name, filter->kernel->width, filter->kernel->height);
+        default:
+            return snprintf(text, size, "%s", name);
+    }
+}
+
+//*имя этапа из count фильтров, начиная с node: "blur 2", "fused(gs + neg)", "tiles 128(sharp + blur 2)"
+static void pipeline_stage_name(const PipelineNode* node, int count, int tile, char* text, size_t size) {
+    size_t length = 0;
+    int written = 0;
+
+    if (tile > 0) {
+        written = snprintf(text, size, "tiles %d(", tile);
+    } else if (count > 1) {
+        written = snprintf(text, size, "fused(");
+    }
+    length = (written > 0) ? (size_t)written : 0;
+
+    for (int i = 0; i < count && length < size; i++, node = node->next) {
+        if (i > 0) {
+            written = snprintf(text + length, size - length, " + ");
+            length += (written > 0) ? (size_t)written : 0;
+            if (length >= size) break;
+        }
+        written = pipeline_describe_filter(&node->filter, text + length, size - length);
+        length += (written > 0) ? (size_t)written : 0;
+    }
+    if (count > 1 && length < size) {
+        snprintf(text + length, size - length, ")");
+    }
+}
+
+//*перевод формата с замером, если включено профилирование
+static bool pipeline_convert_profiled(Pipeline* pipeline, Image** current, Image** spare,
+                                      PixelFormat format, uint8_t** alpha) {
+    if (!pipeline->profile) {
+        return pipeline_convert(current, spare, format, alpha);
+    }
+
+    ProfileMark mark;
+    char name[64];
+    profile_begin(&mark, *current, *spare);
+    bool ok = pipeline_convert(current, spare, format, alpha);
+    snprintf(name, sizeof(name), "convert %s", pixel_format_name(format));
+    profile_end(pipeline->profile, &mark, name, *current, *spare);
+    return ok;
+}
+
+//*применяет все фильтры к изображению *image, используя запасной буфер *spare
+//*фильтры работают на месте или поочередно в двух буферах, поэтому новая
+//*память выделяется, только если буферы малы; после вызова *image - результат
+//*изображение остается в своем формате; во float переводятся только
+//*участки пайплайна из фильтров, которым нужна точность float
+bool pipeline_run_buffered(Pipeline* pipeline, Image** image, Image** spare) {
+    if (!pipeline || !image || !*image || !spare || !*spare) return false;
+
+    Image* current = *image;
+    PixelFormat format = current->format;
+    uint8_t* alpha = NULL;  // альфа-канал на время работы во float
+    bool ok = true;
     
     PipelineNode* node = pipeline->head;
-    while (node) {
-        Image* next = filter_apply(&node->filter, current);
-        if (!next) {
-            image_free(current);
-            return NULL;
+    while (node && ok) {
+        FilterType type = node->filter.type;
+
+        // Переход во float перед фильтром, который не умеет работать с форматом,
+        // и обратно - как только следующий фильтр снова его поддерживает
+        PixelFormat needed = filter_supports_format(type, format) ? format : pixel_format_float(format);
+        if (current->format != needed && !pipeline_convert_profiled(pipeline, &current, spare, needed, &alpha)) {
+            ok = false;
+            break;
+        }
+
+        int width = current->width;
+        int height = current->height;
+        PipelineNode* first = node;
+        int stage_count = 1;
+
+        ProfileMark mark;
+        if (pipeline->profile) {
+            profile_begin(&mark, current, *spare);
+        }
+
+        // Участок из нескольких локальных фильтров выполняется плитками
+        int halo = 0;
+        int local = pipeline_local_run(node, format, current->format, &halo);
+        int tile = local ? pipeline_tile_size(pipeline, current, halo) : 0;
+
+        // Серия из нескольких поэлементных фильтров подряд сливается в один проход
+        int run = 0;
+        for (PipelineNode* n = node; n && filter_is_pointwise(n->filter.type); n = n->next) {
+            run++;
+        }
+
+        if (tile > 0) {
+            ok = pipeline_apply_tiled(node, local, halo, tile, &current, spare);
+            stage_count = local;
+            while (--local > 0) {
+                node = node->next;
+            }
+        } else if (run >= 2) {
+            ok = pipeline_apply_point_run(node, run, &current, spare);
+            stage_count = run;
+            while (--run > 0) {
+                node = node->next;
+            }
+        } else {
+            ok = filter_apply_buffered(&node->filter, &current, spare);
+        }
+
+        if (pipeline->profile) {
+            char name[96];
+            pipeline_stage_name(first, stage_count, tile, name, sizeof(name));
+            profile_end(pipeline->profile, &mark, name, current, *spare);
+        }
+
+        // После изменения размеров сохраненный альфа-канал больше не подходит
+        if (alpha && (current->width != width || current->height != height)) {
+            free(alpha);
+            alpha = NULL;
+        }
+
+        // Оттенки серого перевели изображение в одноканальный формат:
+        // дальше пайплайн работает с ним и возвращает результат в нем
+        if (pixel_format_channels(current->format) == 1 && pixel_format_channels(format) != 1) {
+            format = current->format;
         }
         
-        image_free(current);
-        current = next;
         node = node->next;
     }
-    
-    return current;
 
+    if (ok && current->format != format) {
+        ok = pipeline_convert_profiled(pipeline, &current, spare, format, &alpha);
+    }
+    free(alpha);
+
+    *image = current;
+    return ok;
+}
+
+//*применяет все фильтры к изображению, забирая его во владение
+//*при ошибке изображение освобождается и возвращается NULL
+Image* pipeline_run(Pipeline* pipeline, Image* image) {
+    Image* spare = image_create_empty();
+    if (!pipeline || !image || !spare) {
+        image_free(image);
+        image_free(spare);
+        return NULL;
+    }
+
+    bool ok = pipeline_run_buffered(pipeline, &image, &spare);
+    image_free(spare);
+
+    if (!ok) {
+        image_free(image);
+        return NULL;
+    }
+    return image;
+}
+
+//*применяет все фильтры к копии изображения (исходное не меняется)
+Image* pipeline_apply(Pipeline* pipeline, const Image* image) {
+    if (!pipeline || !image) return NULL;
+
+    ProfileMark mark;
+    if (pipeline->profile) {
+        profile_begin(&mark, NULL, NULL);
+    }
+    Image* current = image_clone(image);
+    if (!current) return NULL;
+    if (pipeline->profile) {
+        profile_end(pipeline->profile, &mark, "copy", current, NULL);
+    }
+
+    return pipeline_run(pipeline, current);
 }
@@ -3,10 +3,12 @@
 #define PIPELINE_H
 
 #include "filters.h"
+#include "profile.h"
 
 // Структура для узла пайплайна
 typedef struct PipelineNode {
     Filter filter;
+    ConvKernel* kernel;  // Собственная копия ядра свертки (filter.kernel указывает на нее)
     struct PipelineNode* next;
 } PipelineNode;
 
@@ -15,12 +17,52 @@ typedef struct {
     PipelineNode* head;
     PipelineNode* tail;
     int count;
+    int tile_size;  // Сторона плитки (0 - по размеру кэша L2, < 0 - без плиток)
+    Profile* profile;  // Замеры этапов (NULL - без профилирования), пайплайн им не владеет
 } Pipeline;
 
 // Функции пайплайна
 Pipeline* pipeline_create(void);
 void pipeline_free(Pipeline* pipeline);
 void pipeline_add_filter(Pipeline* pipeline, FilterType type, int param1, int param2, float param3);
+bool pipeline_add(Pipeline* pipeline, const Filter* filter);
+
+// Оптимизация перед выполнением: обрезка переносится вперед через локальные
+// фильтры (с запасом на их ореол), повторные оттенки серого и пары негативов
+// (только в 8- и 16-битных форматах, format - формат пикселей задания)
+// удаляются. Результат тот же, что и без оптимизации
+// merge_blurs - еще и слить соседние размытия в одно с sigma = sqrt(s1^2 + s2^2).
+// Это точно лишь для непрерывной Гауссианы без краев, поэтому результат
+// меняется: в полосе шириной 3 * (s1 + s2) у краев изображения (края
+// повторяются один раз вместо двух) - на десятки уровней из 255 (до 30 на
+// тестовых изображениях), дальше от краев - на 1 уровень (box при sigma < 2 -
+// до 4)
+void pipeline_optimize(Pipeline* pipeline, PixelFormat format, bool merge_blurs);
+
+// Начало пайплайна, которое выполняется при чтении файла
+typedef struct {
+    bool cropped;          // Читается только окно region
+    ImageRegion region;
+    bool gray;             // Пиксели декодируются сразу в оттенки серого (фильтр gs)
+    bool resized;          // Строки меняют размер по мере чтения (фильтр resize)
+    Filter resize;
+} PipelineSource;
+
+// Снимает с начала пайплайна обрезку, оттенки серого и изменение размеров
+// (в этом порядке, любое из них может отсутствовать), чтобы выполнить их при
+// чтении файла формата format: читаются и декодируются только строки и столбцы
+// окна, серое изображение декодируется сразу в одноканальный формат (если
+// оттенки серого его меняют), а изображение до изменения размеров в памяти
+// не создается
+// false - пайплайн начинается с другого фильтра (и не меняется)
+bool pipeline_take_source(Pipeline* pipeline, PixelFormat format, PipelineSource* source);
+
+// Формат результата пайплайна для изображения формата format:
+// после оттенков серого - одноканальный (см. pixel_format_gray)
+PixelFormat pipeline_output_format(const Pipeline* pipeline, PixelFormat format);
+
 Image* pipeline_apply(Pipeline* pipeline, const Image* image);
+Image* pipeline_run(Pipeline* pipeline, Image* image);
+bool pipeline_run_buffered(Pipeline* pipeline, Image** image, Image** spare);
 
 #endif // PIPELINE_H
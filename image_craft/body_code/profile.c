@@ -0,0 +1,241 @@
+#define _POSIX_C_SOURCE 200112L
+#include "profile.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Наибольшее число различаемых потоков (остальные получают последний номер)
+#define PROFILE_MAX_THREADS 64
+
+// Запись событий из нескольких потоков и номера этих потоков
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t profile_threads[PROFILE_MAX_THREADS];
+static int profile_thread_count = 0;
+
+// Сводка по этапу: все выполнения этапа с одним именем
+typedef struct {
+    const char* name;
+    int count;
+    double wall;
+    double cpu;
+    size_t bytes;
+    double pixels;         // Входные пиксели всех выполнений
+    long rss_kb;           // Наибольшая резидентная память после этапа
+    int width, height;     // Размеры результата последнего выполнения
+} ProfileStage;
+
+static double profile_clock(clockid_t clock) {
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) {
+        return 0.0;
+    }
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t profile_buffers(const Image* image, const Image* spare) {
+    return (image ? image->capacity : 0) + (spare ? spare->capacity : 0);
+}
+
+// Резидентная память процесса (Linux; -1, если неизвестна)
+static long profile_rss_kb(void) {
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) return -1;
+
+    long pages = -1, resident = -1;
+    if (fscanf(file, "%ld %ld", &pages, &resident) != 2) {
+        resident = -1;
+    }
+    fclose(file);
+    return (resident < 0) ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+Profile* profile_create(void) {
+    Profile* profile = (Profile*)calloc(1, sizeof(Profile));
+    if (profile) {
+        profile->origin = profile_clock(CLOCK_MONOTONIC);
+    }
+    return profile;
+}
+
+void profile_free(Profile* profile) {
+    if (!profile) return;
+    free(profile->events);
+    free(profile);
+}
+
+void profile_begin(ProfileMark* mark, const Image* image, const Image* spare) {
+    mark->bytes = profile_buffers(image, spare);
+    mark->width = image ? image->width : 0;
+    mark->height = image ? image->height : 0;
+    mark->cpu = profile_clock(CLOCK_PROCESS_CPUTIME_ID);
+    mark->wall = profile_clock(CLOCK_MONOTONIC);
+}
+
+// Номер текущего потока; вызывается под profile_lock
+static int profile_thread_index(void) {
+    pthread_t self = pthread_self();
+    for (int i = 0; i < profile_thread_count; i++) {
+        if (pthread_equal(profile_threads[i], self)) return i;
+    }
+    if (profile_thread_count == PROFILE_MAX_THREADS) {
+        return PROFILE_MAX_THREADS - 1;
+    }
+    profile_threads[profile_thread_count] = self;
+    return profile_thread_count++;
+}
+
+void profile_end(Profile* profile, const ProfileMark* mark, const char* name,
+                 const Image* image, const Image* spare) {
+    double wall = profile_clock(CLOCK_MONOTONIC);
+    double cpu = profile_clock(CLOCK_PROCESS_CPUTIME_ID);
+    size_t bytes = profile_buffers(image, spare);
+    long rss_kb = profile_rss_kb();
+
+    pthread_mutex_lock(&profile_lock);
+    if (profile->count == profile->capacity) {
+        int capacity = profile->capacity ? 2 * profile->capacity : 16;
+        ProfileEvent* events = (ProfileEvent*)realloc(profile->events, capacity * sizeof(ProfileEvent));
+        if (!events) {
+            pthread_mutex_unlock(&profile_lock);
+            return;  // Профиль неполон, но обработка продолжается
+        }
+        profile->events = events;
+        profile->capacity = capacity;
+    }
+
+    ProfileEvent* event = &profile->events[profile->count++];
+    snprintf(event->name, sizeof(event->name), "%s", name);
+    event->start = mark->wall - profile->origin;
+    event->wall = wall - mark->wall;
+    event->cpu = cpu - mark->cpu;
+    event->bytes = (bytes > mark->bytes) ? bytes - mark->bytes : 0;
+    event->rss_kb = rss_kb;
+    event->in_width = mark->width;
+    event->in_height = mark->height;
+    event->width = image ? image->width : 0;
+    event->height = image ? image->height : 0;
+    event->thread = profile_thread_index();
+    pthread_mutex_unlock(&profile_lock);
+}
+
+// Сводка этапов в порядке первого выполнения; возвращает их число (-1 при ошибке)
+static int profile_stages(const Profile* profile, ProfileStage** stages) {
+    *stages = (ProfileStage*)calloc(profile->count ? profile->count : 1, sizeof(ProfileStage));
+    if (!*stages) return -1;
+
+    int count = 0;
+    for (int i = 0; i < profile->count; i++) {
+        const ProfileEvent* event = &profile->events[i];
+        int s = 0;
+        while (s < count && strcmp((*stages)[s].name, event->name) != 0) s++;
+
+        ProfileStage* stage = &(*stages)[s];
+        if (s == count) {
+            stage->name = event->name;
+            count++;
+        }
+        stage->count++;
+        stage->wall += event->wall;
+        stage->cpu += event->cpu;
+        stage->bytes += event->bytes;
+        // У загрузки входа нет - пропускная способность считается по результату
+        if (event->in_width > 0) {
+            stage->pixels += (double)event->in_width * event->in_height;
+        } else {
+            stage->pixels += (double)event->width * event->height;
+        }
+        if (event->rss_kb > stage->rss_kb) stage->rss_kb = event->rss_kb;
+        stage->width = event->width;
+        stage->height = event->height;
+    }
+    return count;
+}
+
+static double profile_throughput(const ProfileStage* stage) {
+    return (stage->wall > 0) ? stage->pixels / 1e6 / stage->wall : 0.0;
+}
+
+// Печать текста UTF-8 с выравниванием по ширине в символах (printf считает байты)
+static void profile_print_cell(FILE* out, const char* text, int width, bool left) {
+    int length = 0;
+    for (const char* p = text; *p; p++) {
+        if (((unsigned char)*p & 0xC0) != 0x80) length++;
+    }
+    if (!left) fprintf(out, "%*s", width > length ? width - length : 0, "");
+    fputs(text, out);
+    if (left) fprintf(out, "%*s", width > length ? width - length : 0, "");
+}
+
+void profile_report(const Profile* profile, FILE* out) {
+    ProfileStage* stages;
+    int count = profile_stages(profile, &stages);
+    if (count < 0) return;
+
+    static const char* headers[] = {"Этап", "Раз", "Время, мс", "ЦП, мс", "Память, КБ", "Размер", "MPix/s"};
+    static const int widths[] = {40, 5, 11, 11, 12, 11, 10};
+    for (int i = 0; i < 7; i++) {
+        if (i) fputc(' ', out);
+        profile_print_cell(out, headers[i], widths[i], i == 0);
+    }
+    fputc('\n', out);
+
+    double total_wall = 0, total_cpu = 0;
+    for (int s = 0; s < count; s++) {
+        const ProfileStage* stage = &stages[s];
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", stage->width, stage->height);
+        fprintf(out, "%-40s %5d %11.2f %11.2f %12zu %11s %10.1f\n",
+                stage->name, stage->count, stage->wall * 1e3, stage->cpu * 1e3,
+                stage->bytes / 1024, size, profile_throughput(stage));
+        total_wall += stage->wall;
+        total_cpu += stage->cpu;
+    }
+    profile_print_cell(out, "Всего", 46, true);
+    fprintf(out, " %11.2f %11.2f\n", total_wall * 1e3, total_cpu * 1e3);
+    free(stages);
+}
+
+bool profile_write_json(const Profile* profile, const char* filename) {
+    ProfileStage* stages;
+    int count = profile_stages(profile, &stages);
+    if (count < 0) return false;
+
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        free(stages);
+        return false;
+    }
+
+    fprintf(file, "{\n  \"stages\": [");
+    for (int s = 0; s < count; s++) {
+        const ProfileStage* stage = &stages[s];
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"count\": %d, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+                      "\"bytes_allocated\": %zu, \"rss_kb\": %ld, \"width\": %d, \"height\": %d, "
+                      "\"mpix_per_s\": %.2f}",
+                s ? "," : "", stage->name, stage->count, stage->wall * 1e3, stage->cpu * 1e3,
+                stage->bytes, stage->rss_kb, stage->width, stage->height, profile_throughput(stage));
+    }
+    fprintf(file, "\n  ]\n}\n");
+    free(stages);
+    return fclose(file) == 0;
+}
+
+// Формат Trace Event: события "X" с началом и длительностью в микросекундах
+bool profile_write_trace(const Profile* profile, const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (!file) return false;
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (int i = 0; i < profile->count; i++) {
+        const ProfileEvent* event = &profile->events[i];
+        fprintf(file, "%s\n  {\"name\": \"%s\", \"cat\": \"stage\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                      "\"ts\": %.1f, \"dur\": %.1f, \"args\": {\"cpu_ms\": %.3f, \"bytes_allocated\": %zu, "
+                      "\"rss_kb\": %ld, \"width\": %d, \"height\": %d}}",
+                i ? "," : "", event->name, event->thread + 1, event->start * 1e6, event->wall * 1e6, event->cpu * 1e3,
+                event->bytes, event->rss_kb, event->width, event->height);
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,57 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "image.h"
+#include <stdio.h>
+
+// Профилирование этапов обработки (--profile)
+// Этап - загрузка, запись, перевод формата или фильтр пайплайна (слитые
+// поэлементные фильтры и участок плиток - один этап). Для каждого этапа
+// записываются время по часам и процессорное время всех потоков, рост
+// буферов изображения, размеры результата и пропускная способность
+// Пока профилирование выключено (профиль NULL), замеров нет вовсе
+// Этапы могут завершаться в разных потоках (пакетный режим)
+
+// Начало этапа
+typedef struct {
+    double wall;           // Время начала по монотонным часам, с
+    double cpu;            // Процессорное время процесса к началу, с
+    size_t bytes;          // Емкость буферов к началу
+    int width, height;     // Размеры входа этапа
+} ProfileMark;
+
+// Одно выполнение этапа
+typedef struct {
+    char name[96];
+    double start;          // Начало относительно создания профиля, с
+    double wall;           // Длительность по часам, с
+    double cpu;            // Процессорное время, с
+    size_t bytes;          // Память, выделенная под буферы изображения
+    long rss_kb;           // Резидентная память процесса после этапа
+    int in_width, in_height;  // Размеры входа (0 - этап без входного изображения)
+    int width, height;     // Размеры результата
+    int thread;            // Номер потока, выполнившего этап (с 0)
+} ProfileEvent;
+
+typedef struct {
+    ProfileEvent* events;
+    int count;
+    int capacity;
+    double origin;         // Время создания профиля
+} Profile;
+
+Profile* profile_create(void);
+void profile_free(Profile* profile);
+
+// Замер этапа: image и spare - буферы этапа (spare может быть NULL)
+void profile_begin(ProfileMark* mark, const Image* image, const Image* spare);
+void profile_end(Profile* profile, const ProfileMark* mark, const char* name,
+                 const Image* image, const Image* spare);
+
+// Отчет: таблица этапов (повторы одного этапа, например полосы --stream,
+// суммируются), JSON с той же сводкой или трасса для chrome://tracing
+void profile_report(const Profile* profile, FILE* out);
+bool profile_write_json(const Profile* profile, const char* filename);
+bool profile_write_trace(const Profile* profile, const char* filename);
+
+#endif // PROFILE_H
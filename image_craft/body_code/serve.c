@@ -0,0 +1,427 @@
+#define _POSIX_C_SOURCE 200112L
+#include "serve.h"
+#include "batch.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// Наибольшее число заданий одновременно (пар буферов изображения)
+#define SERVE_MAX_JOBS 256
+
+// Наибольшее число открытых соединений сокета
+#define SERVE_MAX_CONNECTIONS 256
+
+// Наибольшая длина строки задания и число слов в ней
+#define SERVE_LINE_SIZE 8192
+#define SERVE_MAX_TOKENS 256
+
+// Период проверки сигнала остановки в ожидании соединений, мс
+#define SERVE_POLL_MS 200
+
+// Буферы одного задания: переходят от задания к заданию
+typedef struct {
+    Image* image;
+    Image* spare;
+} ServeBuffers;
+
+// Свободные пары буферов; новые создаются, пока их меньше limit,
+// иначе задание ждет, пока другое вернет свою пару
+typedef struct {
+    ServeBuffers* free_list[SERVE_MAX_JOBS];
+    int free_count;
+    int created;
+    int limit;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+} ServePool;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_on_signal(int signal_number) {
+    (void)signal_number;
+    serve_stop = 1;
+}
+
+static double serve_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void serve_pool_init(ServePool* pool, int limit) {
+    pool->free_count = 0;
+    pool->created = 0;
+    pool->limit = (limit < 1) ? 1 : (limit > SERVE_MAX_JOBS) ? SERVE_MAX_JOBS : limit;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->available, NULL);
+}
+
+static void serve_buffers_free(ServeBuffers* buffers) {
+    if (!buffers) return;
+    image_free(buffers->image);
+    image_free(buffers->spare);
+    free(buffers);
+}
+
+static void serve_pool_free(ServePool* pool) {
+    for (int i = 0; i < pool->free_count; i++) {
+        serve_buffers_free(pool->free_list[i]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->available);
+}
+
+static ServeBuffers* serve_pool_take(ServePool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->free_count == 0 && pool->created == pool->limit) {
+        pthread_cond_wait(&pool->available, &pool->lock);
+    }
+    if (pool->free_count > 0) {
+        ServeBuffers* buffers = pool->free_list[--pool->free_count];
+        pthread_mutex_unlock(&pool->lock);
+        return buffers;
+    }
+    pool->created++;
+    pthread_mutex_unlock(&pool->lock);
+
+    ServeBuffers* buffers = (ServeBuffers*)malloc(sizeof(ServeBuffers));
+    if (buffers) {
+        buffers->image = image_create_empty();
+        buffers->spare = image_create_empty();
+        if (!buffers->image || !buffers->spare) {
+            serve_buffers_free(buffers);
+            buffers = NULL;
+        }
+    }
+    if (!buffers) {
+        pthread_mutex_lock(&pool->lock);
+        pool->created--;
+        pthread_cond_signal(&pool->available);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return buffers;
+}
+
+static void serve_pool_give(ServePool* pool, ServeBuffers* buffers) {
+    pthread_mutex_lock(&pool->lock);
+    pool->free_list[pool->free_count++] = buffers;
+    pthread_cond_signal(&pool->available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Делит строку на слова на месте: разделители - пробелы и табуляции,
+// слово в двойных кавычках может содержать пробелы
+// Возвращает число слов или -1 (незакрытая кавычка, слишком много слов)
+static int serve_split(char* line, char* tokens[], int max_tokens) {
+    int count = 0;
+    char* p = line;
+    while (true) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0') break;
+        if (count == max_tokens) return -1;
+
+        if (*p == '"') {
+            char* end = strchr(++p, '"');
+            if (!end) return -1;
+            *end = '\0';
+            tokens[count++] = p;
+            p = end + 1;
+        } else {
+            tokens[count++] = p;
+            p += strcspn(p, " \t");
+            if (*p != '\0') *p++ = '\0';
+        }
+    }
+    tokens[count] = NULL;
+    return count;
+}
+
+// Выполняет задание из строки и формирует строку ответа (без перевода строки)
+static void serve_job(const ServeConfig* config, ServePool* pool, char* line, char* reply, size_t reply_size) {
+    char* argv[SERVE_MAX_TOKENS + 1];
+    int argc = serve_split(line, argv, SERVE_MAX_TOKENS);
+    if (argc < 0) {
+        snprintf(reply, reply_size, "ERROR Незакрытая кавычка или слишком много слов");
+        return;
+    }
+    if (argc < 2) {
+        snprintf(reply, reply_size, "ERROR Нужны входной и выходной файлы");
+        return;
+    }
+
+    Pipeline* pipeline = pipeline_create();
+    if (!pipeline) {
+        snprintf(reply, reply_size, "ERROR Ошибка создания пайплайна");
+        return;
+    }
+
+    // Параметры командной строки действуют, пока задание их не переопределит
+    JobOptions options = config->defaults;
+    char error[256];
+    for (int i = 2; i < argc; i++) {
+        OptionsResult result = options_parse(argc, argv, &i, pipeline, &options, error, sizeof(error));
+        if (result == OPTIONS_UNKNOWN) {
+            snprintf(error, sizeof(error), "Неизвестный фильтр или неверные параметры: %s", argv[i]);
+        }
+        if (result != OPTIONS_PARSED) {
+            snprintf(reply, reply_size, "ERROR %s", error);
+            pipeline_free(pipeline);
+            return;
+        }
+    }
+    options_apply(pipeline, &options);
+    pipeline->profile = config->profile;
+
+    // Начальные обрезка и изменение размеров выполняются при чтении файла
+    PipelineSource source;
+    pipeline_take_source(pipeline, options.format, &source);
+
+    double start = serve_clock();
+    ServeBuffers* buffers = serve_pool_take(pool);
+    bool ok = buffers && batch_process_file(pipeline, &source, argv[0], argv[1], options.format,
+                                            &buffers->image, &buffers->spare);
+    if (ok) {
+        snprintf(reply, reply_size, "OK %dx%d %.1f", buffers->image->width, buffers->image->height,
+                 (serve_clock() - start) * 1e3);
+    } else {
+        snprintf(reply, reply_size, "ERROR Ошибка обработки: %s -> %s", argv[0], argv[1]);
+    }
+    if (buffers) {
+        serve_pool_give(pool, buffers);
+    }
+    pipeline_free(pipeline);
+}
+
+// Читает задания из in до конца ввода или строки "quit", ответы пишет в out
+static void serve_session(const ServeConfig* config, ServePool* pool, FILE* in, FILE* out) {
+    char line[SERVE_LINE_SIZE];
+    char reply[SERVE_LINE_SIZE + 64];
+    while (fgets(line, sizeof(line), in)) {
+        size_t length = strcspn(line, "\r\n");
+        bool complete = line[length] != '\0' || feof(in);
+        line[length] = '\0';
+
+        if (!complete) {
+            // Остаток слишком длинной строки пропускается
+            int c;
+            while ((c = fgetc(in)) != EOF && c != '\n') {}
+            snprintf(reply, sizeof(reply), "ERROR Слишком длинная строка задания");
+        } else {
+            const char* text = line;
+            while (*text == ' ' || *text == '\t') text++;
+            if (*text == '\0' || *text == '#') continue;
+            if (strcmp(text, "quit") == 0) break;
+            serve_job(config, pool, line, reply, sizeof(reply));
+        }
+
+        fprintf(out, "%s\n", reply);
+        if (fflush(out) != 0) break;  // Клиент закрыл соединение
+    }
+}
+
+bool serve_stdin(const ServeConfig* config) {
+    // Задания выполняются по порядку: одна пара буферов на весь процесс
+    ServePool pool;
+    serve_pool_init(&pool, 1);
+    serve_session(config, &pool, stdin, stdout);
+    serve_pool_free(&pool);
+    return !ferror(stdin);
+}
+
+// Соединение сокета и сервер, которому оно принадлежит
+typedef struct ServeServer ServeServer;
+
+typedef struct {
+    ServeServer* server;
+    int fd;                // -1 - слот свободен
+} ServeConnection;
+
+struct ServeServer {
+    const ServeConfig* config;
+    ServePool pool;
+    ServeConnection connections[SERVE_MAX_CONNECTIONS];
+    int active;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;   // Закрыто последнее соединение
+};
+
+static void* serve_connection(void* arg) {
+    ServeConnection* connection = (ServeConnection*)arg;
+    ServeServer* server = connection->server;
+    int fd = connection->fd;
+
+    // Чтение и запись через отдельные FILE: у сокета нет позиции
+    FILE* in = fdopen(fd, "r");
+    int out_fd = in ? dup(fd) : -1;
+    FILE* out = (out_fd >= 0) ? fdopen(out_fd, "w") : NULL;
+    if (in && out) {
+        serve_session(server->config, &server->pool, in, out);
+    }
+
+    // Слот освобождается до закрытия, чтобы остановка не тронула чужой дескриптор
+    pthread_mutex_lock(&server->lock);
+    connection->fd = -1;
+    server->active--;
+    pthread_cond_signal(&server->idle);
+    pthread_mutex_unlock(&server->lock);
+
+    if (out) {
+        fclose(out);
+    } else if (out_fd >= 0) {
+        close(out_fd);
+    }
+    if (in) {
+        fclose(in);
+    } else {
+        close(fd);
+    }
+    return NULL;
+}
+
+// Принимает соединение: поток на соединение, отказ при исчерпании слотов
+static void serve_accept(ServeServer* server, int fd) {
+    pthread_mutex_lock(&server->lock);
+    ServeConnection* connection = NULL;
+    for (int i = 0; i < SERVE_MAX_CONNECTIONS && !connection; i++) {
+        if (server->connections[i].fd < 0) connection = &server->connections[i];
+    }
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    bool started = false;
+    if (connection && pthread_attr_init(&attr) == 0) {
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        connection->fd = fd;
+        started = pthread_create(&thread, &attr, serve_connection, connection) == 0;
+        pthread_attr_destroy(&attr);
+        if (started) {
+            server->active++;
+        } else {
+            connection->fd = -1;
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    if (!started) {
+        static const char busy[] = "ERROR Сервер занят\n";
+        if (write(fd, busy, sizeof(busy) - 1) < 0) {
+            // Клиент уже отключился
+        }
+        close(fd);
+    }
+}
+
+// Удаляет сокет прежнего запуска; обычный файл по этому пути не трогается
+static bool serve_remove_socket(const char* path) {
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        return errno == ENOENT;
+    }
+    return S_ISSOCK(info.st_mode) && unlink(path) == 0;
+}
+
+bool serve_socket(const char* path, const ServeConfig* config) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Слишком длинный путь сокета: %s\n", path);
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    if (!serve_remove_socket(path)) {
+        fprintf(stderr, "Путь сокета занят: %s\n", path);
+        return false;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        fprintf(stderr, "Ошибка открытия сокета %s: %s\n", path, strerror(errno));
+        if (listener >= 0) close(listener);
+        return false;
+    }
+
+    // Остановка по сигналу; запись в закрытое клиентом соединение - не сигнал, а ошибка
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = serve_on_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int jobs = config->jobs;
+    if (jobs <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (jobs <= 0) jobs = 1;
+    }
+
+    ServeServer* server = (ServeServer*)malloc(sizeof(ServeServer));
+    if (!server) {
+        close(listener);
+        unlink(path);
+        return false;
+    }
+    server->config = config;
+    server->active = 0;
+    for (int i = 0; i < SERVE_MAX_CONNECTIONS; i++) {
+        server->connections[i].server = server;
+        server->connections[i].fd = -1;
+    }
+    serve_pool_init(&server->pool, jobs);
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->idle, NULL);
+
+    fprintf(stderr, "Ожидание заданий: %s\n", path);
+    bool ok = true;
+    while (!serve_stop) {
+        // Ожидание с таймаутом: сигнал может прийти в любой поток процесса
+        struct pollfd ready = {listener, POLLIN, 0};
+        int status = poll(&ready, 1, SERVE_POLL_MS);
+        if (status < 0 && errno != EINTR) {
+            ok = false;
+            break;
+        }
+        if (status <= 0) continue;
+
+        int fd = accept(listener, NULL, NULL);
+        if (fd >= 0) {
+            serve_accept(server, fd);
+        } else if (errno != EINTR && errno != ECONNABORTED) {
+            ok = false;
+            break;
+        }
+    }
+    close(listener);
+    unlink(path);
+
+    // Новых строк соединения не получат: текущие задания завершаются и отвечают
+    pthread_mutex_lock(&server->lock);
+    for (int i = 0; i < SERVE_MAX_CONNECTIONS; i++) {
+        if (server->connections[i].fd >= 0) {
+            shutdown(server->connections[i].fd, SHUT_RD);
+        }
+    }
+    while (server->active > 0) {
+        pthread_cond_wait(&server->idle, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    serve_pool_free(&server->pool);
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->idle);
+    free(server);
+    return ok;
+}
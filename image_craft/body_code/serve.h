@@ -0,0 +1,28 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "options.h"
+
+// Постоянный режим (--serve): один процесс выполняет задания одно за другим
+// Задание - строка "вход выход [фильтры и параметры...]" по правилам командной
+// строки (пути с пробелами - в двойных кавычках), пустые строки и строки с '#'
+// пропускаются. На каждое задание - строка ответа "OK <ширина>x<высота> <мс>"
+// или "ERROR <описание>"
+// Пул потоков, ядра Гаусса и буферы изображений сохраняются между заданиями,
+// поэтому задание не платит за запуск процесса и холодные кэши
+
+typedef struct {
+    JobOptions defaults;   // Параметры командной строки - значения по умолчанию
+    int jobs;              // Заданий одновременно через сокет (<= 0 - по числу ядер)
+    Profile* profile;      // Замеры всех заданий (NULL - без профилирования)
+} ServeConfig;
+
+// Задания из stdin, ответы в stdout; до конца ввода или строки "quit"
+bool serve_stdin(const ServeConfig* config);
+
+// Задания через Unix-сокет path: у каждого соединения своя последовательность
+// строк и ответов, строка "quit" закрывает соединение. Работает до SIGINT
+// или SIGTERM, после чего дожидается текущих заданий и удаляет файл сокета
+bool serve_socket(const char* path, const ServeConfig* config);
+
+#endif // SERVE_H
@@ -0,0 +1,160 @@
+#include "stream.h"
+#include "bmp.h"
+#include <stdlib.h>
+
+// Желаемый размер полосы результата в памяти (в байтах)
+#define STREAM_STRIP_BYTES (4 * 1024 * 1024)
+
+// Полоса не короче нескольких ореолов: ореол читается и обрабатывается
+// повторно для каждой полосы, и на коротких полосах он стоит дороже самой полосы
+#define STREAM_HALO_FACTOR 4
+
+bool stream_is_supported(const Pipeline* pipeline) {
+    for (const PipelineNode* node = pipeline->head; node; node = node->next) {
+        if (node->filter.type != FILTER_CROP && filter_halo(&node->filter) < 0) {
+            return false;  // Кристаллизация и стекло нелокальны
+        }
+    }
+    return true;
+}
+
+// Копия пайплайна для полос начиная с first: окна обрезки в ней
+// пересчитываются для каждой полосы
+static Pipeline* stream_copy_pipeline(const Pipeline* pipeline, const PipelineNode* first) {
+    Pipeline* copy = pipeline_create();
+    if (!copy) return NULL;
+
+    int count = 0;
+    for (const PipelineNode* node = first; node; node = node->next, count++) {
+        pipeline_add(copy, &node->filter);
+    }
+    copy->tile_size = pipeline->tile_size;
+    copy->profile = pipeline->profile;
+
+    if (copy->count != count) {
+        pipeline_free(copy);
+        return NULL;
+    }
+    return copy;
+}
+
+// Переносит окна обрезки на полосу: на входе полоса - строки [*begin, *begin + *rows)
+// изображения до первой обрезки, на выходе - строки изображения после последней
+// Ширина и высота изображения (width, height) нужны, чтобы ограничить окна так же,
+// как при обработке изображения целиком
+static void stream_clip_crops(const PipelineNode* node, PipelineNode* copy, int width, int height,
+                              int* begin, int* rows) {
+    for (; copy; copy = copy->next, node = node->next) {
+        if (copy->filter.type != FILTER_CROP) continue;
+
+        ImageRegion region = {node->filter.param4, node->filter.param5, node->filter.param1, node->filter.param2};
+        if (!image_region_clip(&region, width, height)) {
+            return;  // Пустое окно - ошибка будет при обработке полосы
+        }
+        int top = (region.y > *begin) ? region.y : *begin;
+        int bottom = (region.y + region.height < *begin + *rows) ? region.y + region.height : *begin + *rows;
+        copy->filter.param5 = top - *begin;
+        copy->filter.param2 = bottom - top;
+
+        *begin = top - region.y;
+        *rows = bottom - top;
+        width = region.width;
+        height = region.height;
+    }
+}
+
+bool stream_process(Pipeline* pipeline, const char* input_file, const char* output_file, PixelFormat format) {
+    if (!pipeline || !stream_is_supported(pipeline)) {
+        return false;
+    }
+
+    BMPReader* reader = bmp_reader_open(input_file);
+    if (!reader) {
+        return false;
+    }
+
+    // Начальная обрезка задает окно файла, которое читается полосами
+    const PipelineNode* first = pipeline->head;
+    ImageRegion source = {0, 0, reader->width, reader->height};
+    if (first && first->filter.type == FILTER_CROP) {
+        source = (ImageRegion){first->filter.param4, first->filter.param5, first->filter.param1, first->filter.param2};
+        first = first->next;
+    }
+    bool ok = image_region_clip(&source, reader->width, reader->height);
+
+    // Размеры результата, сдвиг его верхней строки относительно окна
+    // и суммарный ореол
+    int width = source.width;
+    int height = source.height;
+    int offset = 0;
+    int halo = 0;
+    for (const PipelineNode* node = first; node && ok; node = node->next) {
+        if (node->filter.type == FILTER_CROP) {
+            ImageRegion region = {node->filter.param4, node->filter.param5, node->filter.param1, node->filter.param2};
+            ok = image_region_clip(&region, width, height);
+            offset += region.y;
+            width = region.width;
+            height = region.height;
+        } else {
+            halo += filter_halo(&node->filter);
+        }
+    }
+
+    // Высота полосы: около STREAM_STRIP_BYTES, но не меньше нескольких ореолов
+    size_t row_size = (size_t)source.width * pixel_format_size(format);
+    int strip = (int)(STREAM_STRIP_BYTES / row_size);
+    if (strip < STREAM_HALO_FACTOR * halo) strip = STREAM_HALO_FACTOR * halo;
+    if (strip < 1) strip = 1;
+
+    Pipeline* strip_pipeline = ok ? stream_copy_pipeline(pipeline, first) : NULL;
+    Image* image = image_create_empty();
+    Image* spare = image_create_empty();
+    int bpp = bmp_output_bpp(pipeline_output_format(pipeline, format), reader->layout.alpha);
+    BMPWriter* writer = ok ? bmp_writer_open(output_file, &reader->info_header, width, height, bpp) : NULL;
+    ok = strip_pipeline && image && spare && writer;
+
+    for (int y = 0; y < height && ok; y += strip) {
+        int y_end = (y + strip < height) ? y + strip : height;
+
+        // Полоса с ореолом, обрезанным по краям окна: фильтры считают
+        // полосу целым изображением и портят у ее внутренних краев строки
+        // ореола, а сами строки полосы остаются верными
+        int read_begin = (y + offset - halo > 0) ? y + offset - halo : 0;
+        int read_end = (y_end + offset + halo < source.height) ? y_end + offset + halo : source.height;
+
+        ProfileMark mark;
+        if (pipeline->profile) {
+            profile_begin(&mark, image, spare);
+        }
+        ok = image_reshape(image, source.width, read_end - read_begin, format) &&
+             bmp_reader_read_region(reader, source.x, source.y + read_begin, read_end - read_begin, image, 0);
+        if (pipeline->profile) {
+            profile_end(pipeline->profile, &mark, "read strip", image, spare);
+        }
+        if (!ok) break;
+
+        int begin = read_begin;
+        int rows = read_end - read_begin;
+        stream_clip_crops(first, strip_pipeline->head, source.width, source.height, &begin, &rows);
+
+        ok = pipeline_run_buffered(strip_pipeline, &image, &spare);
+        if (!ok) break;
+
+        if (pipeline->profile) {
+            profile_begin(&mark, image, NULL);
+        }
+        ok = bmp_writer_write_rows(writer, image, y - begin, y_end - y);
+        if (pipeline->profile) {
+            profile_end(pipeline->profile, &mark, "write strip", image, NULL);
+        }
+    }
+
+    if (writer && !bmp_writer_close(writer)) {
+        ok = false;
+    }
+    image_free(image);
+    image_free(spare);
+    pipeline_free(strip_pipeline);
+    bmp_reader_close(reader);
+    return ok;
+}
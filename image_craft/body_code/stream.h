@@ -0,0 +1,14 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "pipeline.h"
+
+// Потоковая обработка BMP полосами строк
+// Каждая полоса результата читается из файла вместе с суммарным ореолом
+// фильтров, проходит весь пайплайн и сразу дописывается в выходной файл,
+// поэтому в памяти несколько полос, а не все изображение
+// Поддерживаются пайплайны из локальных фильтров и обрезки
+bool stream_is_supported(const Pipeline* pipeline);
+bool stream_process(Pipeline* pipeline, const char* input_file, const char* output_file, PixelFormat format);
+
+#endif // STREAM_H
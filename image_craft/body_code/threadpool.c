@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200112L
+#include "threadpool.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Наибольшее число потоков пула
+#define THREADPOOL_MAX_THREADS 256
+
+// Полос на поток: небольшой запас выравнивает нагрузку между потоками
+#define THREADPOOL_BANDS_PER_THREAD 4
+
+typedef struct {
+    pthread_t threads[THREADPOOL_MAX_THREADS];
+    int size;                 // Всего потоков, включая вызывающий
+    bool running;
+
+    pthread_mutex_t submit;   // Одна задача в пуле в каждый момент
+    pthread_mutex_t lock;
+    pthread_cond_t wake;      // Новая задача или остановка
+    pthread_cond_t done;      // Все полосы обработаны
+
+    // Текущая задача
+    RowBandFunc func;
+    void* context;
+    int rows;
+    int band_rows;
+    int next_row;             // Начало следующей свободной полосы
+    int active;               // Потоков, еще работающих над задачей
+    unsigned generation;      // Номер задачи (для пробуждения рабочих)
+} ThreadPool;
+
+static ThreadPool pool = {
+    .size = 1,
+    .submit = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER
+};
+
+// Забирает и обрабатывает полосы текущей задачи, пока они не кончатся
+// Вызывается с захваченным pool.lock
+static void threadpool_run_bands(void) {
+    while (pool.next_row < pool.rows) {
+        int y_begin = pool.next_row;
+        int y_end = y_begin + pool.band_rows;
+        if (y_end > pool.rows) y_end = pool.rows;
+        pool.next_row = y_end;
+
+        pthread_mutex_unlock(&pool.lock);
+        pool.func(pool.context, y_begin, y_end);
+        pthread_mutex_lock(&pool.lock);
+    }
+}
+
+static void* threadpool_worker(void* arg) {
+    (void)arg;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool.lock);
+    while (true) {
+        while (pool.running && pool.generation == seen) {
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        }
+        if (!pool.running) break;
+
+        seen = pool.generation;
+        pool.active++;
+        threadpool_run_bands();
+        if (--pool.active == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+bool threadpool_init(int threads) {
+    threadpool_shutdown();
+
+    if (threads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        if (threads <= 0) threads = 1;
+    }
+    if (threads > THREADPOOL_MAX_THREADS) threads = THREADPOOL_MAX_THREADS;
+
+    pool.running = true;
+    pool.size = 1;
+
+    // Вызывающий поток тоже обрабатывает полосы, поэтому рабочих на один меньше
+    for (int i = 0; i < threads - 1; i++) {
+        if (pthread_create(&pool.threads[i], NULL, threadpool_worker, NULL) != 0) {
+            break;
+        }
+        pool.size++;
+    }
+
+    return pool.size == threads;
+}
+
+void threadpool_shutdown(void) {
+    if (!pool.running) return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.running = false;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 0; i < pool.size - 1; i++) {
+        pthread_join(pool.threads[i], NULL);
+    }
+    pool.size = 1;
+}
+
+int threadpool_size(void) {
+    return pool.size;
+}
+
+void parallel_for_rows(int rows, RowBandFunc func, void* context) {
+    if (rows <= 0) return;
+
+    // Один поток, вложенный вызов или пул занят другой задачей - без распараллеливания
+    if (pool.size <= 1 || rows == 1 || pthread_mutex_trylock(&pool.submit) != 0) {
+        func(context, 0, rows);
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.func = func;
+    pool.context = context;
+    pool.rows = rows;
+    pool.band_rows = rows / (pool.size * THREADPOOL_BANDS_PER_THREAD);
+    if (pool.band_rows < 1) pool.band_rows = 1;
+    pool.next_row = 0;
+    pool.active = 1;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.wake);
+
+    threadpool_run_bands();
+    pool.active--;
+    while (pool.active > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    pthread_mutex_unlock(&pool.submit);
+}
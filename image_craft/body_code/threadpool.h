@@ -0,0 +1,20 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdbool.h>
+
+// Обработчик полосы строк [y_begin, y_end)
+typedef void (*RowBandFunc)(void* context, int y_begin, int y_end);
+
+// Инициализация общего пула потоков
+// threads <= 0 - по числу процессоров, 1 - без дополнительных потоков
+bool threadpool_init(int threads);
+void threadpool_shutdown(void);
+int threadpool_size(void);
+
+// Делит строки [0, rows) на полосы и обрабатывает их всеми потоками пула
+// Возвращается после обработки всех полос. Вызов изнутри другой параллельной
+// задачи (или пока пул занят) выполняется в вызывающем потоке последовательно
+void parallel_for_rows(int rows, RowBandFunc func, void* context);
+
+#endif // THREADPOOL_H